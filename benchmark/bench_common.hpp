@@ -0,0 +1,156 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <format>
+#include <print>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace benchmark
+{
+	using clock = std::chrono::steady_clock;
+
+	// 命令行选项, 由main解析, 各套件只读
+	struct config
+	{
+		std::filesystem::path work_dir = std::filesystem::temp_directory_path() / "qbot_memory_benchmark";
+		std::filesystem::path simple_path; // FTS5 simple分词扩展, 涉及数据库的套件必须提供
+		std::vector<std::size_t> rows{ 10'000, 100'000, 1'000'000, 10'000'000 };
+		int dimension = 384;
+		std::size_t ops = 1000; // 每个被测操作的调用次数
+		bool keep = false;      // 保留生成的数据库文件
+
+		// replay套件
+		std::filesystem::path trace_path;       // 为空时生成合成轨迹
+		std::filesystem::path write_trace_path; // 保存实际回放的轨迹
+		std::size_t threads = 8;                // 并发执行操作的线程数
+		std::size_t preload = 100'000;          // 回放前预先写入的消息数
+		double rate = 200.0;                    // 合成轨迹的平均每秒操作数
+		double duration = 60.0;                 // 合成轨迹的时长(秒)
+		double speed = 1.0;                     // 回放速度倍率, 0为不等待计划时间
+	};
+	inline config& options()
+	{
+		static config c;
+		return c;
+	}
+
+	inline double seconds_since(const clock::time_point start)
+	{
+		return std::chrono::duration<double>(clock::now() - start).count();
+	}
+
+	// p取值0~1, samples会被排序
+	inline double percentile(std::vector<double>& samples, const double p)
+	{
+		if (samples.empty())
+		{
+			return 0.0;
+		}
+		std::sort(samples.begin(), samples.end());
+		const auto index = static_cast<std::size_t>(p * static_cast<double>(samples.size() - 1) + 0.5);
+		return samples[std::min(index, samples.size() - 1)];
+	}
+
+	// 一组单次调用耗时(秒)的统计
+	struct latency_summary
+	{
+		std::size_t count = 0;
+		double total = 0.0;
+		double p50 = 0.0;
+		double p99 = 0.0;
+		double p999 = 0.0;
+		double max = 0.0;
+	};
+	inline latency_summary summarize(std::vector<double>& samples)
+	{
+		latency_summary res;
+		res.count = samples.size();
+		for (const auto i : samples)
+		{
+			res.total += i;
+		}
+		res.p50 = percentile(samples, 0.50);
+		res.p99 = percentile(samples, 0.99);
+		res.p999 = percentile(samples, 0.999);
+		res.max = samples.empty() ? 0.0 : samples.back();
+		return res;
+	}
+
+	// 每个测量结果输出为一行JSON(JSON Lines), 便于脚本收集并跨版本比较
+	class json_line
+	{
+	public:
+		json_line& add(std::string_view key, std::string_view value)
+		{
+			separator();
+			m_buffer += std::format("\"{}\":\"{}\"", key, escape(value));
+			return *this;
+		}
+		json_line& add(std::string_view key, const char* value)
+		{
+			return add(key, std::string_view(value));
+		}
+		json_line& add(std::string_view key, const double value)
+		{
+			separator();
+			m_buffer += std::format("\"{}\":{}", key, value);
+			return *this;
+		}
+		json_line& add(std::string_view key, const std::size_t value)
+		{
+			separator();
+			m_buffer += std::format("\"{}\":{}", key, value);
+			return *this;
+		}
+		json_line& add(std::string_view key, const int value)
+		{
+			separator();
+			m_buffer += std::format("\"{}\":{}", key, value);
+			return *this;
+		}
+		// 追加耗时统计, 单位微秒
+		json_line& add(const latency_summary& summary)
+		{
+			return add("ops", summary.count)
+				.add("mean_us", summary.count == 0 ? 0.0 : summary.total / static_cast<double>(summary.count) * 1e6)
+				.add("p50_us", summary.p50 * 1e6)
+				.add("p99_us", summary.p99 * 1e6)
+				.add("p999_us", summary.p999 * 1e6)
+				.add("max_us", summary.max * 1e6);
+		}
+		void print()
+		{
+			std::println("{{{}}}", m_buffer);
+		}
+	private:
+		std::string m_buffer;
+
+		void separator()
+		{
+			if (!m_buffer.empty())
+			{
+				m_buffer += ',';
+			}
+		}
+		static std::string escape(std::string_view value)
+		{
+			std::string res;
+			res.reserve(value.size());
+			for (const auto c : value)
+			{
+				switch (c)
+				{
+				case '"': res += "\\\""; break;
+				case '\\': res += "\\\\"; break;
+				case '\n': res += "\\n"; break;
+				default: res += c; break;
+				}
+			}
+			return res;
+		}
+	};
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <memory.hpp>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 确定性的合成数据: 同样的下标总是得到同样的消息, 同样的文本总是得到同样的向量
+// 不依赖向量服务, 不同机器、不同版本之间的结果可以直接比较
+namespace benchmark::data
+{
+	inline constexpr std::size_t k_users = 1000;
+	inline constexpr std::size_t k_base_time = 1'700'000'000;
+
+	inline std::uint64_t hash(std::string_view text)
+	{
+		std::uint64_t res = 14695981039346656037ull;
+		for (const auto c : text)
+		{
+			res ^= static_cast<unsigned char>(c);
+			res *= 1099511628211ull;
+		}
+		return res;
+	}
+
+	// 由文本哈希作为种子生成的单位向量
+	inline void embed_into(std::string_view text, const int dimension, float* out)
+	{
+		std::mt19937_64 generator(hash(text));
+		std::normal_distribution<float> distribution;
+		double norm = 0.0;
+		for (int i = 0; i < dimension; i++)
+		{
+			out[i] = distribution(generator);
+			norm += static_cast<double>(out[i]) * out[i];
+		}
+		const auto scale = static_cast<float>(1.0 / std::sqrt(norm > 0.0 ? norm : 1.0));
+		for (int i = 0; i < dimension; i++)
+		{
+			out[i] *= scale;
+		}
+	}
+	inline std::vector<float> embed(std::string_view text, const int dimension)
+	{
+		std::vector<float> res(dimension);
+		embed_into(text, dimension, res.data());
+		return res;
+	}
+	inline std::vector<float> embed_batch(const std::vector<std::string>& texts, const int dimension)
+	{
+		std::vector<float> res(texts.size() * dimension);
+		for (std::size_t i = 0; i < texts.size(); i++)
+		{
+			embed_into(texts[i], dimension, res.data() + i * dimension);
+		}
+		return res;
+	}
+
+	// 由常用字两两组合成的词表, 供消息与FTS查询使用
+	inline const std::vector<std::string>& words()
+	{
+		static const std::vector<std::string> res = []
+			{
+				constexpr std::string_view chars[] = {
+					"你", "好", "老", "爹", "幻", "蓝", "日", "今", "天", "吃", "饭", "了", "吗", "我", "们", "去",
+					"玩", "游", "戏", "看", "书", "早", "晚", "上", "下", "班", "学", "习", "猫", "狗", "水", "果",
+				};
+				std::vector<std::string> res;
+				for (const auto a : chars)
+				{
+					for (const auto b : chars)
+					{
+						res.emplace_back(std::format("{}{}", a, b));
+					}
+				}
+				return res;
+			}();
+		return res;
+	}
+	inline const std::string& word(const std::size_t i)
+	{
+		return words()[i % words().size()];
+	}
+
+	inline std::string sender_uuid(const std::size_t user)
+	{
+		return std::format("user{}", user % k_users);
+	}
+
+	// 第i条消息: 4~12个词, 发送者按i轮转, 时间按i递增, 1%的消息有遗忘概率
+	inline memory::insert_data message(const std::size_t i)
+	{
+		std::mt19937_64 generator(i);
+		const auto count = 4 + generator() % 9;
+		std::string text;
+		for (std::size_t w = 0; w < count; w++)
+		{
+			if (w != 0)
+			{
+				text += ' ';
+			}
+			text += word(generator());
+		}
+		return memory::insert_data{
+			k_base_time + i,
+			sender_uuid(i),
+			sender_uuid(i),
+			std::move(text),
+			i % 100 == 0 ? 0.5 : 0.0
+		};
+	}
+	inline std::vector<memory::insert_data> messages(const std::size_t begin, const std::size_t end)
+	{
+		std::vector<memory::insert_data> res;
+		res.reserve(end - begin);
+		for (auto i = begin; i < end; i++)
+		{
+			res.emplace_back(message(i));
+		}
+		return res;
+	}
+
+	// 使用合成向量的表
+	inline std::shared_ptr<memory::table> open_table(std::shared_ptr<memory::database> db, const std::string& name, const int dimension)
+	{
+		auto res = std::make_shared<memory::table>(db, name, dimension);
+		res->set_vector([dimension](std::string text) { return embed(text, dimension); });
+		res->set_vectors([dimension](std::vector<std::string> texts) { return embed_batch(texts, dimension); });
+		return res;
+	}
+}
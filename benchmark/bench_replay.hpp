@@ -0,0 +1,332 @@
+#pragma once
+#include "bench_common.hpp"
+#include "bench_data.hpp"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <exception>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <map>
+#include <memory.hpp>
+#include <memory>
+#include <print>
+#include <random>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// 回放按时间戳排列的操作序列, 模拟聊天机器人的混合读写负载
+//
+// 轨迹文件每行一个操作, 以制表符分隔, #开头的行为注释:
+//   offset_ms  op  sender_uuid  text
+// op取值与参数:
+//   add          sender_uuid, text为消息
+//   adds         text为合成消息的条数
+//   vector       text为查询文本
+//   vectors      text为合成查询的条数
+//   fts          text为FTS5查询
+//   uuid         sender_uuid
+//   time         text为时间窗口(秒), 查询最近的消息
+//   id           text为行id
+//   forgotten    无参数
+//   rebuild      无参数
+// 未指定--trace时按--rate与--duration生成合成轨迹, 可用--write-trace保存
+namespace benchmark
+{
+	struct trace_event
+	{
+		std::size_t offset_ms;
+		std::string op;
+		std::string sender_uuid;
+		std::string text;
+	};
+
+	inline std::size_t parse_trace_number(std::string_view value)
+	{
+		std::size_t res = 0;
+		auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), res);
+		if (ec != std::errc{})
+		{
+			throw std::invalid_argument(std::format("轨迹中的无效数值: {}", value));
+		}
+		return res;
+	}
+
+	inline std::vector<trace_event> read_trace(const std::filesystem::path& path)
+	{
+		std::ifstream file(path);
+		if (!file)
+		{
+			throw std::runtime_error(std::format("无法打开轨迹文件: {}", path.string()));
+		}
+		std::vector<trace_event> res;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			if (line.empty() || line.front() == '#')
+			{
+				continue;
+			}
+			std::vector<std::string_view> fields;
+			for (const auto field : std::views::split(std::string_view(line), '\t'))
+			{
+				fields.emplace_back(field.begin(), field.end());
+			}
+			fields.resize(4);
+			res.emplace_back(parse_trace_number(fields[0]), std::string(fields[1]), std::string(fields[2]), std::string(fields[3]));
+		}
+		std::ranges::stable_sort(res, {}, &trace_event::offset_ms);
+		return res;
+	}
+
+	inline void write_trace(const std::filesystem::path& path, const std::vector<trace_event>& events)
+	{
+		std::ofstream file(path);
+		file << "# offset_ms\top\tsender_uuid\ttext\n";
+		for (const auto& e : events)
+		{
+			file << e.offset_ms << '\t' << e.op << '\t' << e.sender_uuid << '\t' << e.text << '\n';
+		}
+	}
+
+	// 泊松到达的合成轨迹: 每10秒有2秒的5倍速率突发, 操作按固定比例混合, 每30秒一次forgotten
+	inline std::vector<trace_event> synthetic_trace(const double rate, const double duration, const std::size_t preload)
+	{
+		struct mix_entry
+		{
+			std::string_view op;
+			double weight;
+		};
+		constexpr mix_entry mix[] = {
+			{ "add", 0.40 }, { "adds", 0.03 }, { "vector", 0.30 }, { "vectors", 0.02 },
+			{ "fts", 0.15 }, { "uuid", 0.05 }, { "time", 0.03 }, { "id", 0.02 },
+		};
+		std::vector<double> weights;
+		for (const auto& m : mix)
+		{
+			weights.emplace_back(m.weight);
+		}
+
+		std::mt19937_64 generator(42);
+		std::discrete_distribution<std::size_t> pick(weights.begin(), weights.end());
+		std::vector<trace_event> res;
+		auto next_message = std::max<std::size_t>(preload, 1);
+		double t = 0.0;
+		double next_forgotten = 30.0;
+		while (t < duration)
+		{
+			const bool burst = std::fmod(t, 10.0) < 2.0;
+			t += std::exponential_distribution<double>(burst ? rate * 5.0 : rate)(generator);
+			while (next_forgotten <= t && next_forgotten < duration)
+			{
+				res.emplace_back(static_cast<std::size_t>(next_forgotten * 1000.0), "forgotten", "", "");
+				next_forgotten += 30.0;
+			}
+			const auto offset_ms = static_cast<std::size_t>(t * 1000.0);
+			const auto op = mix[pick(generator)].op;
+			if (op == "add")
+			{
+				auto data = data::message(next_message++);
+				res.emplace_back(offset_ms, "add", std::move(data.sender_uuid), std::move(data.message));
+			}
+			else if (op == "adds") { res.emplace_back(offset_ms, "adds", "", "50"); }
+			else if (op == "vector") { res.emplace_back(offset_ms, "vector", "", data::message(generator() % next_message).message); }
+			else if (op == "vectors") { res.emplace_back(offset_ms, "vectors", "", "16"); }
+			else if (op == "fts") { res.emplace_back(offset_ms, "fts", "", data::word(generator())); }
+			else if (op == "uuid") { res.emplace_back(offset_ms, "uuid", data::sender_uuid(generator()), ""); }
+			else if (op == "time") { res.emplace_back(offset_ms, "time", "", "60"); }
+			else { res.emplace_back(offset_ms, "id", "", std::to_string(generator() % next_message + 1)); }
+		}
+		return res;
+	}
+
+	// 每个线程各自记录, 结束后按操作类型合并
+	struct replay_samples
+	{
+		std::vector<double> latency; // 从计划时间到完成, 包含排队等待
+		std::vector<double> service; // 从开始执行到完成
+		std::size_t errors = 0;
+	};
+
+	inline void bench_replay()
+	{
+		const auto& opt = options();
+		if (opt.simple_path.empty())
+		{
+			std::println(stderr, "replay: 需要通过--simple=<路径>指定simple分词扩展, 已跳过");
+			return;
+		}
+
+		const auto events = opt.trace_path.empty()
+			? synthetic_trace(opt.rate, opt.duration, opt.preload)
+			: read_trace(opt.trace_path);
+		if (!opt.write_trace_path.empty())
+		{
+			write_trace(opt.write_trace_path, events);
+		}
+
+		const auto dir = opt.work_dir / "replay";
+		std::filesystem::remove_all(dir);
+		std::filesystem::create_directories(dir);
+		auto db = std::make_shared<memory::database>(dir / "replay.db", opt.simple_path);
+		db->set_synchronous(memory::sqlite::synchronous_mode::NORMAL);
+		auto table = data::open_table(db, "replay", opt.dimension);
+		for (std::size_t begin = 0; begin < opt.preload; begin += 10'000)
+		{
+			table->adds(data::messages(begin, std::min<std::size_t>(begin + 10'000, opt.preload)));
+		}
+
+		std::atomic<std::size_t> synthetic_next{ opt.preload + events.size() };
+		auto execute = [&](const trace_event& e, std::mt19937_64& generator)
+			{
+				if (e.op == "add")
+				{
+					table->add(memory::insert_data{ data::k_base_time + opt.preload + e.offset_ms / 1000, e.sender_uuid, e.sender_uuid, e.text, 0.0 });
+				}
+				else if (e.op == "adds")
+				{
+					const auto count = parse_trace_number(e.text);
+					const auto begin = synthetic_next.fetch_add(count);
+					table->adds(data::messages(begin, begin + count));
+				}
+				else if (e.op == "vector")
+				{
+					table->search_list_vector_text(e.text, 10);
+				}
+				else if (e.op == "vectors")
+				{
+					std::vector<std::string> queries;
+					for (std::size_t i = parse_trace_number(e.text); i > 0; i--)
+					{
+						queries.emplace_back(data::message(generator() % (opt.preload + 1)).message);
+					}
+					table->search_list_vector_texts(queries, 10);
+				}
+				else if (e.op == "fts")
+				{
+					table->search_list_fts_impl(e.text, {}, {}, {}, 20);
+				}
+				else if (e.op == "uuid")
+				{
+					table->search_list_uuid_limit(e.sender_uuid, 20);
+				}
+				else if (e.op == "time")
+				{
+					const auto now = data::k_base_time + opt.preload + e.offset_ms / 1000;
+					table->search_list_time_start(now - std::min(now, parse_trace_number(e.text)));
+				}
+				else if (e.op == "id")
+				{
+					table->search_id(static_cast<std::int64_t>(parse_trace_number(e.text)));
+				}
+				else if (e.op == "forgotten")
+				{
+					table->forgotten();
+				}
+				else if (e.op == "rebuild")
+				{
+					table->rebuild_faiss_index();
+				}
+				else
+				{
+					throw std::invalid_argument(std::format("未知操作: {}", e.op));
+				}
+			};
+
+		// 开环回放: 操作按计划时间发出, 不因前面的操作变慢而推迟, 排队等待计入latency
+		// --speed=0时不等待计划时间, 各线程尽快执行(闭环)
+		const auto threads = std::max<std::size_t>(opt.threads, 1);
+		std::vector<std::map<std::string, replay_samples>> thread_samples(threads);
+		std::atomic<std::size_t> next{ 0 };
+		const auto start = clock::now();
+		{
+			std::vector<std::jthread> workers;
+			for (std::size_t w = 0; w < threads; w++)
+			{
+				workers.emplace_back([&, w]
+					{
+						std::mt19937_64 generator(w);
+						auto& samples = thread_samples[w];
+						for (auto i = next.fetch_add(1); i < events.size(); i = next.fetch_add(1))
+						{
+							const auto& e = events[i];
+							auto scheduled = clock::now();
+							if (opt.speed > 0.0)
+							{
+								scheduled = start + std::chrono::duration_cast<clock::duration>(
+									std::chrono::duration<double, std::milli>(static_cast<double>(e.offset_ms) / opt.speed));
+								std::this_thread::sleep_until(scheduled);
+							}
+							const auto begin = clock::now();
+							auto& s = samples[e.op];
+							try
+							{
+								execute(e, generator);
+							}
+							catch (const std::exception&)
+							{
+								s.errors++;
+							}
+							const auto end = clock::now();
+							s.latency.emplace_back(std::chrono::duration<double>(end - scheduled).count());
+							s.service.emplace_back(std::chrono::duration<double>(end - begin).count());
+						}
+					});
+			}
+		}
+		const auto seconds = seconds_since(start);
+
+		std::map<std::string, replay_samples> merged;
+		for (auto& per_thread : thread_samples)
+		{
+			for (auto& [op, s] : per_thread)
+			{
+				auto& m = merged[op];
+				m.latency.insert(m.latency.end(), s.latency.begin(), s.latency.end());
+				m.service.insert(m.service.end(), s.service.begin(), s.service.end());
+				m.errors += s.errors;
+			}
+		}
+		for (auto& [op, s] : merged)
+		{
+			const auto service = summarize(s.service);
+			json_line{}
+				.add("suite", "replay")
+				.add("op", op)
+				.add("threads", threads)
+				.add("speed", opt.speed)
+				.add(summarize(s.latency))
+				.add("service_p50_us", service.p50 * 1e6)
+				.add("service_p99_us", service.p99 * 1e6)
+				.add("service_p999_us", service.p999 * 1e6)
+				.add("errors", s.errors)
+				.add("ops_per_second", static_cast<double>(s.latency.size()) / seconds)
+				.print();
+		}
+		json_line{}
+			.add("suite", "replay")
+			.add("op", "total")
+			.add("threads", threads)
+			.add("speed", opt.speed)
+			.add("events", events.size())
+			.add("preload", opt.preload)
+			.add("seconds", seconds)
+			.add("ops_per_second", static_cast<double>(events.size()) / seconds)
+			.print();
+
+		table.reset();
+		db.reset();
+		if (!opt.keep)
+		{
+			std::filesystem::remove_all(dir);
+		}
+	}
+}
@@ -0,0 +1,190 @@
+#pragma once
+#include "bench_common.hpp"
+#include "bench_data.hpp"
+#include <cstddef>
+#include <filesystem>
+#include <format>
+#include <memory.hpp>
+#include <memory>
+#include <print>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace benchmark
+{
+	inline constexpr std::size_t k_populate_batch = 10'000;
+	inline constexpr faiss::idx_t k_search_k = 10;
+	inline constexpr std::size_t k_search_limit = 20;
+	inline constexpr std::size_t k_batch_queries = 32;
+	inline constexpr std::size_t k_adds_batch = 100;
+	inline constexpr std::size_t k_time_window = 100;
+	inline constexpr std::size_t k_rerank_oversample = 4;
+
+	// 调用ops次func(i), 输出每次调用的耗时统计
+	template <class F>
+	void measure_table_op(std::string_view op, const std::size_t rows, const std::size_t ops, F&& func)
+	{
+		std::vector<double> samples;
+		samples.reserve(ops);
+		const auto start = clock::now();
+		for (std::size_t i = 0; i < ops; i++)
+		{
+			const auto op_start = clock::now();
+			func(i);
+			samples.emplace_back(seconds_since(op_start));
+		}
+		const auto seconds = seconds_since(start);
+		json_line{}
+			.add("suite", "table")
+			.add("case", op)
+			.add("rows", rows)
+			.add("dimension", options().dimension)
+			.add(summarize(samples))
+			.add("ops_per_second", static_cast<double>(ops) / seconds)
+			.print();
+	}
+
+	inline void bench_table_size(const std::size_t rows)
+	{
+		const auto& opt = options();
+		const auto dir = opt.work_dir / std::format("table_{}", rows);
+		std::filesystem::remove_all(dir);
+		std::filesystem::create_directories(dir);
+
+		auto db = std::make_shared<memory::database>(dir / "bench.db", opt.simple_path);
+		db->set_synchronous(memory::sqlite::synchronous_mode::NORMAL);
+		auto table = data::open_table(db, "bench", opt.dimension);
+
+		// 填充阶段即adds的大批量吞吐
+		{
+			const auto start = clock::now();
+			for (std::size_t begin = 0; begin < rows; begin += k_populate_batch)
+			{
+				table->adds(data::messages(begin, std::min(begin + k_populate_batch, rows)));
+			}
+			const auto seconds = seconds_since(start);
+			json_line{}
+				.add("suite", "table")
+				.add("case", "populate")
+				.add("rows", rows)
+				.add("dimension", opt.dimension)
+				.add("batch", k_populate_batch)
+				.add("seconds", seconds)
+				.add("rows_per_second", static_cast<double>(rows) / seconds)
+				.print();
+		}
+
+		std::mt19937_64 generator(rows);
+		auto random_row = [&] { return generator() % rows; };
+
+		// 只读操作
+		measure_table_op("search_id", rows, opt.ops, [&](std::size_t)
+			{
+				table->search_id(static_cast<std::int64_t>(random_row() + 1));
+			});
+		measure_table_op("search_list_uuid", rows, opt.ops, [&](std::size_t)
+			{
+				table->search_list_uuid(data::sender_uuid(random_row()));
+			});
+		measure_table_op("search_list_uuid_limit", rows, opt.ops, [&](std::size_t)
+			{
+				table->search_list_uuid_limit(data::sender_uuid(random_row()), k_search_limit);
+			});
+		measure_table_op("search_list_time_start", rows, opt.ops, [&](std::size_t)
+			{
+				table->search_list_time_start(data::k_base_time + rows - k_time_window);
+			});
+		measure_table_op("search_list_time_end", rows, opt.ops, [&](std::size_t)
+			{
+				table->search_list_time_end(data::k_base_time + k_time_window);
+			});
+		measure_table_op("search_list_time_start_end", rows, opt.ops, [&](std::size_t)
+			{
+				const auto start = data::k_base_time + random_row();
+				table->search_list_time_start_end(start, start + k_time_window);
+			});
+		measure_table_op("search_list_fts_impl", rows, opt.ops, [&](std::size_t)
+			{
+				table->search_list_fts_impl(data::word(generator()), {}, {}, {}, k_search_limit);
+			});
+		measure_table_op("search_list_fts_impl_simple_query", rows, opt.ops, [&](std::size_t)
+			{
+				table->search_list_fts_impl({}, std::vector<std::string>{ data::word(generator()) }, {}, {}, k_search_limit);
+			});
+		measure_table_op("search_list_vector_text", rows, opt.ops, [&](std::size_t)
+			{
+				table->search_list_vector_text(data::message(random_row()).message, k_search_k);
+			});
+		measure_table_op("search_list_vector_texts", rows, std::max<std::size_t>(opt.ops / k_batch_queries, 1), [&](std::size_t)
+			{
+				std::vector<std::string> queries;
+				for (std::size_t q = 0; q < k_batch_queries; q++)
+				{
+					queries.emplace_back(data::message(random_row()).message);
+				}
+				table->search_list_vector_texts(queries, k_search_k);
+			});
+		// 重排: 多取候选后按全精度向量精确重算距离
+		table->set_rerank_oversample(k_rerank_oversample);
+		measure_table_op("search_list_vector_text_rerank", rows, opt.ops, [&](std::size_t)
+			{
+				table->search_list_vector_text(data::message(random_row()).message, k_search_k);
+			});
+		table->set_rerank_oversample(1);
+
+		// 写入操作, 新消息的下标接在已有行之后
+		auto next = rows;
+		measure_table_op("add", rows, opt.ops, [&](std::size_t)
+			{
+				table->add(data::message(next++));
+			});
+		measure_table_op("adds", rows, std::max<std::size_t>(opt.ops / k_adds_batch, 1), [&](std::size_t)
+			{
+				table->adds(data::messages(next, next + k_adds_batch));
+				next += k_adds_batch;
+			});
+
+		// 索引持久化: 保存, 以及重新打开表时读取索引
+		measure_table_op("save_faiss_index", rows, 3, [&](std::size_t)
+			{
+				table->save_faiss_index();
+			});
+		table.reset();
+		measure_table_op("load_faiss_index", rows, 1, [&](std::size_t)
+			{
+				table = data::open_table(db, "bench", opt.dimension);
+			});
+
+		// 重建与遗忘会修改整个索引, 放在最后
+		measure_table_op("rebuild_faiss_index", rows, 1, [&](std::size_t)
+			{
+				table->rebuild_faiss_index();
+			});
+		measure_table_op("forgotten", rows, 1, [&](std::size_t)
+			{
+				table->forgotten();
+			});
+
+		table.reset();
+		db.reset();
+		if (!opt.keep)
+		{
+			std::filesystem::remove_all(dir);
+		}
+	}
+
+	inline void bench_table()
+	{
+		if (options().simple_path.empty())
+		{
+			std::println(stderr, "table: 需要通过--simple=<路径>指定simple分词扩展, 已跳过");
+			return;
+		}
+		for (const auto rows : options().rows)
+		{
+			bench_table_size(rows);
+		}
+	}
+}
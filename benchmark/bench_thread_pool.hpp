@@ -0,0 +1,153 @@
+#pragma once
+#include "bench_common.hpp"
+#include "legacy_thread_pool.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <memory>
+#include <thread>
+#include <thread_pool.hpp>
+#include <vector>
+
+namespace benchmark
+{
+	// 旧线程池的线程数与容量是模板参数, 两组线程池统一使用相同的配置
+	inline constexpr std::size_t k_pool_threads = 4;
+	inline constexpr std::size_t k_pool_max_tasks = 64;
+
+	// 模拟一个很短的任务
+	inline void spin_work(const std::size_t iterations)
+	{
+		volatile std::size_t sink = 0;
+		for (std::size_t i = 0; i < iterations; i++)
+		{
+			sink = sink + i;
+		}
+	}
+
+	struct legacy_pool_adapter
+	{
+		static constexpr const char* name = "legacy";
+		legacy::thread_pool<k_pool_threads, k_pool_max_tasks> pool;
+
+		// 旧线程池满时直接返回空的future, 只能自旋重试
+		std::future<void> submit(std::function<void()> f, memory::thread_pool::priority)
+		{
+			while (true)
+			{
+				auto future = pool.enqueue(f);
+				if (future.valid())
+				{
+					return future;
+				}
+				std::this_thread::yield();
+			}
+		}
+	};
+
+	struct work_stealing_pool_adapter
+	{
+		static constexpr const char* name = "work_stealing";
+		memory::thread_pool::thread_pool pool{ k_pool_threads, k_pool_max_tasks };
+
+		std::future<void> submit(std::function<void()> f, memory::thread_pool::priority p)
+		{
+			return pool.enqueue(std::move(f), p);
+		}
+	};
+
+	template <class Adapter>
+	void bench_thread_pool_throughput(const std::size_t tasks, const std::size_t producers, const std::size_t work)
+	{
+		auto adapter = std::make_unique<Adapter>();
+		const auto start = clock::now();
+		std::vector<std::jthread> threads;
+		for (std::size_t p = 0; p < producers; p++)
+		{
+			threads.emplace_back([&, p]
+				{
+					std::vector<std::future<void>> futures;
+					futures.reserve(tasks / producers + 1);
+					for (std::size_t i = p; i < tasks; i += producers)
+					{
+						futures.emplace_back(adapter->submit([work] { spin_work(work); }, memory::thread_pool::priority::interactive));
+					}
+					for (auto& future : futures)
+					{
+						future.get();
+					}
+				});
+		}
+		threads.clear();
+		const auto seconds = seconds_since(start);
+		json_line{}
+			.add("suite", "thread_pool")
+			.add("case", "throughput")
+			.add("pool", Adapter::name)
+			.add("threads", k_pool_threads)
+			.add("producers", producers)
+			.add("tasks", tasks)
+			.add("work", work)
+			.add("seconds", seconds)
+			.add("tasks_per_second", static_cast<double>(tasks) / seconds)
+			.print();
+	}
+
+	// 后台任务持续占满线程池时, 交互任务从提交到开始执行的延迟
+	template <class Adapter>
+	void bench_thread_pool_interactive_latency(const std::size_t background_tasks, const std::size_t interactive_tasks, const std::size_t work)
+	{
+		auto adapter = std::make_unique<Adapter>();
+		std::atomic_bool background_done{ false };
+		std::jthread background([&]
+			{
+				std::vector<std::future<void>> futures;
+				futures.reserve(background_tasks);
+				for (std::size_t i = 0; i < background_tasks; i++)
+				{
+					futures.emplace_back(adapter->submit([work] { spin_work(work); }, memory::thread_pool::priority::background));
+				}
+				for (auto& future : futures)
+				{
+					future.get();
+				}
+				background_done = true;
+			});
+
+		std::vector<double> latencies(interactive_tasks);
+		for (std::size_t i = 0; i < interactive_tasks && !background_done; i++)
+		{
+			const auto submit_time = clock::now();
+			auto& latency = latencies[i];
+			adapter->submit([&latency, submit_time] { latency = seconds_since(submit_time); }, memory::thread_pool::priority::interactive).get();
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+		}
+		background.join();
+
+		std::erase(latencies, 0.0);
+		const auto samples = latencies.size();
+		json_line{}
+			.add("suite", "thread_pool")
+			.add("case", "interactive_latency")
+			.add("pool", Adapter::name)
+			.add("threads", k_pool_threads)
+			.add("background_tasks", background_tasks)
+			.add("samples", samples)
+			.add("p50_us", percentile(latencies, 0.50) * 1e6)
+			.add("p99_us", percentile(latencies, 0.99) * 1e6)
+			.print();
+	}
+
+	inline void bench_thread_pool()
+	{
+		for (const auto producers : { std::size_t{ 1 }, std::size_t{ 4 } })
+		{
+			bench_thread_pool_throughput<legacy_pool_adapter>(200'000, producers, 64);
+			bench_thread_pool_throughput<work_stealing_pool_adapter>(200'000, producers, 64);
+		}
+		bench_thread_pool_interactive_latency<legacy_pool_adapter>(20'000, 500, 20'000);
+		bench_thread_pool_interactive_latency<work_stealing_pool_adapter>(20'000, 500, 20'000);
+	}
+}
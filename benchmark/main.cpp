@@ -0,0 +1,130 @@
+#include "bench_common.hpp"
+#include "bench_replay.hpp"
+#include "bench_table.hpp"
+#include "bench_thread_pool.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <format>
+#include <functional>
+#include <print>
+#include <ranges>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	std::size_t parse_size(std::string_view value)
+	{
+		std::size_t res = 0;
+		auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), res);
+		if (ec != std::errc{} || ptr != value.data() + value.size())
+		{
+			throw std::invalid_argument(std::format("无效的数值: {}", value));
+		}
+		return res;
+	}
+	double parse_double(std::string_view value)
+	{
+		double res = 0.0;
+		auto [ptr, ec] = std::from_chars(value.data(), value.data() + value.size(), res);
+		if (ec != std::errc{} || ptr != value.data() + value.size())
+		{
+			throw std::invalid_argument(std::format("无效的数值: {}", value));
+		}
+		return res;
+	}
+
+	// --key=value形式的选项写入benchmark::options(), 其余参数作为套件名返回
+	std::vector<std::string_view> parse_args(int argc, char** argv)
+	{
+		auto& opt = benchmark::options();
+		std::vector<std::string_view> suites;
+		for (int i = 1; i < argc; i++)
+		{
+			std::string_view arg = argv[i];
+			if (!arg.starts_with("--"))
+			{
+				suites.emplace_back(arg);
+				continue;
+			}
+			const auto eq = arg.find('=');
+			const auto key = arg.substr(2, eq == std::string_view::npos ? std::string_view::npos : eq - 2);
+			const auto value = eq == std::string_view::npos ? std::string_view{} : arg.substr(eq + 1);
+			if (key == "dir") { opt.work_dir = std::string(value); }
+			else if (key == "simple") { opt.simple_path = std::string(value); }
+			else if (key == "dim") { opt.dimension = static_cast<int>(parse_size(value)); }
+			else if (key == "ops") { opt.ops = parse_size(value); }
+			else if (key == "keep") { opt.keep = true; }
+			else if (key == "trace") { opt.trace_path = std::string(value); }
+			else if (key == "write-trace") { opt.write_trace_path = std::string(value); }
+			else if (key == "threads") { opt.threads = parse_size(value); }
+			else if (key == "preload") { opt.preload = parse_size(value); }
+			else if (key == "rate") { opt.rate = parse_double(value); }
+			else if (key == "duration") { opt.duration = parse_double(value); }
+			else if (key == "speed") { opt.speed = parse_double(value); }
+			else if (key == "rows")
+			{
+				opt.rows.clear();
+				for (const auto part : std::views::split(value, ','))
+				{
+					opt.rows.emplace_back(parse_size(std::string_view(part.begin(), part.end())));
+				}
+			}
+			else
+			{
+				throw std::invalid_argument(std::format("未知选项: {}", arg));
+			}
+		}
+		return suites;
+	}
+}
+
+// 用法: benchmark [选项...] [套件名...]
+// 不带套件名时运行全部套件, 结果以JSON Lines格式输出到标准输出
+// 选项:
+//   --simple=<路径>   FTS5 simple分词扩展, table套件必需
+//   --dir=<目录>      生成数据库的目录, 默认在系统临时目录下
+//   --rows=<n,n,...>  table套件的表规模, 默认10000,100000,1000000,10000000
+//   --dim=<n>         合成向量维度, 默认384
+//   --ops=<n>         每个操作的调用次数, 默认1000
+//   --keep            保留生成的数据库文件
+// replay套件(轨迹格式见bench_replay.hpp):
+//   --trace=<文件>        回放的轨迹, 不指定时生成合成轨迹
+//   --write-trace=<文件>  保存回放的轨迹
+//   --threads=<n>         并发线程数, 默认8
+//   --preload=<n>         回放前写入的消息数, 默认100000
+//   --rate=<x>            合成轨迹的平均每秒操作数, 默认200
+//   --duration=<秒>       合成轨迹时长, 默认60
+//   --speed=<x>           回放速度倍率, 默认1, 0为尽快执行
+int main(int argc, char** argv)
+{
+	const std::vector<std::pair<std::string_view, std::function<void()>>> suites{
+		{ "thread_pool", benchmark::bench_thread_pool },
+		{ "table", benchmark::bench_table },
+		{ "replay", benchmark::bench_replay },
+	};
+
+	std::vector<std::string_view> selected;
+	try
+	{
+		selected = parse_args(argc, argv);
+	}
+	catch (const std::exception& e)
+	{
+		std::println(stderr, "{}", e.what());
+		return 1;
+	}
+	for (const auto& [name, func] : suites)
+	{
+		if (selected.empty() || std::ranges::find(selected, name) != selected.end())
+		{
+			func();
+		}
+	}
+	return 0;
+}
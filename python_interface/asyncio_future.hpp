@@ -0,0 +1,99 @@
+#pragma once
+#include <async.hpp>
+#include <exception>
+#include <memory>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <string>
+#include <type_traits>
+#include <utility>
+namespace py = pybind11;
+
+// 把C++异常转换为对应的Python异常对象, 复用pybind11已注册的异常转换
+inline py::object exception_to_python(std::exception_ptr exception)
+{
+    py::cpp_function rethrow([exception] { std::rethrow_exception(exception); });
+    try
+    {
+        rethrow();
+    }
+    catch (py::error_already_set& e)
+    {
+        return e.value();
+    }
+    return py::none();
+}
+
+// 在事件循环线程中执行: future可能已被取消, 只对未完成的future设置结果
+inline py::cpp_function asyncio_future_setter()
+{
+    return py::cpp_function([](py::object future, const std::string& name, py::object value)
+        {
+            if (!future.attr("done")().cast<bool>())
+            {
+                future.attr(name.c_str())(value);
+            }
+        });
+}
+
+// 返回绑定到当前运行中事件循环的asyncio.Future, 任务在工作线程完成后通过call_soon_threadsafe回到事件循环设置结果
+// submit提交任务并返回memory::async::task, 调用期间释放GIL: 线程池已满时提交会阻塞, 而工作线程执行Python回调需要GIL
+// 必须在协程(事件循环正在运行的线程)中调用
+template <class F>
+py::object to_asyncio_future(F&& submit)
+{
+    using task_type = std::invoke_result_t<F>;
+    using value_type = typename task_type::value_type;
+
+    auto loop = py::module_::import("asyncio").attr("get_running_loop")();
+    auto future = loop.attr("create_future")();
+
+    task_type task;
+    {
+        py::gil_scoped_release release;
+        task = std::forward<F>(submit)();
+    }
+
+    // 完成回调可能在工作线程上析构, py::object只能在持有GIL时析构
+    struct context
+    {
+        py::object loop;
+        py::object future;
+    };
+    std::shared_ptr<context> ctx(new context{ std::move(loop), future }, [](context* p)
+        {
+            py::gil_scoped_acquire gil;
+            delete p;
+        });
+    task.then([ctx, task]() mutable
+        {
+            py::gil_scoped_acquire gil;
+            const auto set_if_pending = asyncio_future_setter();
+            try
+            {
+                py::object value;
+                if constexpr (std::is_void_v<value_type>)
+                {
+                    task.get();
+                    value = py::none();
+                }
+                else
+                {
+                    value = py::cast(task.get());
+                }
+                ctx->loop.attr("call_soon_threadsafe")(set_if_pending, ctx->future, "set_result", value);
+            }
+            catch (...)
+            {
+                try
+                {
+                    ctx->loop.attr("call_soon_threadsafe")(set_if_pending, ctx->future, "set_exception", exception_to_python(std::current_exception()));
+                }
+                catch (py::error_already_set&)
+                {
+                    // 事件循环已关闭, 无处投递结果
+                }
+            }
+        });
+    return future;
+}
@@ -2,9 +2,14 @@
 #include "register_ckeck.hpp"
 #include "register_data.hpp"
 #include "register_database.hpp"
+#include "register_embedding.hpp"
 #include "register_exceptions.hpp"
+#include "register_partitioned_table.hpp"
+#include "register_stats.hpp"
 #include "register_sqlite_checkpoint.hpp"
+#include "register_sqlite_profile.hpp"
 #include "register_synchronous_mode.hpp"
+#include "register_trace.hpp"
 #include "resister_table.hpp"
 #include "set_module_info.hpp"
 #include <py.hpp>
@@ -16,10 +21,15 @@ PYBIND11_MODULE(qbot_memory, m)
 {
 	set_module_info(m);
 	register_sqlite_checkpoint(m);
+	register_sqlite_profile(m);
 	register_sqlite_synchronous_mode(m);
 	register_exceptions(m);
 	register_ckecks(m);
 	register_data(m);
+	register_stats(m);
 	register_database(m);
+	register_embedding(m);
 	register_table(m);
+	register_partitioned_table(m);
+	register_trace(m);
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #pragma once
 #include <memory.hpp>
+#include <pybind11/chrono.h>
 #include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
 namespace py = pybind11;
 void register_data(py::module_& m)
 {
@@ -61,4 +63,268 @@ void register_data(py::module_& m)
         .def_readwrite("sender_uuid", &memory::select_vector_data::sender_uuid)
         .def_readwrite("message", &memory::select_vector_data::message)
         .def_readwrite("distance", &memory::select_vector_data::distance);
+
+    py::class_<memory::select_table_vector_data>(m, "select_table_vector_data")
+        .def(py::init<>())
+        .def(py::init<std::string, std::size_t, std::size_t, std::string, std::string, std::string, double>(),
+            py::arg("table_name"),
+            py::arg("id"),
+            py::arg("time"),
+            py::arg("sender"),
+            py::arg("sender_uuid"),
+            py::arg("message"),
+            py::arg("distance"))
+        .def_readwrite("table_name", &memory::select_table_vector_data::table_name)
+        .def_readwrite("id", &memory::select_table_vector_data::id)
+        .def_readwrite("time", &memory::select_table_vector_data::time)
+        .def_readwrite("sender", &memory::select_table_vector_data::sender)
+        .def_readwrite("sender_uuid", &memory::select_table_vector_data::sender_uuid)
+        .def_readwrite("message", &memory::select_table_vector_data::message)
+        .def_readwrite("distance", &memory::select_table_vector_data::distance);
+
+    py::class_<memory::dedup_options>(m, "dedup_options")
+        .def(py::init<>())
+        .def(py::init<bool, bool, float, bool, bool>(),
+            py::arg("enable") = true,
+            py::arg("exact") = true,
+            py::arg("near_distance") = 0.0f,
+            py::arg("same_sender") = false,
+            py::arg("refresh_time") = true)
+        .def_readwrite("enable", &memory::dedup_options::enable)
+        .def_readwrite("exact", &memory::dedup_options::exact)
+        .def_readwrite("near_distance", &memory::dedup_options::near_distance)
+        .def_readwrite("same_sender", &memory::dedup_options::same_sender)
+        .def_readwrite("refresh_time", &memory::dedup_options::refresh_time);
+
+    // 向量距离度量, 搜索返回的distance越小越近
+    py::enum_<memory::metric>(m, "metric")
+        .value("l2", memory::metric::l2)
+        .value("inner_product", memory::metric::inner_product)
+        .value("cosine", memory::metric::cosine);
+
+    // 按相关度排序的全文搜索
+    py::class_<memory::fts_rank_options>(m, "fts_rank_options")
+        .def(py::init<>())
+        .def(py::init<std::optional<std::string>, std::optional<std::size_t>, std::optional<std::size_t>, std::vector<double>, std::optional<std::string>, std::optional<std::string>>(),
+            py::arg("sender_uuid") = py::none(),
+            py::arg("time_start") = py::none(),
+            py::arg("time_end") = py::none(),
+            py::arg("weights") = std::vector<double>{},
+            py::arg("highlight_start") = py::none(),
+            py::arg("highlight_end") = py::none())
+        .def_readwrite("sender_uuid", &memory::fts_rank_options::sender_uuid)
+        .def_readwrite("time_start", &memory::fts_rank_options::time_start)
+        .def_readwrite("time_end", &memory::fts_rank_options::time_end)
+        .def_readwrite("weights", &memory::fts_rank_options::weights)
+        .def_readwrite("highlight_start", &memory::fts_rank_options::highlight_start)
+        .def_readwrite("highlight_end", &memory::fts_rank_options::highlight_end);
+
+    py::class_<memory::select_fts_rank_data>(m, "select_fts_rank_data")
+        .def_readwrite("id", &memory::select_fts_rank_data::id)
+        .def_readwrite("time", &memory::select_fts_rank_data::time)
+        .def_readwrite("sender", &memory::select_fts_rank_data::sender)
+        .def_readwrite("sender_uuid", &memory::select_fts_rank_data::sender_uuid)
+        .def_readwrite("message", &memory::select_fts_rank_data::message)
+        .def_readwrite("score", &memory::select_fts_rank_data::score);
+
+    // 全文索引的存储方式
+    py::enum_<memory::fts_storage>(m, "fts_storage")
+        .value("internal", memory::fts_storage::internal)
+        .value("external_content", memory::fts_storage::external_content);
+
+    // 向量降维
+    py::enum_<memory::reduction>(m, "reduction")
+        .value("none", memory::reduction::none)
+        .value("pca", memory::reduction::pca)
+        .value("random_rotation", memory::reduction::random_rotation);
+
+    py::class_<memory::reduction_options>(m, "reduction_options")
+        .def(py::init<>())
+        .def(py::init<memory::reduction, int, bool, std::size_t>(),
+            py::arg("method") = memory::reduction::pca,
+            py::arg("dimension") = 256,
+            py::arg("keep_full_vectors") = true,
+            py::arg("max_training_vectors") = 100000)
+        .def_readwrite("method", &memory::reduction_options::method)
+        .def_readwrite("dimension", &memory::reduction_options::dimension)
+        .def_readwrite("keep_full_vectors", &memory::reduction_options::keep_full_vectors)
+        .def_readwrite("max_training_vectors", &memory::reduction_options::max_training_vectors);
+
+    // 批量导入
+    py::enum_<memory::import_format>(m, "import_format")
+        .value("auto_detect", memory::import_format::auto_detect)
+        .value("jsonl", memory::import_format::jsonl)
+        .value("csv", memory::import_format::csv);
+
+    py::class_<memory::import_options>(m, "import_options")
+        .def(py::init<>())
+        .def(py::init<memory::import_format, char, std::size_t, std::size_t, std::size_t, bool>(),
+            py::arg("format") = memory::import_format::auto_detect,
+            py::arg("delimiter") = ',',
+            py::arg("chunk_size") = 1024,
+            py::arg("max_inflight_chunks") = 4,
+            py::arg("transaction_rows") = 65536,
+            py::arg("skip_invalid") = false)
+        .def_readwrite("format", &memory::import_options::format)
+        .def_readwrite("delimiter", &memory::import_options::delimiter)
+        .def_readwrite("chunk_size", &memory::import_options::chunk_size)
+        .def_readwrite("max_inflight_chunks", &memory::import_options::max_inflight_chunks)
+        .def_readwrite("transaction_rows", &memory::import_options::transaction_rows)
+        .def_readwrite("skip_invalid", &memory::import_options::skip_invalid);
+
+    py::class_<memory::import_progress>(m, "import_progress")
+        .def_readonly("rows_read", &memory::import_progress::rows_read)
+        .def_readonly("rows_imported", &memory::import_progress::rows_imported)
+        .def_readonly("rows_skipped", &memory::import_progress::rows_skipped)
+        .def_readonly("bytes_read", &memory::import_progress::bytes_read)
+        .def_readonly("bytes_total", &memory::import_progress::bytes_total)
+        .def_readonly("elapsed_seconds", &memory::import_progress::elapsed_seconds)
+        .def_readonly("rows_per_second", &memory::import_progress::rows_per_second);
+
+    // 全量重建索引
+    py::class_<memory::rebuild_options>(m, "rebuild_options")
+        .def(py::init<>())
+        .def(py::init<std::size_t, std::size_t, bool>(),
+            py::arg("chunk_size") = 1024,
+            py::arg("checkpoint_chunks") = 64,
+            py::arg("resume") = true)
+        .def_readwrite("chunk_size", &memory::rebuild_options::chunk_size)
+        .def_readwrite("checkpoint_chunks", &memory::rebuild_options::checkpoint_chunks)
+        .def_readwrite("resume", &memory::rebuild_options::resume);
+
+    // 在线备份, step_interval接受datetime.timedelta或秒数
+    py::class_<memory::backup_options>(m, "backup_options")
+        .def(py::init<>())
+        .def(py::init<int, std::chrono::milliseconds>(),
+            py::arg("pages_per_step") = 1024,
+            py::arg("step_interval") = std::chrono::milliseconds{ 0 })
+        .def_readwrite("pages_per_step", &memory::backup_options::pages_per_step)
+        .def_readwrite("step_interval", &memory::backup_options::step_interval);
+
+    py::class_<memory::backup_report>(m, "backup_report")
+        .def_readonly("db_file", &memory::backup_report::db_file)
+        .def_readonly("tables", &memory::backup_report::tables)
+        .def_readonly("partitions", &memory::backup_report::partitions)
+        .def_readonly("pages", &memory::backup_report::pages)
+        .def_readonly("steps", &memory::backup_report::steps)
+        .def_readonly("elapsed_seconds", &memory::backup_report::elapsed_seconds);
+
+    // 后台维护, 时长接受datetime.timedelta或秒数
+    py::class_<memory::time_window>(m, "time_window")
+        .def(py::init<>())
+        .def(py::init<int, int>(),
+            py::arg("begin_minute"),
+            py::arg("end_minute"))
+        .def_readwrite("begin_minute", &memory::time_window::begin_minute)
+        .def_readwrite("end_minute", &memory::time_window::end_minute);
+
+    py::class_<memory::maintenance_options>(m, "maintenance_options")
+        .def(py::init<>())
+        .def(py::init<std::chrono::milliseconds, std::vector<memory::time_window>, std::chrono::milliseconds, std::uint64_t, std::uint64_t, int, int, std::chrono::milliseconds>(),
+            py::arg("interval") = std::chrono::milliseconds{ 60000 },
+            py::arg("quiet_windows") = std::vector<memory::time_window>{},
+            py::arg("idle_for") = std::chrono::milliseconds{ 10000 },
+            py::arg("wal_passive_bytes") = 4ull << 20,
+            py::arg("wal_truncate_bytes") = 64ull << 20,
+            py::arg("fts_merge_pages") = 256,
+            py::arg("vacuum_pages") = 1024,
+            py::arg("snapshot_interval") = std::chrono::milliseconds{ 600000 })
+        .def_readwrite("interval", &memory::maintenance_options::interval)
+        .def_readwrite("quiet_windows", &memory::maintenance_options::quiet_windows)
+        .def_readwrite("idle_for", &memory::maintenance_options::idle_for)
+        .def_readwrite("wal_passive_bytes", &memory::maintenance_options::wal_passive_bytes)
+        .def_readwrite("wal_truncate_bytes", &memory::maintenance_options::wal_truncate_bytes)
+        .def_readwrite("fts_merge_pages", &memory::maintenance_options::fts_merge_pages)
+        .def_readwrite("vacuum_pages", &memory::maintenance_options::vacuum_pages)
+        .def_readwrite("snapshot_interval", &memory::maintenance_options::snapshot_interval);
+
+    py::class_<memory::maintenance_report>(m, "maintenance_report")
+        .def_readonly("passes", &memory::maintenance_report::passes)
+        .def_readonly("quiet_passes", &memory::maintenance_report::quiet_passes)
+        .def_readonly("passive_checkpoints", &memory::maintenance_report::passive_checkpoints)
+        .def_readonly("truncate_checkpoints", &memory::maintenance_report::truncate_checkpoints)
+        .def_readonly("checkpointed_frames", &memory::maintenance_report::checkpointed_frames)
+        .def_readonly("fts_merges", &memory::maintenance_report::fts_merges)
+        .def_readonly("vacuumed_pages", &memory::maintenance_report::vacuumed_pages)
+        .def_readonly("index_snapshots", &memory::maintenance_report::index_snapshots)
+        .def_readonly("errors", &memory::maintenance_report::errors)
+        .def_readonly("wal_bytes", &memory::maintenance_report::wal_bytes)
+        .def_readonly("freelist_pages", &memory::maintenance_report::freelist_pages)
+        .def_readonly("last_actions", &memory::maintenance_report::last_actions)
+        .def_readonly("last_error", &memory::maintenance_report::last_error)
+        .def_readonly("elapsed_seconds", &memory::maintenance_report::elapsed_seconds);
+
+    // 数据库连接的打开设置与预设, 以及实际生效的设置
+    py::enum_<memory::temp_store_mode>(m, "temp_store_mode")
+        .value("automatic", memory::temp_store_mode::automatic)
+        .value("file", memory::temp_store_mode::file)
+        .value("memory", memory::temp_store_mode::memory);
+
+    py::class_<memory::database_options>(m, "database_options")
+        .def(py::init<>())
+        .def(py::init<int, std::optional<int>, std::optional<std::int64_t>, std::optional<std::int64_t>, std::optional<memory::temp_store_mode>, std::optional<memory::sqlite::synchronous_mode>, std::optional<std::size_t>, std::chrono::milliseconds>(),
+            py::arg("extra_open_flags") = 0,
+            py::arg("page_size") = py::none(),
+            py::arg("cache_size") = py::none(),
+            py::arg("mmap_size") = py::none(),
+            py::arg("temp_store") = py::none(),
+            py::arg("synchronous") = py::none(),
+            py::arg("wal_autocheckpoint") = py::none(),
+            py::arg("busy_timeout") = std::chrono::milliseconds{ 0 })
+        .def_static("low_latency", &memory::database_options::low_latency)
+        .def_static("bulk_load", &memory::database_options::bulk_load)
+        .def_static("low_memory", &memory::database_options::low_memory)
+        .def_readwrite("extra_open_flags", &memory::database_options::extra_open_flags)
+        .def_readwrite("page_size", &memory::database_options::page_size)
+        .def_readwrite("cache_size", &memory::database_options::cache_size)
+        .def_readwrite("mmap_size", &memory::database_options::mmap_size)
+        .def_readwrite("temp_store", &memory::database_options::temp_store)
+        .def_readwrite("synchronous", &memory::database_options::synchronous)
+        .def_readwrite("wal_autocheckpoint", &memory::database_options::wal_autocheckpoint)
+        .def_readwrite("busy_timeout", &memory::database_options::busy_timeout);
+
+    py::class_<memory::database_settings>(m, "database_settings")
+        .def_readonly("serialized", &memory::database_settings::serialized)
+        .def_readonly("journal_mode", &memory::database_settings::journal_mode)
+        .def_readonly("page_size", &memory::database_settings::page_size)
+        .def_readonly("cache_size", &memory::database_settings::cache_size)
+        .def_readonly("mmap_size", &memory::database_settings::mmap_size)
+        .def_readonly("temp_store", &memory::database_settings::temp_store)
+        .def_readonly("synchronous", &memory::database_settings::synchronous)
+        .def_readonly("wal_autocheckpoint", &memory::database_settings::wal_autocheckpoint)
+        .def_readonly("busy_timeout_ms", &memory::database_settings::busy_timeout_ms)
+        .def_readonly("auto_vacuum", &memory::database_settings::auto_vacuum);
+
+    // 按时间分区的表
+    py::enum_<memory::partition_period>(m, "partition_period")
+        .value("day", memory::partition_period::day)
+        .value("month", memory::partition_period::month)
+        .value("year", memory::partition_period::year);
+
+    py::class_<memory::partition_options>(m, "partition_options")
+        .def(py::init<>())
+        .def(py::init<memory::partition_period, std::size_t, std::size_t>(),
+            py::arg("period") = memory::partition_period::month,
+            py::arg("writable_partitions") = 2,
+            py::arg("max_attached") = 8)
+        .def_readwrite("period", &memory::partition_options::period)
+        .def_readwrite("writable_partitions", &memory::partition_options::writable_partitions)
+        .def_readwrite("max_attached", &memory::partition_options::max_attached);
+
+    py::class_<memory::partition_info>(m, "partition_info")
+        .def_readonly("name", &memory::partition_info::name)
+        .def_readonly("time_start", &memory::partition_info::time_start)
+        .def_readonly("time_end", &memory::partition_info::time_end)
+        .def_readonly("db_file", &memory::partition_info::db_file)
+        .def_readonly("read_only", &memory::partition_info::read_only)
+        .def_readonly("compacted", &memory::partition_info::compacted)
+        .def_readonly("attached", &memory::partition_info::attached);
+
+    py::class_<memory::select_table_data>(m, "select_table_data")
+        .def_readwrite("table_name", &memory::select_table_data::table_name)
+        .def_readwrite("id", &memory::select_table_data::id)
+        .def_readwrite("time", &memory::select_table_data::time)
+        .def_readwrite("sender", &memory::select_table_data::sender)
+        .def_readwrite("sender_uuid", &memory::select_table_data::sender_uuid)
+        .def_readwrite("message", &memory::select_table_data::message);
 }
\ No newline at end of file
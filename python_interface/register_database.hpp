@@ -1,4 +1,5 @@
 #pragma once
+#include "asyncio_future.hpp"
 #include <memory.hpp>
 #include <pybind11/functional.h>
 #include <pybind11/pybind11.h>
@@ -8,10 +9,14 @@ namespace py = pybind11;
 void register_database(py::module& m)
 {
     py::class_<memory::database, std::shared_ptr<memory::database>>(m, "database")
-        .def(py::init<const fs::path&, const fs::path&>(),
+        .def(py::init<const fs::path&, const fs::path&, const memory::database_options&>(),
             py::arg("db_file_path"),
-            py::arg("simple_path"))
+            py::arg("simple_path"),
+            py::arg("options") = memory::database_options{})
         .def("db_file_path", &memory::database::db_file_path)
+        // 连接实际生效的PRAGMA与打开标志
+        .def("settings", &memory::database::settings,
+            py::call_guard<py::gil_scoped_release>())
         .def("set_synchronous", &memory::database::set_synchronous,
             py::arg("synchronous"))
         .def("set_wal_autocheckpoint", &memory::database::set_wal_autocheckpoint,
@@ -20,5 +25,60 @@ void register_database(py::module& m)
             py::arg("mode"),
             py::arg("db_name"),
             py::arg("log") = NULL,
-            py::arg("ckpt") = NULL);
+            py::arg("ckpt") = NULL)
+        // 所有表汇总的阶段耗时与计数, 以及SQLite页缓存计数
+        .def("stats", &memory::database::stats,
+            py::call_guard<py::gil_scoped_release>())
+        .def("reset_stats", &memory::database::reset_stats,
+            py::call_guard<py::gil_scoped_release>())
+        // SQLite语句级性能分析与慢查询日志
+        .def("enable_sqlite_profiling", &memory::database::enable_sqlite_profiling,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("slow_threshold_ms"),
+            py::arg("slow_capacity") = 128)
+        .def("disable_sqlite_profiling", &memory::database::disable_sqlite_profiling,
+            py::call_guard<py::gil_scoped_release>())
+        .def("sqlite_statement_profiles", &memory::database::sqlite_statement_profiles,
+            py::call_guard<py::gil_scoped_release>())
+        .def("sqlite_slow_queries", &memory::database::sqlite_slow_queries,
+            py::call_guard<py::gil_scoped_release>())
+        .def("reset_sqlite_profiling", &memory::database::reset_sqlite_profiling,
+            py::call_guard<py::gil_scoped_release>())
+        // 数据库与FAISS索引的一致在线备份
+        .def("backup", &memory::database::backup,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("directory"),
+            py::arg("options") = memory::backup_options{})
+        .def("backup_async", [](memory::database& self, fs::path directory, memory::backup_options options)
+            {
+                return to_asyncio_future([&] { return self.backup_async(std::move(directory), options); });
+            },
+            py::arg("directory"),
+            py::arg("options") = memory::backup_options{})
+        // 后台维护: 自适应WAL检查点、FTS增量合并、增量vacuum与索引快照
+        .def("start_maintenance", &memory::database::start_maintenance,
+            py::arg("options") = memory::maintenance_options{})
+        .def("stop_maintenance", &memory::database::stop_maintenance,
+            py::call_guard<py::gil_scoped_release>())
+        .def("maintenance_running", &memory::database::maintenance_running)
+        .def("run_maintenance", &memory::database::run_maintenance,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("options") = memory::maintenance_options{},
+            py::arg("force") = false)
+        .def("maintenance_summary", &memory::database::maintenance_summary)
+        .def("enable_incremental_vacuum", &memory::database::enable_incremental_vacuum,
+            py::call_guard<py::gil_scoped_release>())
+        // 跨表向量搜索
+        .def("search_list_vector_text_tables", &memory::database::search_list_vector_text_tables,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("table_names"),
+            py::arg("message"),
+            py::arg("k"))
+        .def("search_list_vector_text_tables_async", [](memory::database& self, std::vector<std::string> table_names, std::string message, const faiss::idx_t k)
+            {
+                return to_asyncio_future([&] { return self.search_list_vector_text_tables_async(std::move(table_names), std::move(message), k); });
+            },
+            py::arg("table_names"),
+            py::arg("message"),
+            py::arg("k"));
 }
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+#include <embedding.hpp>
+#include <pybind11/chrono.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <memory>
+namespace py = pybind11;
+void register_embedding(py::module_& m)
+{
+    py::class_<memory::embedding::client_options>(m, "embedding_client_options")
+        .def(py::init<>())
+        .def_readwrite("url", &memory::embedding::client_options::url)
+        .def_readwrite("model", &memory::embedding::client_options::model)
+        .def_readwrite("dimension", &memory::embedding::client_options::dimension)
+        .def_readwrite("batch_size", &memory::embedding::client_options::batch_size)
+        .def_readwrite("max_in_flight", &memory::embedding::client_options::max_in_flight)
+        .def_readwrite("max_retries", &memory::embedding::client_options::max_retries)
+        .def_readwrite("initial_backoff", &memory::embedding::client_options::initial_backoff)
+        .def_readwrite("max_backoff", &memory::embedding::client_options::max_backoff)
+        .def_readwrite("connect_timeout", &memory::embedding::client_options::connect_timeout)
+        .def_readwrite("timeout", &memory::embedding::client_options::timeout);
+
+    // embed/embed_one可直接传给table.set_vectors/set_vector, 请求期间释放GIL
+    py::class_<memory::embedding::client, std::shared_ptr<memory::embedding::client>>(m, "embedding_client")
+        .def(py::init<memory::embedding::client_options>(),
+            py::arg("options") = memory::embedding::client_options{})
+        .def("options", &memory::embedding::client::options)
+        .def("embed", &memory::embedding::client::embed,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("texts"))
+        .def("embed_one", &memory::embedding::client::embed_one,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("text"));
+}
@@ -6,6 +6,15 @@ namespace py = pybind11;
 
 void register_exceptions(py::module_& m)
 {
+    // 异常的调用栈捕获方式, 错误频繁的负载可以设为off或raw以减少每次抛出的开销
+    py::enum_<memory::exception::stack_capture>(m, "stack_capture")
+        .value("off", memory::exception::stack_capture::off)
+        .value("raw", memory::exception::stack_capture::raw)
+        .value("full", memory::exception::stack_capture::full);
+    m.def("set_stack_capture", &memory::exception::set_stack_capture,
+        py::arg("mode"));
+    m.def("get_stack_capture", &memory::exception::get_stack_capture);
+
     // 注册基础异常
     py::register_exception<memory::exception::base_exception>(m, "base_exception", PyExc_Exception);
 
@@ -31,6 +40,9 @@ void register_exceptions(py::module_& m)
     py::register_exception<memory::exception::sqlite_call_error>(m, "sqlite_call_error", m.attr("bad_database"));
     py::register_exception<memory::exception::sqlite_extension_error>(m, "sqlite_extension_error", m.attr("sqlite_call_error"));
 
+    // 向量生成相关
+    py::register_exception<memory::exception::embedding_error>(m, "embedding_error", m.attr("bad_exception"));
+
     // 参数相关
     py::register_exception<memory::exception::invalid_argument>(m, "invalid_argument", m.attr("runtime_error"));
 
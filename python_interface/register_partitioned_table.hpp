@@ -0,0 +1,73 @@
+#pragma once
+#include "asyncio_future.hpp"
+#include <memory.hpp>
+#include <pybind11/functional.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <string>
+namespace py = pybind11;
+void register_partitioned_table(py::module_& m)
+{
+    py::class_<memory::partitioned_table, std::shared_ptr<memory::partitioned_table>>(m, "partitioned_table")
+        .def(py::init<std::shared_ptr<memory::database>, const std::string&, int, int, memory::metric, memory::fts_storage, const memory::partition_options&>(),
+            py::arg("db"),
+            py::arg("name"),
+            py::arg("vector_dimension"),
+            py::arg("HNWS_max_connect") = 32,
+            py::arg("metric") = memory::metric::l2,
+            py::arg("fts") = memory::fts_storage::internal,
+            py::arg("options") = memory::partition_options{}
+        )
+        .def("name", &memory::partitioned_table::name)
+        .def("period", &memory::partitioned_table::period)
+        // 向量生成回调函数, 应用到所有分区
+        .def("set_vector", &memory::partitioned_table::set_vector,
+            py::arg("func"))
+        .def("set_vectors", &memory::partitioned_table::set_vectors,
+            py::arg("func"))
+        // 分区列表与单个分区
+        .def("partitions", &memory::partitioned_table::partitions,
+            py::call_guard<py::gil_scoped_release>())
+        .def("partition", &memory::partitioned_table::partition,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("partition_name"))
+        // 数据操作, 按时间写入所在的分区
+        .def("add", &memory::partitioned_table::add,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("data"))
+        .def("adds", &memory::partitioned_table::adds,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("datas"))
+        // 按时间范围裁剪分区的搜索
+        .def("search_list_time_start_end", &memory::partitioned_table::search_list_time_start_end,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("start"),
+            py::arg("end"))
+        .def("search_list_vector_text", &memory::partitioned_table::search_list_vector_text,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("message"),
+            py::arg("k"),
+            py::arg("time_start") = py::none(),
+            py::arg("time_end") = py::none())
+        .def("search_list_vector_text_async", [](memory::partitioned_table& self, std::string message, const faiss::idx_t k, std::optional<std::size_t> time_start, std::optional<std::size_t> time_end)
+            {
+                return to_asyncio_future([&] { return self.search_list_vector_text_async(std::move(message), k, time_start, time_end); });
+            },
+            py::arg("message"),
+            py::arg("k"),
+            py::arg("time_start") = py::none(),
+            py::arg("time_end") = py::none())
+        // 封存与压缩较早的分区
+        .def("seal_partitions", &memory::partitioned_table::seal_partitions,
+            py::call_guard<py::gil_scoped_release>())
+        .def("compact_partition", &memory::partitioned_table::compact_partition,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("partition_name"),
+            py::arg("reduction") = py::none())
+        .def("compact_partition_async", [](memory::partitioned_table& self, std::string partition_name, std::optional<memory::reduction_options> reduction)
+            {
+                return to_asyncio_future([&] { return self.compact_partition_async(std::move(partition_name), std::move(reduction)); });
+            },
+            py::arg("partition_name"),
+            py::arg("reduction") = py::none());
+}
\ No newline at end of file
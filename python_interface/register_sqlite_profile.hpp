@@ -0,0 +1,27 @@
+#pragma once
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <sqlite.hpp>
+namespace py = pybind11;
+void register_sqlite_profile(py::module_& m)
+{
+    py::class_<memory::sqlite::statement_profile>(m, "sqlite_statement_profile")
+        .def_readonly("sql", &memory::sqlite::statement_profile::sql)
+        .def_readonly("calls", &memory::sqlite::statement_profile::calls)
+        .def_readonly("total_ms", &memory::sqlite::statement_profile::total_ms)
+        .def_readonly("max_ms", &memory::sqlite::statement_profile::max_ms)
+        .def_readonly("fullscan_steps", &memory::sqlite::statement_profile::fullscan_steps)
+        .def_readonly("sorts", &memory::sqlite::statement_profile::sorts)
+        .def_readonly("autoindexes", &memory::sqlite::statement_profile::autoindexes)
+        .def_readonly("vm_steps", &memory::sqlite::statement_profile::vm_steps);
+
+    py::class_<memory::sqlite::slow_query>(m, "sqlite_slow_query")
+        .def_readonly("sql", &memory::sqlite::slow_query::sql)
+        .def_readonly("expanded_sql", &memory::sqlite::slow_query::expanded_sql)
+        .def_readonly("ms", &memory::sqlite::slow_query::ms)
+        .def_readonly("fullscan_steps", &memory::sqlite::slow_query::fullscan_steps)
+        .def_readonly("sorts", &memory::sqlite::slow_query::sorts)
+        .def_readonly("autoindexes", &memory::sqlite::slow_query::autoindexes)
+        .def_readonly("vm_steps", &memory::sqlite::slow_query::vm_steps)
+        .def_readonly("query_plan", &memory::sqlite::slow_query::query_plan);
+}
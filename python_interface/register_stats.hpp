@@ -0,0 +1,21 @@
+#pragma once
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <stats.hpp>
+namespace py = pybind11;
+void register_stats(py::module_& m)
+{
+    py::class_<memory::stats::stage_snapshot>(m, "stage_stats")
+        .def_readonly("name", &memory::stats::stage_snapshot::name)
+        .def_readonly("count", &memory::stats::stage_snapshot::count)
+        .def_readonly("total_us", &memory::stats::stage_snapshot::total_us)
+        .def_readonly("mean_us", &memory::stats::stage_snapshot::mean_us)
+        .def_readonly("p50_us", &memory::stats::stage_snapshot::p50_us)
+        .def_readonly("p99_us", &memory::stats::stage_snapshot::p99_us)
+        .def_readonly("p999_us", &memory::stats::stage_snapshot::p999_us)
+        .def_readonly("max_us", &memory::stats::stage_snapshot::max_us);
+
+    py::class_<memory::stats::snapshot>(m, "stats")
+        .def_readonly("stages", &memory::stats::snapshot::stages)
+        .def_readonly("counters", &memory::stats::snapshot::counters);
+}
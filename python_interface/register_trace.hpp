@@ -0,0 +1,25 @@
+#pragma once
+#include <pybind11/pybind11.h>
+#include <pybind11/stl/filesystem.h>
+#include <trace.hpp>
+namespace py = pybind11;
+// 请求级时间线追踪, 导出的JSON可在Perfetto中打开
+void register_trace(py::module_& m)
+{
+    auto trace = m.def_submodule("trace", "请求级时间线追踪(Chrome trace-event JSON)");
+    trace.def("enable", &memory::trace::enable,
+        py::arg("sample_rate") = 1.0,
+        py::arg("max_events") = 1'000'000);
+    trace.def("disable", &memory::trace::disable);
+    trace.def("enabled", &memory::trace::enabled);
+    trace.def("set_sample_rate", &memory::trace::set_sample_rate,
+        py::arg("sample_rate"));
+    trace.def("clear", &memory::trace::clear,
+        py::call_guard<py::gil_scoped_release>());
+    trace.def("dropped", &memory::trace::dropped);
+    trace.def("json", &memory::trace::json,
+        py::call_guard<py::gil_scoped_release>());
+    trace.def("write", &memory::trace::write,
+        py::call_guard<py::gil_scoped_release>(),
+        py::arg("path"));
+}
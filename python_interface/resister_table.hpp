@@ -1,6 +1,8 @@
 #pragma once
+#include "asyncio_future.hpp"
 #include <memory.hpp>
 #include <pybind11/cast.h>
+#include <pybind11/functional.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/pytypes.h>
 #include <pybind11/stl.h>
@@ -10,60 +12,203 @@ namespace py = pybind11;
 void register_table(py::module_& m)
 {
     py::class_<memory::table, std::shared_ptr<memory::table>>(m, "table")
-        .def(py::init<std::shared_ptr<memory::database>, const std::string&, int, int>(),
+        .def(py::init<std::shared_ptr<memory::database>, const std::string&, int, int, memory::metric, memory::fts_storage>(),
             py::arg("db"),
             py::arg("name"),
             py::arg("vector_dimension"),
-            py::arg("HNWS_max_connect") = 32
+            py::arg("HNWS_max_connect") = 32,
+            py::arg("metric") = memory::metric::l2,
+            py::arg("fts") = memory::fts_storage::internal
         )
+        .def("distance_metric", &memory::table::distance_metric)
+        // 全文索引的存储方式, 切换时重建全文索引
+        .def("fts_storage_mode", &memory::table::fts_storage_mode,
+            py::call_guard<py::gil_scoped_release>())
+        .def("set_fts_storage", &memory::table::set_fts_storage,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("fts"))
         // 向量生成回调函数
         .def("set_vector", &memory::table::set_vector,
             py::arg("func"))
         .def("set_vectors", &memory::table::set_vectors,
             py::arg("func"))
+        .def("set_embedding_parallelism", &memory::table::set_embedding_parallelism,
+            py::arg("parallelism"))
         // HNSW参数设置
         .def("set_hnsw_efSearch", &memory::table::set_hnsw_efSearch,
+            py::call_guard<py::gil_scoped_release>(),
             py::arg("efSearch"))
+        // 向量搜索重排的候选倍数, 1为关闭
+        .def("set_rerank_oversample", &memory::table::set_rerank_oversample,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("oversample"))
+        .def("rerank_oversample", &memory::table::rerank_oversample,
+            py::call_guard<py::gil_scoped_release>())
+        // 向量降维, 关闭且未保存原始向量时会重新生成全部向量
+        .def("enable_reduction", &memory::table::enable_reduction,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("options"))
+        .def("disable_reduction", &memory::table::disable_reduction,
+            py::call_guard<py::gil_scoped_release>())
+        .def("reduction_method", &memory::table::reduction_method,
+            py::call_guard<py::gil_scoped_release>())
+        .def("index_dimension", &memory::table::index_dimension,
+            py::call_guard<py::gil_scoped_release>())
+        .def("keeps_full_vectors", &memory::table::keeps_full_vectors,
+            py::call_guard<py::gil_scoped_release>())
+        // 阶段耗时与计数
+        .def("stats", &memory::table::stats)
+        .def("reset_stats", &memory::table::reset_stats)
+        // 插入去重设置
+        .def("set_dedup", &memory::table::set_dedup,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("options"))
+        .def("dedup", &memory::table::dedup,
+            py::call_guard<py::gil_scoped_release>())
+        .def("search_duplicate_count", &memory::table::search_duplicate_count,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("id"))
         // 数据操作
         .def("add", &memory::table::add,
+            py::call_guard<py::gil_scoped_release>(),
             py::arg("data"))
         .def("adds", &memory::table::adds,
+            py::call_guard<py::gil_scoped_release>(),
             py::arg("datas"))
         // 搜索方法
         .def("search_id", &memory::table::search_id,
+            py::call_guard<py::gil_scoped_release>(),
             py::arg("id"))
         .def("search_list_uuid", &memory::table::search_list_uuid,
+            py::call_guard<py::gil_scoped_release>(),
             py::arg("uuid"))
         .def("search_list_uuid_limit", &memory::table::search_list_uuid_limit,
+            py::call_guard<py::gil_scoped_release>(),
             py::arg("uuid"),
             py::arg("limit"))
         .def("search_list_time_start", &memory::table::search_list_time_start,
+            py::call_guard<py::gil_scoped_release>(),
             py::arg("start"))
         .def("search_list_time_end", &memory::table::search_list_time_end,
+            py::call_guard<py::gil_scoped_release>(),
             py::arg("end"))
         .def("search_list_time_start_end", &memory::table::search_list_time_start_end,
+            py::call_guard<py::gil_scoped_release>(),
             py::arg("start"),
             py::arg("end"))
         // 全文搜索
         .def("search_list_fts_impl", &memory::table::search_list_fts_impl,
+            py::call_guard<py::gil_scoped_release>(),
             py::arg("fts") = py::none(),
             py::arg("simple_query") = py::none(),
             py::arg("start") = py::none(),
             py::arg("end") = py::none(),
             py::arg("limit") = py::none())
+        // 按BM25相关度排序, 发送者与时间范围在SQL中过滤
+        .def("search_list_fts_ranked", &memory::table::search_list_fts_ranked,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("fts") = py::none(),
+            py::arg("simple_query") = py::none(),
+            py::arg("limit") = 10,
+            py::arg("options") = memory::fts_rank_options{})
         // 向量搜索
         .def("search_list_vector_text", &memory::table::search_list_vector_text,
+            py::call_guard<py::gil_scoped_release>(),
             py::arg("message"),
             py::arg("k"))
         .def("search_list_vector_texts", &memory::table::search_list_vector_texts,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("messages"),
+            py::arg("k"))
+        .def("search_list_vector_texts_grouped", &memory::table::search_list_vector_texts_grouped,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("messages"),
+            py::arg("k"))
+        // 异步接口, 返回asyncio.Future, 需在协程中调用
+        .def("add_async", [](memory::table& self, memory::insert_data data)
+            {
+                return to_asyncio_future([&] { return self.add_async(std::move(data)); });
+            },
+            py::arg("data"))
+        .def("adds_async", [](memory::table& self, std::vector<memory::insert_data> datas)
+            {
+                return to_asyncio_future([&] { return self.adds_async(std::move(datas)); });
+            },
+            py::arg("datas"))
+        .def("search_list_vector_text_async", [](memory::table& self, std::string message, const faiss::idx_t k)
+            {
+                return to_asyncio_future([&] { return self.search_list_vector_text_async(std::move(message), k); });
+            },
+            py::arg("message"),
+            py::arg("k"))
+        .def("search_list_vector_texts_async", [](memory::table& self, std::vector<std::string> messages, const faiss::idx_t k)
+            {
+                return to_asyncio_future([&] { return self.search_list_vector_texts_async(std::move(messages), k); });
+            },
+            py::arg("messages"),
+            py::arg("k"))
+        .def("search_list_vector_texts_grouped_async", [](memory::table& self, std::vector<std::string> messages, const faiss::idx_t k)
+            {
+                return to_asyncio_future([&] { return self.search_list_vector_texts_grouped_async(std::move(messages), k); });
+            },
             py::arg("messages"),
             py::arg("k"))
+        .def("search_list_fts_impl_async", [](memory::table& self,
+            std::optional<std::string> fts,
+            std::optional<std::vector<std::string>> simple_query,
+            std::optional<std::string> start,
+            std::optional<std::string> end,
+            std::optional<std::size_t> limit)
+            {
+                return to_asyncio_future([&] { return self.search_list_fts_impl_async(std::move(fts), std::move(simple_query), std::move(start), std::move(end), limit); });
+            },
+            py::arg("fts") = py::none(),
+            py::arg("simple_query") = py::none(),
+            py::arg("start") = py::none(),
+            py::arg("end") = py::none(),
+            py::arg("limit") = py::none())
+        .def("search_list_fts_ranked_async", [](memory::table& self,
+            std::optional<std::string> fts,
+            std::optional<std::vector<std::string>> simple_query,
+            std::size_t limit,
+            memory::fts_rank_options options)
+            {
+                return to_asyncio_future([&] { return self.search_list_fts_ranked_async(std::move(fts), std::move(simple_query), limit, std::move(options)); });
+            },
+            py::arg("fts") = py::none(),
+            py::arg("simple_query") = py::none(),
+            py::arg("limit") = 10,
+            py::arg("options") = memory::fts_rank_options{})
         // 索引管理
-        .def("forgotten", &memory::table::forgotten)
-        .def("rebuild_faiss_index", &memory::table::rebuild_faiss_index)
-        .def("full_rebuild_faiss_index", &memory::table::full_rebuild_faiss_index)
+        .def("forgotten", &memory::table::forgotten,
+            py::call_guard<py::gil_scoped_release>())
+        .def("rebuild_faiss_index", &memory::table::rebuild_faiss_index,
+            py::call_guard<py::gil_scoped_release>())
+        .def("full_rebuild_faiss_index", &memory::table::full_rebuild_faiss_index,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("options") = memory::rebuild_options{})
+        // 在后台影子索引中重建, 期间照常搜索与插入
+        .def("rebuild_faiss_index_async", [](memory::table& self)
+            {
+                return to_asyncio_future([&] { return self.rebuild_faiss_index_async(); });
+            })
+        .def("full_rebuild_faiss_index_async", [](memory::table& self, memory::rebuild_options options)
+            {
+                return to_asyncio_future([&] { return self.full_rebuild_faiss_index_async(options); });
+            },
+            py::arg("options") = memory::rebuild_options{})
+        .def("rebuilding", &memory::table::rebuilding,
+            py::call_guard<py::gil_scoped_release>())
+        // 从JSONL/CSV流式批量导入, progress在每个事务提交后以import_progress调用
+        .def("import_file", &memory::table::import_file,
+            py::call_guard<py::gil_scoped_release>(),
+            py::arg("path"),
+            py::arg("options") = memory::import_options{},
+            py::arg("progress") = nullptr)
         // 表操作
-        .def("drop", &memory::table::drop)
+        .def("drop", &memory::table::drop,
+            py::call_guard<py::gil_scoped_release>())
         // 自动保存
-        .def("save_faiss_index", &memory::table::save_faiss_index);
+        .def("save_faiss_index", &memory::table::save_faiss_index,
+            py::call_guard<py::gil_scoped_release>());
 }
\ No newline at end of file
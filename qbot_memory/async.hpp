@@ -0,0 +1,201 @@
+#pragma once
+#include "exception.hpp"
+#include "thread_pool.hpp"
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace memory::async
+{
+	namespace detail
+	{
+		template <class T>
+		class shared_state
+		{
+		public:
+			using value_type = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+			void set_value(value_type value)
+			{
+				std::vector<std::function<void()>> callbacks;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_value.emplace(std::move(value));
+					m_ready = true;
+					callbacks.swap(m_callbacks);
+				}
+				m_condition.notify_all();
+				for (auto& callback : callbacks)
+				{
+					callback();
+				}
+			}
+			void set_exception(std::exception_ptr exception)
+			{
+				std::vector<std::function<void()>> callbacks;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_exception = std::move(exception);
+					m_ready = true;
+					callbacks.swap(m_callbacks);
+				}
+				m_condition.notify_all();
+				for (auto& callback : callbacks)
+				{
+					callback();
+				}
+			}
+			bool ready()
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				return m_ready;
+			}
+			void wait()
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_condition.wait(lock, [this] { return m_ready; });
+			}
+			// 已完成时不登记并返回false, 由调用方直接执行
+			bool add_callback(std::function<void()> callback)
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_ready)
+				{
+					return false;
+				}
+				m_callbacks.emplace_back(std::move(callback));
+				return true;
+			}
+			// 调用前必须已完成, 值只能被取走一次
+			value_type take()
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (m_exception)
+				{
+					std::rethrow_exception(m_exception);
+				}
+				if (!m_value.has_value())
+				{
+					throw exception::bad_exception("异步任务的结果已被取走");
+				}
+				auto value = std::move(*m_value);
+				m_value.reset();
+				return value;
+			}
+		private:
+			std::mutex m_mutex;
+			std::condition_variable m_condition;
+			bool m_ready = false;
+			std::optional<value_type> m_value;
+			std::exception_ptr m_exception;
+			std::vector<std::function<void()>> m_callbacks;
+		};
+	}
+
+	// 提交到线程池后立即开始执行的异步任务
+	// 可以在协程中co_await, 也可以get()阻塞等待, 或用then()登记完成回调
+	// 完成回调与co_await之后的代码都在执行任务的工作线程上运行
+	template <class T>
+	class task
+	{
+	public:
+		using value_type = T;
+
+		task() = default;
+		explicit task(std::shared_ptr<detail::shared_state<T>> state) : m_state{ std::move(state) } {}
+
+		bool valid() const noexcept
+		{
+			return m_state != nullptr;
+		}
+		bool ready() const
+		{
+			return state().ready();
+		}
+		void wait() const
+		{
+			state().wait();
+		}
+		T get()
+		{
+			state().wait();
+			if constexpr (std::is_void_v<T>)
+			{
+				state().take();
+			}
+			else
+			{
+				return state().take();
+			}
+		}
+		// 任务完成(包括抛出异常)后调用callback, 已完成时在当前线程立即调用
+		void then(std::function<void()> callback)
+		{
+			if (!state().add_callback(callback))
+			{
+				callback();
+			}
+		}
+
+		bool await_ready() const
+		{
+			return ready();
+		}
+		bool await_suspend(std::coroutine_handle<> handle)
+		{
+			return state().add_callback([handle] { handle.resume(); });
+		}
+		T await_resume()
+		{
+			return get();
+		}
+	private:
+		std::shared_ptr<detail::shared_state<T>> m_state;
+
+		detail::shared_state<T>& state() const
+		{
+			if (!m_state)
+			{
+				throw exception::bad_exception("使用了无效的异步任务");
+			}
+			return *m_state;
+		}
+	};
+
+	// 在线程池上执行func, 返回对应的异步任务
+	template <class F>
+	auto run(thread_pool::thread_pool& pool, F func, thread_pool::priority p = thread_pool::priority::interactive)
+		-> task<std::invoke_result_t<F>>
+	{
+		using result_type = std::invoke_result_t<F>;
+		auto state = std::make_shared<detail::shared_state<result_type>>();
+		pool.enqueue([state, func = std::move(func)]() mutable
+			{
+				try
+				{
+					if constexpr (std::is_void_v<result_type>)
+					{
+						func();
+						state->set_value({});
+					}
+					else
+					{
+						state->set_value(func());
+					}
+				}
+				catch (...)
+				{
+					state->set_exception(std::current_exception());
+				}
+			}, p);
+		return task<result_type>{ state };
+	}
+}
@@ -0,0 +1,364 @@
+#pragma once
+
+#include "exception.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cpr/cpr.h>
+#include <cstddef>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace memory::embedding
+{
+	struct client_options
+	{
+		std::string url = "http://127.0.0.1:11434/api/embed"; // Ollama批量接口, 请求体{"model", "input": [...]}, 响应体{"embeddings": [[...], ...]}
+		std::string model = "nomic-embed-text";
+		std::size_t dimension = 768;
+		std::size_t batch_size = 64;   // 单个请求最多包含的文本数
+		std::size_t max_in_flight = 4; // 同时进行的请求数上限, 同一客户端的所有调用共享
+		std::size_t max_retries = 3;   // 网络错误、429与5xx时的重试次数
+		std::chrono::milliseconds initial_backoff{ 100 };
+		std::chrono::milliseconds max_backoff{ 5000 };
+		std::chrono::milliseconds connect_timeout{ 3000 };
+		std::chrono::milliseconds timeout{ 60000 };
+	};
+
+	namespace detail
+	{
+		// 以SAX方式解析响应, 不构建JSON DOM, 数值直接写入调用方预分配的连续缓冲区
+		// 只接受顶层"embeddings"为rows个长度为dimension的数组, 顶层"error"字符串会被记录
+		class embeddings_sax
+		{
+		public:
+			using json = nlohmann::json;
+
+			embeddings_sax(float* out, const std::size_t rows, const std::size_t dimension)
+				: m_out{ out }, m_rows{ rows }, m_dimension{ dimension }
+			{
+			}
+
+			bool null() { return scalar(); }
+			bool boolean(bool) { return scalar(); }
+			bool number_integer(json::number_integer_t value) { return number(static_cast<double>(value)); }
+			bool number_unsigned(json::number_unsigned_t value) { return number(static_cast<double>(value)); }
+			bool number_float(json::number_float_t value, const json::string_t&) { return number(value); }
+			bool string(json::string_t& value)
+			{
+				if (m_depth == 1 && m_key == key_kind::error)
+				{
+					m_error = value;
+				}
+				return scalar();
+			}
+			bool binary(json::binary_t&) { return scalar(); }
+			bool start_object(std::size_t)
+			{
+				m_depth++;
+				if (m_state != state::outside)
+				{
+					return fail("embeddings中出现了对象");
+				}
+				return true;
+			}
+			bool key(json::string_t& value)
+			{
+				m_key = key_kind::other;
+				if (m_depth == 1)
+				{
+					if (value == "embeddings") { m_key = key_kind::embeddings; }
+					else if (value == "error") { m_key = key_kind::error; }
+				}
+				return true;
+			}
+			bool end_object()
+			{
+				m_depth--;
+				return true;
+			}
+			bool start_array(std::size_t)
+			{
+				m_depth++;
+				switch (m_state)
+				{
+				case state::outside:
+					if (m_depth == 2 && m_key == key_kind::embeddings)
+					{
+						m_state = state::embeddings;
+					}
+					return true;
+				case state::embeddings:
+					if (m_row >= m_rows)
+					{
+						return fail(std::format("返回的向量数多于请求的文本数{}", m_rows));
+					}
+					m_state = state::row;
+					m_column = 0;
+					return true;
+				default:
+					return fail("embeddings的嵌套层数错误");
+				}
+			}
+			bool end_array()
+			{
+				m_depth--;
+				if (m_state == state::row)
+				{
+					if (m_column != m_dimension)
+					{
+						return fail(std::format("第{}个向量的维度为{}, 期望为{}", m_row, m_column, m_dimension));
+					}
+					m_row++;
+					m_state = state::embeddings;
+				}
+				else if (m_state == state::embeddings)
+				{
+					m_state = state::outside;
+					m_key = key_kind::other;
+				}
+				return true;
+			}
+			bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& e)
+			{
+				return fail(std::format("位置{}: {}", position, e.what()));
+			}
+
+			std::size_t rows() const noexcept { return m_row; }
+			const std::string& error() const noexcept { return m_error; }
+		private:
+			enum class state { outside, embeddings, row };
+			enum class key_kind { other, embeddings, error };
+
+			float* m_out;
+			std::size_t m_rows;
+			std::size_t m_dimension;
+			std::size_t m_row = 0;
+			std::size_t m_column = 0;
+			std::size_t m_depth = 0;
+			state m_state = state::outside;
+			key_kind m_key = key_kind::other;
+			std::string m_error;
+
+			bool number(const double value)
+			{
+				if (m_state != state::row)
+				{
+					return scalar();
+				}
+				if (m_column >= m_dimension)
+				{
+					return fail(std::format("第{}个向量的维度超过{}", m_row, m_dimension));
+				}
+				m_out[m_row * m_dimension + m_column++] = static_cast<float>(value);
+				return true;
+			}
+			bool scalar()
+			{
+				if (m_state != state::outside)
+				{
+					return fail("embeddings中出现了非数值元素");
+				}
+				return true;
+			}
+			bool fail(std::string message)
+			{
+				m_error = std::move(message);
+				return false;
+			}
+		};
+	}
+
+	// 调用批量向量接口的客户端
+	// 输入按batch_size切分成多个请求并发发送, 每个请求占用一个保持长连接的会话, 会话数即在途请求数上限
+	// 可直接作为table::set_vectors/set_vector的回调
+	class client
+	{
+	public:
+		explicit client(client_options options = {})
+			: m_options{ std::move(options) },
+			m_pool{ std::max<std::size_t>(m_options.max_in_flight, 1) }
+		{
+			if (m_options.dimension == 0)
+			{
+				throw exception::invalid_argument("dimension不能为0");
+			}
+			if (m_options.batch_size == 0)
+			{
+				throw exception::invalid_argument("batch_size不能为0");
+			}
+			m_options.max_in_flight = std::max<std::size_t>(m_options.max_in_flight, 1);
+		}
+
+		const client_options& options() const noexcept
+		{
+			return m_options;
+		}
+
+		// 返回texts.size() * dimension个float, 第i段对应texts[i]
+		std::vector<float> embed(const std::vector<std::string>& texts)
+		{
+			std::vector<float> res(texts.size() * m_options.dimension);
+			embed_into(texts, res.data());
+			return res;
+		}
+		std::vector<float> embed_one(const std::string& text)
+		{
+			std::vector<float> res(m_options.dimension);
+			embed_into(std::span<const std::string>(&text, 1), res.data());
+			return res;
+		}
+		// out需要有texts.size() * dimension个float的空间
+		void embed_into(std::span<const std::string> texts, float* out)
+		{
+			const auto batches = (texts.size() + m_options.batch_size - 1) / m_options.batch_size;
+			if (batches == 1)
+			{
+				post_batch(texts, out);
+				return;
+			}
+			thread_pool::parallel_for(m_pool, batches, [&](const std::size_t batch)
+				{
+					const auto begin = batch * m_options.batch_size;
+					const auto count = std::min(m_options.batch_size, texts.size() - begin);
+					post_batch(texts.subspan(begin, count), out + begin * m_options.dimension);
+				}, m_options.max_in_flight);
+		}
+
+		std::vector<float> operator()(const std::vector<std::string>& texts)
+		{
+			return embed(texts);
+		}
+		std::vector<float> operator()(const std::string& text)
+		{
+			return embed_one(text);
+		}
+	private:
+		client_options m_options;
+		thread_pool::thread_pool m_pool;
+
+		// 空闲会话与已创建的会话数, 会话内部的curl句柄会复用连接
+		std::mutex m_sessions_mutex;
+		std::condition_variable m_sessions_condition;
+		std::vector<std::unique_ptr<cpr::Session>> m_sessions;
+		std::size_t m_sessions_created = 0;
+
+		// 归还会话的RAII包装
+		class session_lease
+		{
+		public:
+			session_lease(client& owner, std::unique_ptr<cpr::Session> session)
+				: m_owner{ owner }, m_session{ std::move(session) }
+			{
+			}
+			~session_lease()
+			{
+				m_owner.release_session(std::move(m_session));
+			}
+			session_lease(const session_lease&) = delete;
+			session_lease& operator=(const session_lease&) = delete;
+			cpr::Session& operator*() noexcept
+			{
+				return *m_session;
+			}
+		private:
+			client& m_owner;
+			std::unique_ptr<cpr::Session> m_session;
+		};
+
+		session_lease acquire_session()
+		{
+			std::unique_lock<std::mutex> lock(m_sessions_mutex);
+			m_sessions_condition.wait(lock, [this] { return !m_sessions.empty() || m_sessions_created < m_options.max_in_flight; });
+			if (!m_sessions.empty())
+			{
+				auto session = std::move(m_sessions.back());
+				m_sessions.pop_back();
+				return { *this, std::move(session) };
+			}
+			m_sessions_created++;
+			lock.unlock();
+
+			auto session = std::make_unique<cpr::Session>();
+			session->SetUrl(cpr::Url{ m_options.url });
+			session->SetHeader(cpr::Header{ { "Content-Type", "application/json" } });
+			session->SetConnectTimeout(cpr::ConnectTimeout{ m_options.connect_timeout });
+			session->SetTimeout(cpr::Timeout{ m_options.timeout });
+			return { *this, std::move(session) };
+		}
+		void release_session(std::unique_ptr<cpr::Session> session)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_sessions_mutex);
+				m_sessions.emplace_back(std::move(session));
+			}
+			m_sessions_condition.notify_one();
+		}
+
+		std::chrono::milliseconds backoff(const std::size_t attempt)
+		{
+			thread_local std::mt19937 generator{ std::random_device{}() };
+			const auto base = std::min(m_options.initial_backoff * (1ll << std::min<std::size_t>(attempt, 20)), m_options.max_backoff);
+			// 随机抖动避免多个请求同时重试
+			std::uniform_real_distribution<double> jitter(0.5, 1.0);
+			return std::chrono::milliseconds(static_cast<std::int64_t>(static_cast<double>(base.count()) * jitter(generator)));
+		}
+
+		void post_batch(std::span<const std::string> texts, float* out)
+		{
+			auto input = nlohmann::json::array();
+			for (const auto& text : texts)
+			{
+				input.push_back(text);
+			}
+			nlohmann::json body{
+				{ "model", m_options.model },
+				{ "input", std::move(input) }
+			};
+			const auto body_str = body.dump();
+
+			for (std::size_t attempt = 0;; attempt++)
+			{
+				cpr::Response res;
+				{
+					auto session = acquire_session();
+					(*session).SetBody(cpr::Body{ body_str });
+					res = (*session).Post();
+				}
+
+				const bool transport_error = res.error.code != cpr::ErrorCode::OK;
+				if (!transport_error && res.status_code == 200)
+				{
+					decode(res.text, texts.size(), out);
+					return;
+				}
+				const bool retryable = transport_error || res.status_code == 429 || res.status_code >= 500;
+				if (!retryable || attempt >= m_options.max_retries)
+				{
+					throw exception::embedding_error(transport_error
+						? std::format("请求{}失败: {}", m_options.url, res.error.message)
+						: std::format("请求{}失败, 状态码{}: {}", m_options.url, res.status_code, res.text));
+				}
+				std::this_thread::sleep_for(backoff(attempt));
+			}
+		}
+
+		void decode(const std::string& text, const std::size_t rows, float* out)
+		{
+			detail::embeddings_sax sax(out, rows, m_options.dimension);
+			const bool ok = nlohmann::json::sax_parse(text, &sax);
+			if (!ok || sax.rows() != rows)
+			{
+				throw exception::embedding_error(std::format("解析向量响应失败, 收到{}个向量, 期望{}个: {}", sax.rows(), rows, sax.error()));
+			}
+		}
+	};
+}
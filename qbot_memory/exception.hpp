@@ -1,7 +1,11 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <exception>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <stacktrace>
 #include <stdexcept>
@@ -10,6 +14,36 @@
 
 namespace memory::exception
 {
+    // 异常构造时的调用栈捕获方式
+    enum class stack_capture
+    {
+        off,  // 不捕获, what()只有异常名与消息
+        raw,  // 只捕获栈帧地址, what()输出未符号化的地址
+        full  // 捕获栈帧, 首次调用what()时符号化并输出函数名与源码位置
+    };
+
+    namespace detail
+    {
+        inline std::atomic<stack_capture> g_stack_capture{ stack_capture::full };
+
+        // what()的格式化结果, 同一异常的副本之间共享, 只格式化一次
+        struct what_cache
+        {
+            std::once_flag flag;
+            std::string str;
+        };
+    }
+
+    // 对之后构造的异常生效, 已构造的异常保持构造时的方式
+    inline void set_stack_capture(const stack_capture mode) noexcept
+    {
+        detail::g_stack_capture.store(mode, std::memory_order_relaxed);
+    }
+    inline stack_capture get_stack_capture() noexcept
+    {
+        return detail::g_stack_capture.load(std::memory_order_relaxed);
+    }
+
     class base_exception : public std::exception
     {
     public:
@@ -18,23 +52,23 @@ namespace memory::exception
         base_exception(const char* msg = "未知标准异常 请注意! 该异常不会抛出! 如果你收到这个异常 这是意外情况",
             frame_filter_func filter = default_frame_filter,
             const char* name = "标准异常")
-            : m_message(msg),
-            m_name(name),
-            m_stacktrace(std::stacktrace::current()),
+            : m_name(name),
+            m_message(msg),
+            m_capture(get_stack_capture()),
+            m_stacktrace(capture_stacktrace(m_capture)),
             m_frame_filter(std::move(filter))
         {
-            format_what();
         }
 
         base_exception(std::string msg,
             frame_filter_func filter = default_frame_filter,
             const char* name = "标准异常")
-            : m_message(std::move(msg)),
-            m_name(name),
-            m_stacktrace(std::stacktrace::current()),
+            : m_name(name),
+            m_message(std::move(msg)),
+            m_capture(get_stack_capture()),
+            m_stacktrace(capture_stacktrace(m_capture)),
             m_frame_filter(std::move(filter))
         {
-            format_what();
         }
 
         virtual ~base_exception() noexcept = default;
@@ -42,7 +76,7 @@ namespace memory::exception
         virtual std::string name() const noexcept { return m_name; }
         virtual std::string msg() const noexcept { return m_message; }
         virtual std::stacktrace stacktrace() const noexcept { return m_stacktrace; }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
 
         static bool default_frame_filter(const std::stacktrace_entry& frame)
         {
@@ -56,13 +90,47 @@ namespace memory::exception
         }
 
     protected:
-        void format_what()
+        // 首次访问时格式化, 格式化失败(例如内存不足)时退回到只有消息
+        const char* lazy_what() const noexcept
+        {
+            try
+            {
+                std::call_once(m_what->flag, [this] { m_what->str = format_what(); });
+                return m_what->str.c_str();
+            }
+            catch (...)
+            {
+                return m_message.c_str();
+            }
+        }
+
+        std::string format_what() const
         {
             std::ostringstream oss;
-            oss << "[" << m_name << "] " << m_message << "\n"
-                << "位置: " << get_most_recent_frame() << "\n"
-                << "调用栈:\n" << format_stacktrace();
-            m_what_str = oss.str();
+            oss << "[" << m_name << "] " << m_message << "\n";
+            switch (m_capture)
+            {
+            case stack_capture::off:
+                break;
+            case stack_capture::raw:
+                oss << "调用栈(未符号化):\n";
+                for (const auto& frame : m_stacktrace)
+                {
+                    oss << "    在 0x" << std::hex << reinterpret_cast<std::uintptr_t>(frame.native_handle()) << std::dec << "\n";
+                }
+                break;
+            case stack_capture::full:
+                oss << "位置: " << get_most_recent_frame() << "\n"
+                    << "调用栈:\n" << format_stacktrace();
+                break;
+            }
+            return oss.str();
+        }
+
+        static std::stacktrace capture_stacktrace(const stack_capture mode) noexcept
+        {
+            // 跳过本函数所在的帧
+            return mode == stack_capture::off ? std::stacktrace{} : std::stacktrace::current(1);
         }
 
         std::string format_stacktrace() const
@@ -110,8 +178,9 @@ namespace memory::exception
 
         std::string m_name;
         std::string m_message;
+        stack_capture m_capture;
         std::stacktrace m_stacktrace;
-        std::string m_what_str;
+        std::shared_ptr<detail::what_cache> m_what = std::make_shared<detail::what_cache>();
         frame_filter_func m_frame_filter;
     };
 
@@ -133,7 +202,7 @@ namespace memory::exception
             std::runtime_error(std::move(msg))
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~runtime_error() = default;
     };
 
@@ -153,7 +222,7 @@ namespace memory::exception
             : runtime_error(std::move(msg), filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~bad_exception() = default;
     };
 
@@ -173,7 +242,7 @@ namespace memory::exception
             : bad_exception(std::move(msg), filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~bad_function_call() = default;
     };
 
@@ -193,7 +262,7 @@ namespace memory::exception
             : bad_exception(std::move(msg), filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~bad_stmt() = default;
     };
 
@@ -213,7 +282,7 @@ namespace memory::exception
             : bad_stmt(std::move(msg), filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~stmt_call_error() = default;
     };
 
@@ -233,7 +302,7 @@ namespace memory::exception
             : bad_stmt(std::move(msg), filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~stmt_bind_error() = default;
     };
 
@@ -253,7 +322,7 @@ namespace memory::exception
             : bad_stmt(std::move(msg), filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~stmt_reset_error() = default;
     };
 
@@ -273,7 +342,7 @@ namespace memory::exception
             : bad_exception(std::move(msg), filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~bad_transaction() = default;
     };
 
@@ -293,7 +362,7 @@ namespace memory::exception
             : bad_exception(std::move(msg), filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~bad_database() = default;
     };
 
@@ -313,7 +382,7 @@ namespace memory::exception
             : bad_database(std::move(msg), filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~wal_error() = default;
     };
 
@@ -333,7 +402,7 @@ namespace memory::exception
             : bad_database(std::move(msg), filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~sqlite_call_error() = default;
     };
 
@@ -353,10 +422,30 @@ namespace memory::exception
             : sqlite_call_error(std::move(msg), filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~sqlite_extension_error() = default;
     };
 
+    class embedding_error : public bad_exception
+    {
+    public:
+        embedding_error(const char* msg = "向量生成失败",
+            frame_filter_func filter = default_frame_filter,
+            const char* name = "向量生成异常")
+            : bad_exception(msg, filter, name)
+        {
+        }
+
+        embedding_error(std::string msg,
+            frame_filter_func filter = default_frame_filter,
+            const char* name = "向量生成异常")
+            : bad_exception(std::move(msg), filter, name)
+        {
+        }
+        virtual const char* what() const noexcept override { return lazy_what(); }
+        virtual ~embedding_error() = default;
+    };
+
     class invalid_argument : public runtime_error, public std::invalid_argument
     {
     public:
@@ -369,7 +458,7 @@ namespace memory::exception
             frame_filter_func filter = default_frame_filter,
             const char* name = "无效参数异常")
             : runtime_error(msg, filter, name), std::invalid_argument(std::move(msg)) {}
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~invalid_argument() = default;
     };
 
@@ -389,7 +478,7 @@ namespace memory::exception
             : runtime_error(std::move(msg), filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~length_error() = default;
     };
 
@@ -409,7 +498,7 @@ namespace memory::exception
             : bad_exception(std::move(msg), filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~bad_alloc() = default;
     };
 
@@ -429,7 +518,7 @@ namespace memory::exception
             : runtime_error(msg, filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~range_error() = default;
     };
 
@@ -449,7 +538,7 @@ namespace memory::exception
             : range_error(std::move(msg), filter, name)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~out_of_range() = default;
     };
 
@@ -471,7 +560,7 @@ namespace memory::exception
             std::overflow_error(msg)
         {
         }
-        virtual const char* what() const noexcept override { return m_what_str.c_str(); }
+        virtual const char* what() const noexcept override { return lazy_what(); }
         virtual ~overflow_error() = default;
     };
 }
\ No newline at end of file
@@ -1,8 +1,10 @@
 #pragma once
 
 
+#include <faiss/IndexFlat.h>
 #include <faiss/IndexHNSW.h>
 #include <faiss/IndexIDMap.h>
+#include <faiss/VectorTransform.h>
 #include <faiss/index_io.h>
 
 namespace memory::f
@@ -1,48 +1,12 @@
 #include "memory.hpp"
 
+#include "embedding.hpp"
 #include "exception.hpp"
-#include <cpr/api.h>
-#include <cpr/body.h>
-#include <cpr/cprtypes.h>
 #include <memory>
-#include <nlohmann/json.hpp>
-#include <nlohmann/json_fwd.hpp>
 #include <print>
 #include <string>
 #include <vector>
 
-using json = nlohmann::json;
-
-std::vector<float> text_to_vec(const std::string& str)
-{
-	json body_json{
-		{"model", "nomic-embed-text"},
-		{"prompt", str}
-	};
-	auto res = cpr::Post(
-		cpr::Url{ "http://127.0.0.1:11434/api/embeddings" },
-		cpr::Header{ {"Content-Type", "application/json"} },
-		cpr::Body{ body_json.dump() }
-	);
-	if (res.status_code != 200)
-		throw memory::exception::runtime_error();
-	json res_json = json::parse(res.text);
-	if (!res_json["embedding"].is_array())
-		throw memory::exception::runtime_error();
-	std::vector<float> embeddings;
-	for (const auto& i : res_json["embedding"])
-	{
-		if (i.is_number_float())
-			embeddings.emplace_back(i.get<float>());
-	}
-	return embeddings;
-}
-
-std::vector<float> texts_to_vec(const std::vector<std::string>& vec)
-{
-	return {};
-}
-
 int main()
 {
 	try
@@ -55,10 +19,12 @@ int main()
 		auto db = std::make_shared<memory::database>(R"(C:\game\123\test\02\__test__.db)", R"(C:/game/source/SQLite_extension/simple.dll)");
 		try
 		{
-			memory::table test1{ db, "test1", 768 };
+			memory::table test1{ db, "test1", 768, 32, memory::metric::cosine };
 			test1.set_hnsw_efSearch(64);
-			test1.set_vector(text_to_vec);
-			//test1.set_vectors(texts_to_vec);
+			// 离线测试时可运行tools/embedding_stub_server.py代替Ollama
+			auto embedder = std::make_shared<memory::embedding::client>(memory::embedding::client_options{ .dimension = 768 });
+			test1.set_vector([embedder](std::string str) { return embedder->embed_one(str); });
+			test1.set_vectors([embedder](std::vector<std::string> strs) { return embedder->embed(strs); });
 			test1.add(memory::insert_data{ 1000, "幻日", "幻日", "幻蓝你好！", 0.11 });
 			test1.add(memory::insert_data{ 1023, "幻蓝", "幻蓝", "啊！是老爹啊！", 0.9 });
 			test1.add(memory::insert_data{ 1000, "幻蓝", "幻蓝", "老爹好！", 0.4 });
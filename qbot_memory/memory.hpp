@@ -1,19 +1,42 @@
 #pragma once
 
+#include "async.hpp"
 #include "exception.hpp"
 #include "faiss.hpp"
 #include "py.hpp"
+#include "simd.hpp"
 #include "sqlite.hpp"
+#include "stats.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <faiss/impl/io.h>
 #include <faiss/index_io.h>
 #include <filesystem>
 #include <format>
+#include <fstream>
 #include <functional>
+#include <future>
+#include <limits>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <new>
+#include <nlohmann/json.hpp>
+#include <queue>
 #include <random>
 #include <ranges>
 #include <sqlite3.h>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace fs = std::filesystem;
@@ -35,6 +58,107 @@ namespace memory
 		}
 	}
 
+	// 规范化消息用于判断完全重复: 去掉首尾空白, 连续空白(含全角空格)合并为一个空格, ASCII字母转小写
+	// 只改写ASCII字节与U+3000, 不会破坏UTF-8多字节字符
+	inline std::string normalize_message(std::string_view message)
+	{
+		std::string res;
+		res.reserve(message.size());
+		bool pending_space = false;
+		for (std::size_t i = 0; i < message.size(); i++)
+		{
+			const auto c = static_cast<unsigned char>(message[i]);
+			bool space = c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+			if (!space && c == 0xE3 && message.substr(i, 3) == "\xE3\x80\x80")
+			{
+				space = true;
+				i += 2;
+			}
+			if (space)
+			{
+				pending_space = !res.empty();
+				continue;
+			}
+			if (pending_space)
+			{
+				res += ' ';
+				pending_space = false;
+			}
+			res += (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : static_cast<char>(c);
+		}
+		return res;
+	}
+	// 规范化内容的64位FNV-1a哈希, 以有符号整数存入SQLite
+	inline std::int64_t message_hash(std::string_view normalized)
+	{
+		std::uint64_t hash = 14695981039346656037ull;
+		for (const auto c : normalized)
+		{
+			hash ^= static_cast<unsigned char>(c);
+			hash *= 1099511628211ull;
+		}
+		return static_cast<std::int64_t>(hash);
+	}
+
+	// 向量距离度量, 建表时确定并保存在__TABLE_MANAGE__中
+	// 向量搜索返回的distance统一为越小越近: L2为平方L2距离, 内积为负内积, 余弦为1-余弦相似度
+	enum class metric
+	{
+		l2,
+		inner_product,
+		cosine  // 插入与查询时把向量归一化, 使用内积索引
+	};
+	inline const char* metric_name(const metric m) noexcept
+	{
+		switch (m)
+		{
+		case metric::inner_product: return "inner_product";
+		case metric::cosine: return "cosine";
+		default: return "l2";
+		}
+	}
+	inline metric parse_metric(std::string_view name)
+	{
+		if (name == "l2") return metric::l2;
+		if (name == "inner_product") return metric::inner_product;
+		if (name == "cosine") return metric::cosine;
+		throw exception::invalid_argument(std::format("未知的距离度量: {}", name));
+	}
+
+	// 全文索引的存储方式
+	enum class fts_storage
+	{
+		internal,        // FTS5表自己保存一份消息
+		external_content // FTS5表只保存倒排索引, 内容从主表的message列读取, 消息不再存两份
+	};
+
+	// 向量降维方法
+	enum class reduction
+	{
+		none,
+		pca,             // 按已有向量训练主成分投影
+		random_rotation  // 随机正交投影, 不依赖数据分布
+	};
+	// 降维设置: HNSW只保存降维后的向量, 查询向量经过同一变换后搜索
+	struct reduction_options
+	{
+		reduction method = reduction::pca;
+		int dimension = 256;                      // 降维后的维度, 需小于表的向量维度
+		bool keep_full_vectors = true;            // 另存原始向量, 搜索结果用原始向量精确计算距离, 关闭降维时无需重新生成向量
+		std::size_t max_training_vectors = 100000; // 训练最多使用的向量数
+	};
+
+	// 插入时的去重设置, 默认关闭
+	// 重复的消息不再新增行与向量, 而是合并到已有行: duplicate_count加一, 并可把时间更新为较新的一次
+	struct dedup_options
+	{
+		bool enable = false;
+		bool exact = true;          // 规范化内容相同视为重复, 在生成向量之前检查
+		float near_distance = 0.0f; // 最近邻距离不大于此值视为近似重复, 与向量搜索返回的distance同一尺度, 不大于0时关闭
+		bool same_sender = false;   // 只与同一sender_uuid的消息合并
+		bool refresh_time = true;   // 合并时把已有行的时间更新为较新的时间
+	};
+
 	struct insert_data
 	{
 		std::size_t time;
@@ -44,6 +168,272 @@ namespace memory
 		double forget_probability;
 	};
 
+	// 批量导入的文件格式
+	// JSONL每行一个对象, CSV首行为列名; 字段名为time(或timestamp)、sender、sender_uuid、message、forget_probability
+	// time、sender_uuid、message必需, sender默认为空, forget_probability默认为0
+	enum class import_format
+	{
+		auto_detect, // 扩展名为.csv时按CSV, 否则按JSONL
+		jsonl,
+		csv
+	};
+	struct import_options
+	{
+		import_format format = import_format::auto_detect;
+		char delimiter = ',';                  // CSV的分隔符
+		std::size_t chunk_size = 1024;         // 一次生成向量的文本数
+		std::size_t max_inflight_chunks = 4;   // 同时生成向量的块数, 与set_embedding_parallelism共同决定对向量服务的并发
+		std::size_t transaction_rows = 65536;  // 一个事务写入的行数, 也是一次加入HNSW的向量数
+		bool skip_invalid = false;             // 跳过无法解析的行, 否则抛出异常
+	};
+	struct import_progress
+	{
+		std::uint64_t rows_read = 0;     // 已解析的行
+		std::uint64_t rows_imported = 0; // 已提交的行
+		std::uint64_t rows_skipped = 0;  // 因无法解析而跳过的行
+		std::uint64_t bytes_read = 0;
+		std::uint64_t bytes_total = 0;
+		double elapsed_seconds = 0.0;
+		double rows_per_second = 0.0;    // 按已提交的行计算
+	};
+
+	namespace detail
+	{
+		// 流式读取导入文件, 每次取出至多max条记录, 不把整个文件读入内存
+		class import_reader
+		{
+		public:
+			import_reader(const fs::path& path, import_format format, const char delimiter)
+				: m_path{ path.string() }, m_delimiter{ delimiter }
+			{
+				m_file.open(path, std::ios::binary);
+				if (!m_file)
+				{
+					throw exception::invalid_argument(std::format("无法打开导入文件: {}", m_path));
+				}
+				m_bytes_total = fs::file_size(path);
+				if (format == import_format::auto_detect)
+				{
+					auto extension = path.extension().string();
+					std::ranges::transform(extension, extension.begin(), [](const unsigned char c) { return static_cast<char>(std::tolower(c)); });
+					format = extension == ".csv" ? import_format::csv : import_format::jsonl;
+				}
+				m_csv = format == import_format::csv;
+				if (m_csv)
+				{
+					read_csv_header();
+				}
+			}
+			// 读到文件末尾且没有取出任何记录时返回false
+			bool next(std::vector<insert_data>& out, const std::size_t max, std::uint64_t& skipped, const bool skip_invalid)
+			{
+				while (out.size() < max)
+				{
+					std::optional<insert_data> data;
+					try
+					{
+						if (m_csv)
+						{
+							if (!read_csv_record())
+								break;
+							if (m_fields.size() == 1 && m_fields[0].empty())
+								continue;
+							data = parse_csv();
+						}
+						else
+						{
+							if (!read_line())
+								break;
+							if (std::ranges::all_of(m_line, [](const unsigned char c) { return std::isspace(c); }))
+								continue;
+							data = parse_json();
+						}
+					}
+					catch (const exception::invalid_argument&)
+					{
+						if (!skip_invalid)
+							throw;
+						skipped++;
+						continue;
+					}
+					out.emplace_back(std::move(*data));
+				}
+				return !out.empty();
+			}
+			std::uint64_t bytes_read() const noexcept
+			{
+				return m_bytes_read;
+			}
+			std::uint64_t bytes_total() const noexcept
+			{
+				return m_bytes_total;
+			}
+		private:
+			std::string m_path;
+			std::ifstream m_file;
+			char m_delimiter;
+			bool m_csv = false;
+			std::uint64_t m_bytes_read = 0;
+			std::uint64_t m_bytes_total = 0;
+			std::size_t m_line_number = 0;
+			std::string m_line;
+			std::vector<std::string> m_fields;
+			// CSV各字段所在的列, -1为缺失
+			int m_time_column = -1;
+			int m_sender_column = -1;
+			int m_sender_uuid_column = -1;
+			int m_message_column = -1;
+			int m_forget_probability_column = -1;
+
+			bool read_line()
+			{
+				if (!std::getline(m_file, m_line))
+					return false;
+				m_bytes_read += m_line.size() + 1;
+				m_line_number++;
+				if (!m_line.empty() && m_line.back() == '\r')
+					m_line.pop_back();
+				return true;
+			}
+			[[noreturn]] void invalid(std::string_view reason) const
+			{
+				throw exception::invalid_argument(std::format("导入文件{}第{}行: {}", m_path, m_line_number, reason));
+			}
+			// RFC 4180: 双引号包围的字段可以包含分隔符、换行与转义的双引号("")
+			bool read_csv_record()
+			{
+				m_fields.clear();
+				if (!read_line())
+					return false;
+				std::string field;
+				bool quoted = false;
+				std::size_t i = 0;
+				while (true)
+				{
+					if (i == m_line.size())
+					{
+						if (!quoted)
+							break;
+						// 引号内的换行属于字段内容
+						if (!read_line())
+							invalid("引号没有闭合");
+						field += '\n';
+						i = 0;
+						continue;
+					}
+					const auto c = m_line[i++];
+					if (quoted)
+					{
+						if (c != '"')
+							field += c;
+						else if (i < m_line.size() && m_line[i] == '"')
+						{
+							field += '"';
+							i++;
+						}
+						else
+							quoted = false;
+					}
+					else if (c == '"')
+						quoted = true;
+					else if (c == m_delimiter)
+						m_fields.emplace_back(std::exchange(field, {}));
+					else
+						field += c;
+				}
+				m_fields.emplace_back(std::move(field));
+				return true;
+			}
+			void read_csv_header()
+			{
+				if (!read_csv_record())
+					invalid("CSV文件缺少列名");
+				for (int i = 0; i < static_cast<int>(m_fields.size()); i++)
+				{
+					const auto& name = m_fields[i];
+					if (name == "time" || name == "timestamp") m_time_column = i;
+					else if (name == "sender") m_sender_column = i;
+					else if (name == "sender_uuid") m_sender_uuid_column = i;
+					else if (name == "message") m_message_column = i;
+					else if (name == "forget_probability") m_forget_probability_column = i;
+				}
+				if (m_time_column < 0 || m_sender_uuid_column < 0 || m_message_column < 0)
+					invalid("CSV列名中缺少time、sender_uuid或message");
+			}
+			insert_data parse_csv()
+			{
+				const auto column = [&](const int index) -> std::string&
+					{
+						if (index >= static_cast<int>(m_fields.size()))
+							invalid(std::format("只有{}列", m_fields.size()));
+						return m_fields[index];
+					};
+				insert_data data{};
+				const auto& time = column(m_time_column);
+				if (std::from_chars(time.data(), time.data() + time.size(), data.time).ec != std::errc{})
+					invalid(std::format("无效的time: {}", time));
+				if (m_sender_column >= 0)
+					data.sender = std::move(column(m_sender_column));
+				data.sender_uuid = std::move(column(m_sender_uuid_column));
+				data.message = std::move(column(m_message_column));
+				if (m_forget_probability_column >= 0 && !column(m_forget_probability_column).empty())
+				{
+					const auto& value = column(m_forget_probability_column);
+					if (std::from_chars(value.data(), value.data() + value.size(), data.forget_probability).ec != std::errc{})
+						invalid(std::format("无效的forget_probability: {}", value));
+				}
+				check_forget_probability(data);
+				return data;
+			}
+			insert_data parse_json()
+			{
+				const auto object = nlohmann::json::parse(m_line, nullptr, false);
+				if (object.is_discarded() || !object.is_object())
+					invalid("不是有效的JSON对象");
+				const auto field = [&](const char* name) -> const nlohmann::json*
+					{
+						const auto it = object.find(name);
+						return it == object.end() || it->is_null() ? nullptr : &*it;
+					};
+				insert_data data{};
+				auto time = field("time");
+				if (time == nullptr)
+					time = field("timestamp");
+				if (time == nullptr || !time->is_number_integer() || time->get<std::int64_t>() < 0)
+					invalid("缺少非负整数time");
+				data.time = time->get<std::size_t>();
+				if (const auto sender = field("sender"))
+				{
+					if (!sender->is_string())
+						invalid("sender不是字符串");
+					data.sender = sender->get<std::string>();
+				}
+				const auto sender_uuid = field("sender_uuid");
+				if (sender_uuid == nullptr || !sender_uuid->is_string())
+					invalid("缺少字符串sender_uuid");
+				data.sender_uuid = sender_uuid->get<std::string>();
+				const auto message = field("message");
+				if (message == nullptr || !message->is_string())
+					invalid("缺少字符串message");
+				data.message = message->get<std::string>();
+				if (const auto forget_probability = field("forget_probability"))
+				{
+					if (!forget_probability->is_number())
+						invalid("forget_probability不是数值");
+					data.forget_probability = forget_probability->get<double>();
+				}
+				check_forget_probability(data);
+				return data;
+			}
+			// 表上有CHECK约束, 越界的行会使整个事务失败, 在解析时提前拦下
+			void check_forget_probability(const insert_data& data) const
+			{
+				if (!(data.forget_probability >= 0.0 && data.forget_probability <= 1.0))
+					invalid(std::format("forget_probability需在0到1之间, 但实际值为: {}", data.forget_probability));
+			}
+		};
+	}
+
 	struct select_data
 	{
 		std::size_t id;
@@ -62,8 +452,39 @@ namespace memory
 		std::string message;
 	};
 
+	// 按相关度排序的全文搜索的过滤与排序设置, 过滤条件在同一条语句中与主表连接
+	struct fts_rank_options
+	{
+		std::optional<std::string> sender_uuid;
+		std::optional<std::size_t> time_start;     // 包含
+		std::optional<std::size_t> time_end;       // 包含
+		std::vector<double> weights;               // FTS各列的BM25权重, 依次对应(message), 为空时均为1
+		std::optional<std::string> highlight_start; // 与highlight_end同时提供时返回高亮后的消息
+		std::optional<std::string> highlight_end;
+	};
+	struct select_fts_rank_data
+	{
+		std::size_t id;
+		std::size_t time;
+		std::string sender;
+		std::string sender_uuid;
+		std::string message;
+		double score; // BM25分数, 越小越相关
+	};
+
 	struct select_vector_data
 	{
+		std::size_t id;
+		std::size_t time;
+		std::string sender;
+		std::string sender_uuid;
+		std::string message;
+		double distance; // 越小越近, 含义取决于表的距离度量
+	};
+
+	struct select_table_vector_data
+	{
+		std::string table_name;
 		std::size_t id;
 		std::size_t time;
 		std::string sender;
@@ -72,13 +493,233 @@ namespace memory
 		double distance;
 	};
 
-	class database
+	// 重建索引的设置
+	// 按id分块读取, 生成下一块向量的同时把当前块加入影子索引, 峰值内存与块大小相关而不是与表的行数相关
+	struct rebuild_options
+	{
+		std::size_t chunk_size = 1024;     // 每块的行数
+		std::size_t checkpoint_chunks = 64; // 每完成多少块保存一次检查点, 失败后再次调用可从检查点继续; 0为不保存
+		bool resume = true;                 // 存在未完成的检查点时继续, 为false时丢弃检查点从头开始
+	};
+
+	// 在线备份设置
+	struct backup_options
+	{
+		int pages_per_step = 1024;                   // 每一步复制的页数, 每步之间释放数据库锁, 不阻塞其他读写
+		std::chrono::milliseconds step_interval{ 0 }; // 每步之后的等待, 用于限制备份占用的IO
+	};
+	struct backup_report
+	{
+		std::string db_file;             // 备份的数据库文件
+		std::vector<std::string> tables; // 备份了索引的表
+		std::vector<std::string> partitions; // 备份了数据库文件的分区
+		std::uint64_t pages = 0;         // 数据库的总页数
+		std::uint64_t steps = 0;
+		double elapsed_seconds = 0.0;
+	};
+
+	// 一天中的一段本地时间, 单位分钟; begin_minute大于end_minute时跨越午夜, 例如{ 23 * 60, 6 * 60 }
+	struct time_window
+	{
+		int begin_minute = 0;
+		int end_minute = 24 * 60;
+	};
+	// 后台维护设置, 每次检查都在线程池的后台优先级上执行, 不与交互任务争抢工作线程
+	// PASSIVE检查点在任何时候都可以执行; TRUNCATE检查点、FTS合并、增量vacuum与索引快照只在安静时执行
+	struct maintenance_options
+	{
+		std::chrono::milliseconds interval{ 60000 };          // 两次检查之间的间隔
+		std::vector<time_window> quiet_windows;               // 安静时段, 为空时不限时段
+		std::chrono::milliseconds idle_for{ 10000 };          // 距最近一次观察到的插入/删除至少这么久才算安静, 0为不要求
+		std::uint64_t wal_passive_bytes = 4ull << 20;         // WAL文件超过此大小时执行PASSIVE检查点, 0为不执行
+		std::uint64_t wal_truncate_bytes = 64ull << 20;       // 超过此大小时改为TRUNCATE检查点并截断WAL文件, 0为不执行
+		int fts_merge_pages = 256;                            // 每个已打开表每次FTS5 merge最多写入的页数, 0为不合并
+		int vacuum_pages = 1024;                              // 每次增量vacuum最多释放的页数, 0为不执行; 需要先enable_incremental_vacuum
+		std::chrono::milliseconds snapshot_interval{ 600000 }; // 两次保存已打开表的FAISS索引的最小间隔, 只保存有写入的表; 0为不保存
+	};
+	// 维护执行情况, 单次检查的结果或启动以来的累计
+	struct maintenance_report
+	{
+		std::uint64_t passes = 0;               // 检查次数
+		std::uint64_t quiet_passes = 0;         // 其中处于安静状态的次数
+		std::uint64_t passive_checkpoints = 0;
+		std::uint64_t truncate_checkpoints = 0;
+		std::uint64_t checkpointed_frames = 0;  // 检查点写回数据库的WAL帧数
+		std::uint64_t fts_merges = 0;           // 实际合并了段的表次数
+		std::uint64_t vacuumed_pages = 0;       // 增量vacuum释放的页数
+		std::uint64_t index_snapshots = 0;      // 保存索引的表次数
+		std::uint64_t errors = 0;
+		std::uint64_t wal_bytes = 0;            // 最近一次检查结束时主库与附加的分区数据库的WAL文件大小之和
+		std::uint64_t freelist_pages = 0;       // 最近一次检查结束时主库与附加的分区数据库的空闲页数之和
+		std::vector<std::string> last_actions;  // 最近一次检查执行的操作
+		std::string last_error;
+		double elapsed_seconds = 0.0;
+	};
+
+	// PRAGMA temp_store的取值, 临时表与排序使用的临时存储
+	enum class temp_store_mode
+	{
+		automatic = 0, // 由编译选项SQLITE_TEMP_STORE决定
+		file = 1,
+		memory = 2
+	};
+
+	// 打开数据库连接的设置, 可选项为空时保持SQLite的默认值
+	struct database_options
+	{
+		int extra_open_flags = 0;                          // 额外的sqlite3_open_v2标志, 例如SQLITE_OPEN_NOFOLLOW; 不能包含SQLITE_OPEN_NOMUTEX
+		std::optional<int> page_size;                      // 只对新建的数据库生效, 已有数据库需要VACUUM才能改变
+		std::optional<std::int64_t> cache_size;            // 正数为页数, 负数为KiB
+		std::optional<std::int64_t> mmap_size;             // 内存映射的最大字节数, 0为不使用; 受编译选项SQLITE_MAX_MMAP_SIZE限制
+		std::optional<temp_store_mode> temp_store;
+		std::optional<sqlite::synchronous_mode> synchronous;
+		std::optional<std::size_t> wal_autocheckpoint;     // 页数, 0为关闭自动检查点
+		std::chrono::milliseconds busy_timeout{ 0 };      // 其他连接持有锁时的等待时间, 0为立即返回SQLITE_BUSY
+
+		// 交互查询: 大页缓存与内存映射, 临时数据放在内存中
+		static database_options low_latency()
+		{
+			database_options res;
+			res.cache_size = -65536;
+			res.mmap_size = 256ll << 20;
+			res.temp_store = temp_store_mode::memory;
+			res.synchronous = sqlite::synchronous_mode::NORMAL;
+			res.busy_timeout = std::chrono::milliseconds{ 5000 };
+			return res;
+		}
+		// 批量导入: 不等待落盘, 关闭自动检查点, 由调用方或后台维护在导入后执行检查点
+		static database_options bulk_load()
+		{
+			database_options res;
+			res.cache_size = -262144;
+			res.mmap_size = 256ll << 20;
+			res.temp_store = temp_store_mode::memory;
+			res.synchronous = sqlite::synchronous_mode::OFF;
+			res.wal_autocheckpoint = 0;
+			res.busy_timeout = std::chrono::milliseconds{ 30000 };
+			return res;
+		}
+		// 内存受限: 小页缓存, 不使用内存映射, 临时数据写入文件
+		static database_options low_memory()
+		{
+			database_options res;
+			res.cache_size = -2048;
+			res.mmap_size = 0;
+			res.temp_store = temp_store_mode::file;
+			res.synchronous = sqlite::synchronous_mode::NORMAL;
+			res.busy_timeout = std::chrono::milliseconds{ 5000 };
+			return res;
+		}
+	};
+	// 连接实际生效的设置, 从连接上读取, 可能因编译选项或已有数据库而与请求的不同
+	struct database_settings
+	{
+		bool serialized = true; // 连接是否自带互斥量
+		std::string journal_mode;
+		std::int64_t page_size = 0;
+		std::int64_t cache_size = 0;
+		std::int64_t mmap_size = 0;
+		temp_store_mode temp_store = temp_store_mode::automatic;
+		sqlite::synchronous_mode synchronous = sqlite::synchronous_mode::FULL;
+		std::int64_t wal_autocheckpoint = 0;
+		std::int64_t busy_timeout_ms = 0;
+		std::int64_t auto_vacuum = 0; // 0: NONE, 1: FULL, 2: INCREMENTAL
+	};
+
+	// 分区的时间粒度, 按UTC划分, 时间戳单位为秒
+	enum class partition_period
+	{
+		day,
+		month,
+		year
+	};
+	inline const char* partition_period_name(const partition_period period) noexcept
+	{
+		switch (period)
+		{
+		case partition_period::day: return "day";
+		case partition_period::year: return "year";
+		default: return "month";
+		}
+	}
+	inline partition_period parse_partition_period(std::string_view name)
+	{
+		if (name == "day") return partition_period::day;
+		if (name == "month") return partition_period::month;
+		if (name == "year") return partition_period::year;
+		throw exception::invalid_argument(std::format("未知的分区粒度: {}", name));
+	}
+	// 包含time的分区的起止时间[start, end)
+	inline std::pair<std::size_t, std::size_t> partition_range(const partition_period period, const std::size_t time)
+	{
+		using namespace std::chrono;
+		const sys_days day{ floor<days>(sys_seconds{ seconds{ static_cast<std::int64_t>(time) } }) };
+		const year_month_day ymd{ day };
+		sys_days start = day;
+		sys_days end = day + days{ 1 };
+		if (period == partition_period::month)
+		{
+			start = sys_days{ ymd.year() / ymd.month() / 1 };
+			end = sys_days{ (ymd.year() / ymd.month() + months{ 1 }) / 1 };
+		}
+		else if (period == partition_period::year)
+		{
+			start = sys_days{ ymd.year() / 1 / 1 };
+			end = sys_days{ (ymd.year() + years{ 1 }) / 1 / 1 };
+		}
+		return { static_cast<std::size_t>(duration_cast<seconds>(start.time_since_epoch()).count()),
+			static_cast<std::size_t>(duration_cast<seconds>(end.time_since_epoch()).count()) };
+	}
+
+	struct partition_options
+	{
+		partition_period period = partition_period::month; // 只对新建的分区表生效, 已有的沿用建表时的粒度
+		std::size_t writable_partitions = 2; // 最新的几个分区保持可写, 更早的分区在创建新分区时封存为只读
+		std::size_t max_attached = 8;        // 同时附加的分区数上限, 超出时分离最久未使用的空闲分区; SQLite默认最多附加10个数据库
+	};
+	struct partition_info
+	{
+		std::string name;       // 分区的表名, 也是FAISS索引的文件名
+		std::size_t time_start; // 包含
+		std::size_t time_end;   // 不包含
+		std::string db_file;
+		bool read_only;
+		bool compacted;
+		bool attached;
+	};
+	// 分区附加到数据库连接上使用的schema名
+	inline std::string partition_schema_name(const std::string& partition_name)
+	{
+		return std::format("{}_db", partition_name);
+	}
+
+	struct select_table_data
+	{
+		std::string table_name;
+		std::size_t id;
+		std::size_t time;
+		std::string sender;
+		std::string sender_uuid;
+		std::string message;
+	};
+
+	class table;
+	class partitioned_table;
+
+	class database : public std::enable_shared_from_this<database>
 	{
+		friend class table;
+		friend class partitioned_table;
 	public:
-		database(const fs::path& db_file_path, const fs::path& simple_path)
-			: m_db{ new sqlite::database(db_file_path.string()) },
+		database(const fs::path& db_file_path, const fs::path& simple_path, const database_options& options = {})
+			: m_db{ new sqlite::database(db_file_path.string(), open_flags(options)) },
 			m_db_file_path{ db_file_path }
 		{
+			// page_size需要在建表与切换WAL之前设置
+			if (options.page_size)
+			{
+				m_db->execute(std::format("PRAGMA page_size={};", *options.page_size));
+			}
 			m_db->enable_load_extension();
 			m_db->load_extension(simple_path.string());
 
@@ -89,12 +730,68 @@ namespace memory
 				vector_dimension INTEGER NOT NULL,
 				HNWS_max_connect INTEGER NOT NULL,
 				faiss_fullpath TEXT NOT NULL,
-				faiss_new_id INTEGER NOT NULL
+				faiss_new_id INTEGER NOT NULL,
+				metric TEXT NOT NULL DEFAULT 'l2'
+				);
+				)");
+			m_db->execute(R"(
+				CREATE TABLE IF NOT EXISTS __REBUILD_CHECKPOINT__ (
+				tablename TEXT PRIMARY KEY NOT NULL,
+				last_id INTEGER NOT NULL,
+				count INTEGER NOT NULL,
+				index_dimension INTEGER NOT NULL,
+				reembed INTEGER NOT NULL
+				);
+				)");
+			m_db->execute(R"(
+				CREATE TABLE IF NOT EXISTS __PARTITIONED_TABLE__ (
+				tablename TEXT PRIMARY KEY NOT NULL,
+				period TEXT NOT NULL,
+				vector_dimension INTEGER NOT NULL,
+				HNWS_max_connect INTEGER NOT NULL,
+				metric TEXT NOT NULL,
+				fts_storage TEXT NOT NULL
+				);
+				)");
+			m_db->execute(R"(
+				CREATE TABLE IF NOT EXISTS __PARTITION_MANAGE__ (
+				partition_name TEXT PRIMARY KEY NOT NULL,
+				tablename TEXT NOT NULL,
+				time_start INTEGER NOT NULL,
+				time_end INTEGER NOT NULL,
+				db_file TEXT NOT NULL,
+				read_only INTEGER NOT NULL DEFAULT 0,
+				compacted INTEGER NOT NULL DEFAULT 0
 				);
 				)");
+			migrate_table_manage();
 			m_db->execute("PRAGMA journal_mode=WAL;");
+			if (options.cache_size)
+			{
+				m_db->execute(std::format("PRAGMA cache_size={};", *options.cache_size));
+			}
+			if (options.mmap_size)
+			{
+				m_db->execute(std::format("PRAGMA mmap_size={};", *options.mmap_size));
+			}
+			if (options.temp_store)
+			{
+				m_db->execute(std::format("PRAGMA temp_store={};", static_cast<int>(*options.temp_store)));
+			}
+			if (options.synchronous)
+			{
+				m_db->set_synchronous(*options.synchronous);
+			}
+			if (options.wal_autocheckpoint)
+			{
+				m_db->set_wal_autocheckpoint(*options.wal_autocheckpoint);
+			}
+			m_db->busy_timeout(static_cast<int>(options.busy_timeout.count()));
+		}
+		~database()
+		{
+			stop_maintenance();
 		}
-		~database() = default;
 
 		const fs::path db_file_path() const noexcept
 		{
@@ -106,784 +803,3813 @@ namespace memory
 			return m_db;
 		}
 
+		// 同一数据库连接上的事务与预编译语句不能并发使用, 所有表的读写都需要持有这把锁
+		// 生成向量(调用回调)期间不持有此锁
+		std::unique_lock<std::recursive_mutex> lock()
+		{
+			return std::unique_lock<std::recursive_mutex>(m_mutex);
+		}
+
 		void set_synchronous(const sqlite::synchronous_mode synchronous)
 		{
+			auto lock = this->lock();
 			m_db->set_synchronous(synchronous);
 		}
 		void set_wal_autocheckpoint(const std::size_t wal_autocheckpoint)
 		{
+			auto lock = this->lock();
 			m_db->set_wal_autocheckpoint(wal_autocheckpoint);
 		}
 		void wal_checkpoint(sqlite::checkpoint::checkpoint moed, std::string_view db_name, int& log, int& ckpt)
 		{
+			auto lock = this->lock();
 			m_db->wal_checkpoint(moed, db_name, &log, &ckpt);
 		}
-	private:
-		const fs::path m_db_file_path;
-		std::shared_ptr<sqlite::database> m_db;
-	};
 
-	class table
-	{
-	public:
-		table(std::shared_ptr<database> db, const std::string& name, const int vector_dimension, const int HNWS_max_connect = 32)
-			: m_db(db->get()),
-			m_name(name)
+		// 连接当前实际生效的设置
+		database_settings settings()
 		{
-			sqlite::transaction ts(db->get(), sqlite::transaction_level::EXCLUSIVE);
-
-			init(ts, db, name, vector_dimension, HNWS_max_connect);
-
-			try_create_table(ts);
-
-			load_faiss_index();
-			ts.commit();
+			auto lock = this->lock();
+			database_settings res;
+			res.serialized = m_db->serialized();
+			res.journal_mode = m_db->pragma_text("journal_mode");
+			res.page_size = m_db->pragma_int("page_size");
+			res.cache_size = m_db->pragma_int("cache_size");
+			res.mmap_size = m_db->pragma_int("mmap_size");
+			res.temp_store = static_cast<temp_store_mode>(m_db->pragma_int("temp_store"));
+			res.synchronous = static_cast<sqlite::synchronous_mode>(m_db->pragma_int("synchronous"));
+			res.wal_autocheckpoint = m_db->pragma_int("wal_autocheckpoint");
+			res.busy_timeout_ms = m_db->pragma_int("busy_timeout");
+			res.auto_vacuum = m_db->pragma_int("auto_vacuum");
+			return res;
+		}
 
-			init_stmt();
+		// 所有表的阶段耗时与计数的汇总(包括已关闭的表), 以及SQLite页缓存的命中/未命中/写入次数
+		stats::snapshot stats()
+		{
+			auto res = m_stats.take();
+			auto lock = this->lock();
+			res.counters["sqlite_cache_hit"] = static_cast<std::uint64_t>(m_db->db_status(SQLITE_DBSTATUS_CACHE_HIT));
+			res.counters["sqlite_cache_miss"] = static_cast<std::uint64_t>(m_db->db_status(SQLITE_DBSTATUS_CACHE_MISS));
+			res.counters["sqlite_cache_write"] = static_cast<std::uint64_t>(m_db->db_status(SQLITE_DBSTATUS_CACHE_WRITE));
+			return res;
 		}
-		~table()
+		// 只清空数据库的汇总, 各表自己的统计不受影响
+		void reset_stats()
 		{
-			save_faiss_index();
+			m_stats.reset();
+			auto lock = this->lock();
+			m_db->db_status(SQLITE_DBSTATUS_CACHE_HIT, true);
+			m_db->db_status(SQLITE_DBSTATUS_CACHE_MISS, true);
+			m_db->db_status(SQLITE_DBSTATUS_CACHE_WRITE, true);
 		}
-		void save_faiss_index()
+
+		// SQLite语句级性能分析: 每条SQL的调用次数、耗时与全表扫描/排序/自动索引计数, 以及慢查询日志
+		// 耗时不小于slow_threshold_ms的执行记入慢查询日志, 最多保留slow_capacity条
+		void enable_sqlite_profiling(const double slow_threshold_ms, const std::size_t slow_capacity = 128)
 		{
-			if (!m_faiss_index)
-				return;
-			sqlite::stmt update_faiss_new_id{ m_db, R"(UPDATE __TABLE_MANAGE__ SET faiss_new_id = ? WHERE tablename = ?;)" };
-			update_faiss_new_id.bind(1, m_faiss_index_new_id);
-			update_faiss_new_id.bind(2, m_name);
-			update_faiss_new_id.step();
-			if (!fs::exists(m_faiss_fullpath.parent_path())) // write_index 不会自动创建目录
-				fs::create_directories(m_faiss_fullpath.parent_path());
-			faiss::write_index(m_faiss_index.get(), m_faiss_fullpath.string().c_str());
+			auto lock = this->lock();
+			m_db->enable_profiling(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double, std::milli>(slow_threshold_ms)), slow_capacity);
 		}
-		void set_vector(std::function<std::vector<float>(std::string)> func)
+		void disable_sqlite_profiling()
 		{
-			m_generate_vector_callback = func;
+			auto lock = this->lock();
+			m_db->disable_profiling();
 		}
-		void set_vectors(std::function < std::vector<float>(std::vector<std::string>)> func)
+		std::vector<sqlite::statement_profile> sqlite_statement_profiles()
 		{
-			m_generate_vectors_callback = func;
+			auto lock = this->lock();
+			return m_db->statement_profiles();
 		}
-		void set_hnsw_efSearch(const int efSearch)
+		// 附带每条慢查询当前的EXPLAIN QUERY PLAN
+		std::vector<sqlite::slow_query> sqlite_slow_queries()
 		{
-			m_faiss_index->hnsw.efSearch = efSearch;
+			auto lock = this->lock();
+			return m_db->slow_queries();
 		}
-		void add(const insert_data& data)
+		void reset_sqlite_profiling()
 		{
-			auto vector = m_generate_vector_callback(data.message);
-			m_faiss_index->add(1, vector.data());
+			auto lock = this->lock();
+			m_db->reset_profiling();
+		}
 
-			m_insert_fts_data.reset();
-			m_insert_main_data.reset();
+		// 在线备份到directory: 数据库文件与各表的FAISS索引按默认布局放在directory下, 直接打开即可恢复, 不需要重建索引
+		// 数据库按页增量复制, 最后一步与所有已打开表的索引快照在同一次持有数据库锁期间完成, 索引与行一致
+		// directory中已存在同名数据库文件时抛出异常
+		backup_report backup(const fs::path& directory, const backup_options& options = {});
+		async::task<backup_report> backup_async(fs::path directory, backup_options options = {})
+		{
+			return async::run(m_thread_pool, [self = shared_from_this(), directory = std::move(directory), options]
+				{
+					return self->backup(directory, options);
+				}, thread_pool::priority::background);
+		}
 
-			m_insert_main_data.bind(6, m_faiss_index_new_id++);
-			m_insert_main_data.bind(1, data.time);
-			if (data.sender.empty()) { m_insert_main_data.bind(2, ""); }
-			else { m_insert_main_data.bind(2, data.sender); }
-			m_insert_main_data.bind(3, data.sender_uuid);
-			m_insert_main_data.bind(4, data.message);
-			m_insert_main_data.bind(5, data.forget_probability);
-			sqlite::transaction ts{ m_db };
-			m_insert_main_data.step();
-			m_insert_fts_data.bind(1, m_db->last_insert_rowid());
-			m_insert_fts_data.bind(2, data.message);
-			m_insert_fts_data.step();
-			ts.commit();
-		}
-		void adds(const std::vector<insert_data>& datas)
+		// 按options定期在后台检查并维护数据库, 已在运行时以新的设置重新开始
+		void start_maintenance(const maintenance_options& options = {})
 		{
-			auto vector = insert_data_generate_vectors(datas);
-			m_faiss_index->add(datas.size(), vector.data());
-
-			m_insert_fts_data.reset();
-			m_insert_main_data.reset();
-
-			sqlite::transaction ts{ m_db };
-			for (const auto& i : datas)
+			if (options.interval.count() <= 0)
 			{
-				m_insert_fts_data.reset();
-				m_insert_main_data.reset();
-				m_insert_main_data.bind(6, m_faiss_index_new_id++);
-				m_insert_main_data.bind(1, i.time);
-				if (i.sender.empty()) { m_insert_main_data.bind(2, ""); }
-				else { m_insert_main_data.bind(2, i.sender); }
-				m_insert_main_data.bind(3, i.sender_uuid);
-				m_insert_main_data.bind(4, i.message);
-				m_insert_main_data.bind(5, i.forget_probability);
-				m_insert_main_data.step();
-				m_insert_fts_data.bind(1, m_db->last_insert_rowid());
-				m_insert_fts_data.bind(2, i.message);
-				m_insert_fts_data.step();
+				throw exception::invalid_argument("维护检查间隔必须大于0");
 			}
-			ts.commit();
+			std::lock_guard<std::mutex> control_lock(m_maintenance_control_mutex);
+			m_maintenance_thread = std::jthread([this, options](std::stop_token stop)
+				{
+					while (true)
+					{
+						{
+							std::unique_lock<std::mutex> lock(m_maintenance_mutex);
+							m_maintenance_condition.wait_for(lock, stop, options.interval, [] { return false; });
+						}
+						if (stop.stop_requested())
+						{
+							return;
+						}
+						// 等待本次检查完成再开始计时, 检查不会重叠
+						m_thread_pool.enqueue([this, &options]
+							{
+								run_maintenance(options);
+							}, thread_pool::priority::background).wait();
+					}
+				});
 		}
-		std::optional<select_data> search_id(const std::int64_t id)
+		// 等待正在执行的检查完成后返回
+		void stop_maintenance()
 		{
-			m_select_main_data_id.reset();
-			m_select_main_data_id.bind(1, id);
-			if (m_select_main_data_id.step() != SQLITE_ROW)
+			std::lock_guard<std::mutex> control_lock(m_maintenance_control_mutex);
+			if (m_maintenance_thread.joinable())
 			{
-				return {};
+				m_maintenance_thread.request_stop();
+				m_maintenance_thread.join();
 			}
-			return { select_data{m_select_main_data_id.get_column_uint64(0),
-				m_select_main_data_id.get_column_uint64(1),
-				m_select_main_data_id.get_column_str(2),
-				m_select_main_data_id.get_column_str(3) ,
-				m_select_main_data_id.get_column_str(4)} };
 		}
-		std::vector<select_data> search_list_uuid(std::string_view uuid)
+		bool maintenance_running()
 		{
-			sqlite::transaction ts(m_db);
-
-			m_select_main_sender_uuid.reset();
-			m_select_main_sender_uuid.bind(1, uuid);
-			std::vector<select_data> res;
-			while (m_select_main_sender_uuid.step() == SQLITE_ROW)
+			std::lock_guard<std::mutex> control_lock(m_maintenance_control_mutex);
+			return m_maintenance_thread.joinable();
+		}
+		// 立即在当前线程执行一次检查, 返回本次的结果并计入累计; force为true时忽略安静时段与空闲要求
+		// 单个步骤失败只记入errors与last_error, 不影响其他步骤
+		maintenance_report run_maintenance(const maintenance_options& options, const bool force = false);
+		// 启动以来(包括手动执行)的累计, last_actions等为最近一次检查的结果
+		maintenance_report maintenance_summary()
+		{
+			std::lock_guard<std::mutex> lock(m_maintenance_mutex);
+			return m_maintenance_total;
+		}
+		// 把数据库切换为auto_vacuum=INCREMENTAL, 之后维护才能增量释放空闲页
+		// 已有数据的数据库需要一次完整的VACUUM, 期间持有数据库锁并重写整个文件
+		void enable_incremental_vacuum()
+		{
+			trace::span span("database::enable_incremental_vacuum", "database");
+			auto lock = this->lock();
+			if (m_db->pragma_int("auto_vacuum") == 2)
 			{
-				res.emplace_back(m_select_main_sender_uuid.get_column_uint64(0),
-					m_select_main_sender_uuid.get_column_uint64(1),
-					m_select_main_sender_uuid.get_column_str(2),
-					m_select_main_sender_uuid.get_column_str(3),
-					m_select_main_sender_uuid.get_column_str(4)
-				);
+				return;
 			}
+			m_db->execute("PRAGMA auto_vacuum=INCREMENTAL;");
+			m_db->execute("VACUUM;");
+		}
 
-			ts.commit();
+		// 跨表向量搜索: 查询文本只生成一次向量, 各表的FAISS搜索在线程池上并发执行, 再用堆归并出全局top-k
+		// 向量生成使用table_names中第一个表的回调, 所有表的向量维度必须一致; 参与搜索的表需由std::shared_ptr持有
+		std::vector<select_table_vector_data> search_list_vector_text_tables(const std::vector<std::string>& table_names, std::string_view message, const faiss::idx_t k);
 
-			return res;
-		}
-		std::vector<select_data> search_list_uuid_limit(std::string_view uuid, const std::size_t limit)
+		// 异步版本在数据库的线程池上执行, 要求database由std::shared_ptr持有
+		async::task<std::vector<select_table_vector_data>> search_list_vector_text_tables_async(std::vector<std::string> table_names, std::string message, const faiss::idx_t k)
 		{
-			sqlite::transaction ts(m_db);
+			return async::run(m_thread_pool, [self = shared_from_this(), table_names = std::move(table_names), message = std::move(message), k]
+				{
+					return self->search_list_vector_text_tables(table_names, message, k);
+				});
+		}
+	private:
+		const fs::path m_db_file_path;
+		std::shared_ptr<sqlite::database> m_db;
+		std::recursive_mutex m_mutex;
 
-			m_select_main_sender_uuid_limit.reset();
-			m_select_main_sender_uuid_limit.bind(1, uuid);
-			m_select_main_sender_uuid_limit.bind(2, limit);
-			std::vector<select_data> res;
-			while (m_select_main_sender_uuid_limit.step() == SQLITE_ROW)
-			{
-				res.emplace_back(m_select_main_sender_uuid_limit.get_column_uint64(0),
-					m_select_main_sender_uuid_limit.get_column_uint64(1),
-					m_select_main_sender_uuid_limit.get_column_str(2),
-					m_select_main_sender_uuid_limit.get_column_str(3),
-					m_select_main_sender_uuid_limit.get_column_str(4)
-				);
-			}
+		// 当前已打开的表, 由table在构造/析构时登记/注销
+		std::mutex m_tables_mutex;
+		std::unordered_map<std::string, table*> m_tables;
 
-			ts.commit();
+		thread_pool::thread_pool m_thread_pool;
+		stats::recorder m_stats;
 
-			return res;
-		}
-		std::vector<select_data> search_list_time_start(const std::size_t start)
+		// 维护检查之间保留的状态, 由m_maintenance_pass_mutex保护
+		struct maintenance_state
 		{
-			sqlite::transaction ts(m_db);
+			std::uint64_t writes = 0;
+			std::chrono::steady_clock::time_point last_write{};
+			std::chrono::steady_clock::time_point last_snapshot{};
+			std::unordered_map<std::string, std::uint64_t> snapshot_writes; // 各表上次保存索引时的写入计数
+		};
+		std::mutex m_maintenance_pass_mutex;
+		maintenance_state m_maintenance_state;
+		std::mutex m_maintenance_mutex;
+		std::condition_variable_any m_maintenance_condition;
+		maintenance_report m_maintenance_total;
+		std::mutex m_maintenance_control_mutex;
+		std::jthread m_maintenance_thread;
 
-			m_select_main_data_time_start.reset();
-			m_select_main_data_time_start.bind(1, start);
-			std::vector<select_data> res;
-			while (m_select_main_data_time_start.step() == SQLITE_ROW)
+		void register_table(const std::string& name, table* t)
+		{
+			std::lock_guard<std::mutex> lock(m_tables_mutex);
+			m_tables[name] = t;
+		}
+		void unregister_table(const std::string& name, table* t)
+		{
+			std::lock_guard<std::mutex> lock(m_tables_mutex);
+			auto it = m_tables.find(name);
+			if (it != m_tables.end() && it->second == t) // 同名表被重复打开时, 只注销自己
 			{
-				res.emplace_back(m_select_main_data_time_start.get_column_uint64(0),
-					m_select_main_data_time_start.get_column_uint64(1),
-					m_select_main_data_time_start.get_column_str(2),
-					m_select_main_data_time_start.get_column_str(3),
-					m_select_main_data_time_start.get_column_str(4)
-				);
+				m_tables.erase(it);
 			}
-
-			ts.commit();
-
-			return res;
 		}
-		std::vector<select_data> search_list_time_end(const std::size_t end)
+		// 线程池与后台维护会在其他线程使用连接, 连接必须保留SQLite自带的互斥量
+		static int open_flags(const database_options& options)
 		{
-			sqlite::transaction ts(m_db);
-
-			m_select_main_data_time_end.reset();
-			m_select_main_data_time_end.bind(1, end);
-			std::vector<select_data> res;
-			while (m_select_main_data_time_end.step() == SQLITE_ROW)
+			if (options.extra_open_flags & SQLITE_OPEN_NOMUTEX)
 			{
-				res.emplace_back(m_select_main_data_time_end.get_column_uint64(0),
-					m_select_main_data_time_end.get_column_uint64(1),
-					m_select_main_data_time_end.get_column_str(2),
-					m_select_main_data_time_end.get_column_str(3),
-					m_select_main_data_time_end.get_column_str(4)
-				);
+				throw exception::invalid_argument("extra_open_flags不能包含SQLITE_OPEN_NOMUTEX");
 			}
-
-			ts.commit();
-
-			return res;
+			return SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI | options.extra_open_flags;
 		}
-		std::vector<select_data> search_list_time_start_end(const std::size_t start, const std::size_t end)
+		// __TABLE_MANAGE__中的索引路径与__PARTITION_MANAGE__中的分区文件为相对路径时, 相对于数据库文件所在的目录
+		fs::path resolve_path(const fs::path& stored) const
 		{
-			sqlite::transaction ts(m_db);
-
-			m_select_main_data_time_start_end.reset();
-			m_select_main_data_time_start_end.bind(1, start);
-			m_select_main_data_time_start_end.bind(2, end);
-			std::vector<select_data> res;
-			while (m_select_main_data_time_start_end.step() == SQLITE_ROW)
+			return stored.is_relative() ? m_db_file_path.parent_path() / stored : stored;
+		}
+		// 主库与附加的分区数据库的schema名与文件, 不含临时库; 调用方需持有数据库锁
+		std::vector<std::pair<std::string, fs::path>> attached_databases()
+		{
+			std::vector<std::pair<std::string, fs::path>> res;
+			sqlite::stmt database_list{ m_db, "PRAGMA database_list;" };
+			while (database_list.step() == SQLITE_ROW)
 			{
-				res.emplace_back(m_select_main_data_time_start_end.get_column_uint64(0),
-					m_select_main_data_time_start_end.get_column_uint64(1),
-					m_select_main_data_time_start_end.get_column_str(2),
-					m_select_main_data_time_start_end.get_column_str(3),
-					m_select_main_data_time_start_end.get_column_str(4)
-				);
+				const auto file = database_list.get_column_str(2);
+				if (file != nullptr && *file != '\0')
+				{
+					res.emplace_back(database_list.get_column_str(1), fs::path(file));
+				}
 			}
-
-			ts.commit();
-
 			return res;
 		}
-
-		std::vector<select_fts_data> search_list_fts_impl(
-			const std::optional<std::string_view>& fts = {},
-			const std::optional<std::vector<std::string>>& simple_query = {},
-			const std::optional<std::string_view>& start = {},
-			const std::optional<std::string_view>& end = {},
-			const std::optional<std::size_t>& limit = {})
+		static std::uint64_t wal_bytes(const fs::path& db_file)
 		{
-			// 参数验证
-			if (fts.has_value() + simple_query.has_value() != 1)
-			{
-				throw exception::invalid_argument("必须且只能提供一种查询类型(fts/simple_query)");
-			}
-
-			if ((simple_query.has_value() && simple_query->empty()) ||
-				(fts.has_value() && fts->empty()))
-			{
-				throw exception::invalid_argument("查询参数不能为空");
-			}
-
-			if (limit.has_value())
+			std::error_code ec;
+			const auto size = fs::file_size(fs::path(db_file).concat("-wal"), ec);
+			return ec ? 0 : static_cast<std::uint64_t>(size);
+		}
+		// 插入、删除与合并重复的行数之和, 变化说明期间有写入
+		static std::uint64_t write_count(const stats::snapshot& snapshot)
+		{
+			std::uint64_t res = 0;
+			for (const auto name : { "rows_inserted", "rows_deleted", "duplicates_merged" })
 			{
-				check_limit(*limit);
+				auto it = snapshot.counters.find(name);
+				if (it != snapshot.counters.end())
+				{
+					res += it->second;
+				}
 			}
-
-			// 准备SQL语句
-			std::string message_select = (start.has_value() && end.has_value())
-				? std::format("simple_highlight({}_fts, 0 , ?, ?) AS text", m_name)
-				: "message";
-
-			std::string query_type;
-			std::string arguments;
-
-			if (fts.has_value())
+			return res;
+		}
+		static bool in_quiet_window(const std::vector<time_window>& windows)
+		{
+			if (windows.empty())
 			{
-				query_type = "?";
+				return true;
 			}
-			else
+			const auto now = std::chrono::current_zone()->to_local(std::chrono::system_clock::now());
+			const auto minute = static_cast<int>(std::chrono::duration_cast<std::chrono::minutes>(now - std::chrono::floor<std::chrono::days>(now)).count());
+			return std::ranges::any_of(windows, [minute](const time_window& w)
+				{
+					return w.begin_minute <= w.end_minute
+						? minute >= w.begin_minute && minute < w.end_minute
+						: minute >= w.begin_minute || minute < w.end_minute;
+				});
+		}
+		// 旧版本的__TABLE_MANAGE__没有metric列, 已有的表都是L2
+		void migrate_table_manage()
+		{
+			sqlite::stmt table_info{ m_db, "PRAGMA table_info(__TABLE_MANAGE__);" };
+			while (table_info.step() == SQLITE_ROW)
 			{
-				query_type = "simple_query";
-				arguments = "(?";
-				for (size_t i = 1; i < simple_query->size(); i++)
+				if (std::string_view(table_info.get_column_str(1)) == "metric")
 				{
-					arguments += ", ?";
+					return;
 				}
-				arguments += ")";
 			}
+			table_info.close();
+			m_db->execute("ALTER TABLE __TABLE_MANAGE__ ADD COLUMN metric TEXT NOT NULL DEFAULT 'l2';");
+		}
+		// 各表的向量维度与距离度量需一致, 调用方需保证搜索期间表不被析构
+		std::vector<select_table_vector_data> search_vector_tables(const std::vector<table*>& tables, const float* vector, const faiss::idx_t k);
+		// 调用方需持有m_tables_mutex; 返回的shared_ptr使表在释放m_tables_mutex后仍不会被析构
+		std::shared_ptr<table> find_table(const std::string& name);
+	};
 
-			std::string sql = std::format(
-				"SELECT rowid, {} FROM {}_fts WHERE message MATCH {}{} ORDER BY rowid DESC{};",
-				message_select, m_name, query_type, arguments, limit.has_value() ? " LIMIT ?" : ""
-			);
-
-			// 执行查询
-			sqlite::transaction ts(m_db);
-			sqlite::stmt select_stmt(m_db, sql);
-
-			int bind_index = 1;
-
-			// 绑定高亮参数
-			if (start.has_value() && end.has_value())
-			{
-				select_stmt.bind(bind_index++, *start, SQLITE_STATIC);
-				select_stmt.bind(bind_index++, *end, SQLITE_STATIC);
-			}
+	class table : public std::enable_shared_from_this<table>
+	{
+		friend class database;
+		friend class partitioned_table;
+	public:
+		// 分组批量搜索时, 每个线程一次搜索的查询数
+		static constexpr std::size_t k_batch_search_chunk = 256;
+		// FTS表的列数(message)
+		static constexpr std::size_t k_fts_columns = 1;
 
-			// 绑定查询参数
-			if (fts.has_value())
+		// 已存在的表沿用建表时的向量维度、HNSW参数、距离度量与全文索引存储方式
+		table(std::shared_ptr<database> db, const std::string& name, const int vector_dimension, const int HNWS_max_connect = 32, const metric distance_metric = metric::l2, const fts_storage fts = fts_storage::internal)
+			: table(std::move(db), "main", name, vector_dimension, HNWS_max_connect, distance_metric, fts)
+		{
+		}
+		// 先保存再注销: 注销前并发的备份会等待保存完成, 取得与数据库一致的索引快照
+		~table()
+		{
+			save_faiss_index();
+			m_database->unregister_table(m_name, this);
+		}
+		const std::string& name() const noexcept
+		{
+			return m_name;
+		}
+		int vector_dimension() const noexcept
+		{
+			return m_vector_dimension;
+		}
+		metric distance_metric() const noexcept
+		{
+			return m_metric;
+		}
+		fts_storage fts_storage_mode()
+		{
+			auto lock = m_database->lock();
+			return m_fts_storage;
+		}
+		// 切换全文索引的存储方式: 重建FTS5表, 转为外部内容时用'rebuild'从主表重新生成索引
+		// 转为外部内容后可以VACUUM回收原先重复保存消息的空间
+		void set_fts_storage(const fts_storage fts)
+		{
+			trace::span span("table::set_fts_storage", "table");
+			span.arg("table", m_name);
+			auto lock = m_database->lock();
+			if (fts == m_fts_storage)
 			{
-				select_stmt.bind(bind_index++, *fts, SQLITE_STATIC);
+				return;
 			}
-			else
+			// 删除表之前需要先结束引用它的预编译语句
+			m_insert_fts_data.close();
+			m_del_fts_id.close();
+			try
 			{
-				for (const auto& term : *simple_query)
+				sqlite::transaction ts(m_db, sqlite::IMMEDIATE);
+				ts.execute(std::format("DROP TABLE {}_fts;", m_name));
+				ts.execute(std::format("CREATE VIRTUAL TABLE {}.{}_fts USING {};", m_schema, m_name, fts_definition(fts)));
+				if (fts == fts_storage::external_content)
 				{
-					select_stmt.bind(bind_index++, term);
+					ts.execute(std::format("INSERT INTO {0}_fts ({0}_fts) VALUES ('rebuild');", m_name));
 				}
-			}
-
-			// 绑定limit参数
-			if (limit.has_value())
-			{
-				select_stmt.bind(bind_index++, *limit);
-			}
-
-			// 处理结果
-			std::vector<select_fts_data> res;
-			while (select_stmt.step() == SQLITE_ROW)
-			{
-				m_select_main_data_id_no_message.reset();
-				m_select_main_data_id_no_message.bind(1, select_stmt.get_column_uint64(0));
-				if (m_select_main_data_id_no_message.step() != SQLITE_ROW)
+				else
 				{
-					continue;
+					ts.execute(std::format("INSERT INTO {0}_fts (rowid, message) SELECT id, message FROM {0};", m_name));
 				}
-				res.emplace_back(
-					m_select_main_data_id_no_message.get_column_uint64(0),
-					m_select_main_data_id_no_message.get_column_uint64(1),
-					m_select_main_data_id_no_message.get_column_str(2),
-					m_select_main_data_id_no_message.get_column_str(3),
-					select_stmt.get_column_str(1)
-				);
+				commit(ts);
+				m_fts_storage = fts;
 			}
-
-			ts.commit();
-			return res;
+			catch (...)
+			{
+				prepare_fts_stmt();
+				throw;
+			}
+			prepare_fts_stmt();
 		}
-
-		std::vector<select_vector_data> search_list_vector_text(std::string_view message, const faiss::idx_t k)
+		// 本表的阶段耗时与计数, 记录无锁, 快照不持有数据库锁
+		stats::snapshot stats() const
 		{
-			ckeck_k(k);
-
-			constexpr faiss::idx_t limit = 1;
-			sqlite::transaction ts(m_db);
-
-			auto vector = m_generate_vector_callback(message.data());
+			return m_stats.take();
+		}
+		void reset_stats() noexcept
+		{
+			m_stats.reset();
+		}
+		void save_faiss_index()
+		{
+			trace::span span("table::save_faiss_index", "table");
+			span.arg("table", m_name);
+			auto lock = m_database->lock();
+			if (!m_faiss_index)
+				return;
+			sqlite::stmt update_faiss_new_id{ m_db, R"(UPDATE __TABLE_MANAGE__ SET faiss_new_id = ? WHERE tablename = ?;)" };
+			update_faiss_new_id.bind(1, m_faiss_index_new_id);
+			update_faiss_new_id.bind(2, m_name);
+			update_faiss_new_id.step();
+			stats::scoped_timer timer(m_stats, stats::stage::index_save);
+			trace::span stage_span("stage::index_save", "stage");
+			if (!fs::exists(m_faiss_fullpath.parent_path())) // write_index 不会自动创建目录
+				fs::create_directories(m_faiss_fullpath.parent_path());
+			faiss::write_index(m_faiss_index.get(), m_faiss_fullpath.string().c_str());
+			if (m_transform)
+				faiss::write_VectorTransform(m_transform.get(), transform_path().string().c_str());
+			else
+				fs::remove(transform_path());
+			if (m_full_vectors)
+				faiss::write_index(m_full_vectors.get(), full_vectors_path().string().c_str());
+			else
+				fs::remove(full_vectors_path());
+		}
+		void set_vector(std::function<std::vector<float>(std::string)> func)
+		{
+			m_generate_vector_callback = func;
+		}
+		void set_vectors(std::function < std::vector<float>(std::vector<std::string>)> func)
+		{
+			m_generate_vectors_callback = func;
+		}
+		// 只设置了单条向量回调时, 批量生成向量的最大并发调用数, 1为逐条串行调用
+		void set_embedding_parallelism(const std::size_t parallelism)
+		{
+			if (parallelism < 1)
+			{
+				throw exception::invalid_argument("parallelism不能小于1, 但实际值为: 0");
+			}
+			m_embedding_parallelism.store(parallelism, std::memory_order_relaxed);
+		}
+		void set_hnsw_efSearch(const int efSearch)
+		{
+			auto lock = m_database->lock();
+			m_faiss_index->hnsw.efSearch = efSearch;
+		}
+		// 向量搜索的重排: 从HNSW取k*oversample个候选, 用索引中存储的全精度向量精确计算距离后取前k个, 1为关闭
+		// HNSW实际搜索的候选数为max(efSearch, k*oversample)
+		void set_rerank_oversample(const std::size_t oversample)
+		{
+			if (oversample < 1)
+			{
+				throw exception::invalid_argument("oversample不能小于1, 但实际值为: 0");
+			}
+			auto lock = m_database->lock();
+			m_rerank_oversample = oversample;
+		}
+		std::size_t rerank_oversample()
+		{
+			auto lock = m_database->lock();
+			return m_rerank_oversample;
+		}
+		// 训练降维变换并用降维后的向量重建索引, 已开启降维时按新设置重新训练
+		// 训练向量取自索引(未降维时)或另存的原始向量, 不会重新生成向量
+		void enable_reduction(const reduction_options& options)
+		{
+			trace::span span("table::enable_reduction", "table");
+			span.arg("table", m_name);
+			if (options.method == reduction::none)
+			{
+				throw exception::invalid_argument("降维方法不能为none, 关闭降维请使用disable_reduction");
+			}
+			if (options.dimension <= 0 || options.dimension >= m_vector_dimension)
+			{
+				throw exception::invalid_argument(std::format("降维后的维度需在1到{}之间, 但实际值为: {}", m_vector_dimension - 1, options.dimension));
+			}
+			if (options.max_training_vectors < 1)
+			{
+				throw exception::invalid_argument("max_training_vectors不能小于1, 但实际值为: 0");
+			}
+			auto lock = m_database->lock();
+			throw_if_rebuilding();
+			if (m_transform && !m_full_vectors)
+			{
+				throw exception::invalid_argument(std::format("表{}已降维且没有保存原始向量, 请先disable_reduction", m_name));
+			}
+			sqlite::transaction ts(m_db, sqlite::IMMEDIATE);
+			auto rows = read_index_rows();
+			const auto n = rows.ids.size();
+			if (n < static_cast<std::size_t>(options.dimension))
+			{
+				throw exception::invalid_argument(std::format("训练降维至少需要{}条向量, 但表{}只有{}条", options.dimension, m_name, n));
+			}
+			const auto& full = m_transform ? rows.full_vectors : rows.index_vectors;
+			const auto d = static_cast<std::size_t>(m_vector_dimension);
+
+			std::shared_ptr<faiss::VectorTransform> transform;
+			if (options.method == reduction::pca)
+				transform = std::make_shared<faiss::PCAMatrix>(m_vector_dimension, options.dimension);
+			else
+				transform = std::make_shared<faiss::RandomRotationMatrix>(m_vector_dimension, options.dimension);
+			// 均匀抽样训练向量
+			const auto train_n = std::min(n, options.max_training_vectors);
+			std::vector<float> train(train_n * d);
+			for (std::size_t i = 0; i < train_n; i++)
+			{
+				std::copy_n(full.data() + i * n / train_n * d, d, train.data() + i * d);
+			}
+			transform->train(static_cast<faiss::idx_t>(train_n), train.data());
+
+			auto old_transform = std::exchange(m_transform, transform);
+			try
+			{
+				std::vector<float> reduced;
+				const auto index_vectors = project(static_cast<faiss::idx_t>(n), full.data(), reduced);
+				replace_faiss_index(rows.ids, index_vectors, options.keep_full_vectors ? full.data() : nullptr);
+				commit(ts);
+			}
+			catch (...)
+			{
+				m_transform = old_transform;
+				throw;
+			}
+			save_faiss_index();
+		}
+		// 恢复为原始维度的索引; 没有保存原始向量时需要重新生成全部向量
+		void disable_reduction()
+		{
+			trace::span span("table::disable_reduction", "table");
+			span.arg("table", m_name);
+			auto lock = m_database->lock();
+			if (!m_transform)
+			{
+				return;
+			}
+			throw_if_rebuilding();
+			if (!m_full_vectors)
+			{
+				// 在影子索引中重新生成原始维度的向量, 切换时才去掉降维变换, 期间照常搜索与插入
+				// 必须先释放锁, online_rebuild中的释放只退出一层递归
+				lock.unlock();
+				if (!online_rebuild(true, {}, std::shared_ptr<faiss::VectorTransform>{}))
+				{
+					throw exception::runtime_error(std::format("表{}的索引正在重建", m_name));
+				}
+				return;
+			}
+			sqlite::transaction ts(m_db, sqlite::IMMEDIATE);
+			auto rows = read_index_rows();
+			auto old_transform = std::exchange(m_transform, nullptr);
+			try
+			{
+				replace_faiss_index(rows.ids, rows.full_vectors.data(), nullptr);
+				commit(ts);
+			}
+			catch (...)
+			{
+				m_transform = old_transform;
+				throw;
+			}
+			save_faiss_index();
+		}
+		reduction reduction_method()
+		{
+			auto lock = m_database->lock();
+			if (!m_transform)
+				return reduction::none;
+			return dynamic_cast<const faiss::PCAMatrix*>(m_transform.get()) ? reduction::pca : reduction::random_rotation;
+		}
+		// HNSW索引中向量的维度, 未降维时等于vector_dimension
+		int index_dimension()
+		{
+			auto lock = m_database->lock();
+			return m_transform ? m_transform->d_out : m_vector_dimension;
+		}
+		bool keeps_full_vectors()
+		{
+			auto lock = m_database->lock();
+			return m_full_vectors != nullptr;
+		}
+		void set_dedup(const dedup_options& options)
+		{
+			auto lock = m_database->lock();
+			m_dedup = options;
+		}
+		dedup_options dedup()
+		{
+			auto lock = m_database->lock();
+			return m_dedup;
+		}
+		// 行被合并过的次数(包含自身), 行不存在时返回空
+		std::optional<std::size_t> search_duplicate_count(const std::int64_t id)
+		{
+			auto lock = m_database->lock();
+			m_select_main_duplicate_count.reset();
+			m_select_main_duplicate_count.bind(1, id);
+			if (m_select_main_duplicate_count.step() != SQLITE_ROW)
+			{
+				return {};
+			}
+			return m_select_main_duplicate_count.get_column_uint64(0);
+		}
+		void add(const insert_data& data)
+		{
+			trace::span span("table::add", "table");
+			span.arg("table", m_name);
+			const auto normalized = normalize_message(data.message);
+			const auto hash = message_hash(normalized);
+
+			auto lock = m_database->lock();
+			const auto dedup = m_dedup;
+			if (dedup.enable && dedup.exact && merge_exact_duplicate(dedup, data, normalized, hash))
+			{
+				return;
+			}
+			lock.unlock();
+
+			auto vector = generate_vector(data.message);
+
+			lock.lock();
+			sqlite::transaction ts{ m_db };
+			if (dedup.enable)
+			{
+				// 生成向量期间没有持有锁, 完全重复需要再检查一次
+				if ((dedup.exact && merge_exact_duplicate(dedup, data, normalized, hash))
+					|| merge_near_duplicate(dedup, data, vector.data()))
+				{
+					commit(ts);
+					return;
+				}
+			}
+			index_add(1, vector.data());
+			insert_main_data(data, hash);
+			commit(ts);
+		}
+		// 开启去重时, 批内的完全重复合并到批内第一次出现的行; 批内的近似重复不会互相合并, 只与已入库的行比较
+		void adds(const std::vector<insert_data>& datas)
+		{
+			trace::span span("table::adds", "table");
+			span.arg("table", m_name);
+			std::vector<std::string> normalized;
+			std::vector<std::int64_t> hashes;
+			normalized.reserve(datas.size());
+			hashes.reserve(datas.size());
+			for (const auto& i : datas)
+			{
+				hashes.emplace_back(message_hash(normalized.emplace_back(normalize_message(i.message))));
+			}
+
+			// 需要生成向量的下标, 以及批内完全重复: (重复的下标, 第一次出现的下标)
+			std::vector<std::size_t> pending;
+			std::vector<std::pair<std::size_t, std::size_t>> batch_duplicates;
+			pending.reserve(datas.size());
+
+			auto lock = m_database->lock();
+			const auto dedup = m_dedup;
+			if (dedup.enable && dedup.exact)
+			{
+				std::unordered_multimap<std::int64_t, std::size_t> first_seen;
+				sqlite::transaction ts{ m_db };
+				for (std::size_t i = 0; i < datas.size(); i++)
+				{
+					auto [begin, end] = first_seen.equal_range(hashes[i]);
+					auto first = std::find_if(begin, end, [&](const auto& seen)
+						{
+							return normalized[seen.second] == normalized[i]
+								&& (!dedup.same_sender || datas[seen.second].sender_uuid == datas[i].sender_uuid);
+						});
+					if (first != end)
+					{
+						batch_duplicates.emplace_back(i, first->second);
+						continue;
+					}
+					if (merge_exact_duplicate(dedup, datas[i], normalized[i], hashes[i]))
+					{
+						continue;
+					}
+					first_seen.emplace(hashes[i], i);
+					pending.emplace_back(i);
+				}
+				commit(ts);
+			}
+			else
+			{
+				for (std::size_t i = 0; i < datas.size(); i++)
+				{
+					pending.emplace_back(i);
+				}
+			}
+			lock.unlock();
+
+			if (pending.empty())
+			{
+				return;
+			}
+			auto vector = string_generate_vectors(pending
+				| std::views::transform([&](const std::size_t i) { return datas[i].message; })
+				| std::ranges::to<std::vector<std::string>>());
+
+			lock.lock();
+			sqlite::transaction ts{ m_db };
+			// 每条待插入消息最终对应的行id, 供批内重复合并
+			std::vector<std::int64_t> row_ids(datas.size(), -1);
+			std::vector<std::size_t> inserts;
+			inserts.reserve(pending.size());
+			for (std::size_t p = 0; p < pending.size(); p++)
+			{
+				const auto i = pending[p];
+				if (dedup.enable)
+				{
+					if (dedup.exact)
+					{
+						if (auto id = find_exact_duplicate(dedup, datas[i], normalized[i], hashes[i]))
+						{
+							merge_duplicate(dedup, *id, datas[i].time);
+							row_ids[i] = *id;
+							continue;
+						}
+					}
+					if (auto id = find_near_duplicate(dedup, datas[i], vector.data() + p * m_vector_dimension))
+					{
+						merge_duplicate(dedup, *id, datas[i].time);
+						row_ids[i] = *id;
+						continue;
+					}
+				}
+				// 向量原地前移, 使待插入的向量保持连续
+				if (inserts.size() != p)
+				{
+					std::copy_n(vector.data() + p * m_vector_dimension, m_vector_dimension, vector.data() + inserts.size() * m_vector_dimension);
+				}
+				inserts.emplace_back(i);
+			}
+			index_add(inserts.size(), vector.data());
+			for (const auto i : inserts)
+			{
+				row_ids[i] = insert_main_data(datas[i], hashes[i]);
+			}
+			for (const auto& [duplicate, first] : batch_duplicates)
+			{
+				merge_duplicate(dedup, row_ids[first], datas[duplicate].time);
+			}
+			commit(ts);
+		}
+		// 从JSONL或CSV文件流式导入, 适合为新表回填大量历史消息
+		// 解析与写入在调用线程上进行, 同时有至多max_inflight_chunks块在线程池的后台任务中生成向量
+		// 每transaction_rows行一个事务, 向量一次加入HNSW; 导入期间关闭FTS自动合并, 结束后恢复并执行一次optimize
+		// 导入不做去重, 每个事务提交后调用progress; 出错时已提交的事务保留
+		import_progress import_file(const std::string& path, const import_options& options = {}, std::function<void(import_progress)> progress = {})
+		{
+			trace::span span("table::import_file", "table");
+			span.arg("table", m_name);
+			span.arg("path", path);
+			if (options.chunk_size < 1 || options.max_inflight_chunks < 1 || options.transaction_rows < 1)
+			{
+				throw exception::invalid_argument("chunk_size、max_inflight_chunks与transaction_rows不能小于1");
+			}
+			py::function<void(import_progress)> report{ progress };
+			detail::import_reader reader(path, options.format, options.delimiter);
+			const auto start = std::chrono::steady_clock::now();
+			import_progress res;
+			res.bytes_total = reader.bytes_total();
+
+			struct chunk
+			{
+				std::vector<insert_data> rows;
+				std::vector<float> vectors;
+				std::future<void> embedded;
+			};
+			std::deque<std::shared_ptr<chunk>> inflight;
+			bool eof = false;
+			// 保持max_inflight_chunks块在生成向量, 按文件顺序写入
+			auto fill = [&]
+				{
+					while (!eof && inflight.size() < options.max_inflight_chunks)
+					{
+						auto c = std::make_shared<chunk>();
+						if (!reader.next(c->rows, options.chunk_size, res.rows_skipped, options.skip_invalid))
+						{
+							eof = true;
+							break;
+						}
+						res.rows_read += c->rows.size();
+						c->embedded = m_database->m_thread_pool.enqueue([this, c]
+							{
+								c->vectors = string_generate_vectors(c->rows
+									| std::views::transform([](const insert_data& data) { return data.message; })
+									| std::ranges::to<std::vector<std::string>>());
+							}, thread_pool::priority::background);
+						inflight.emplace_back(std::move(c));
+					}
+				};
+
+			const auto automerge = fts_automerge();
+			set_fts_automerge(0);
+			try
+			{
+				fill();
+				while (!inflight.empty())
+				{
+					std::vector<std::shared_ptr<chunk>> batch;
+					std::size_t rows = 0;
+					while (!inflight.empty() && (batch.empty() || rows + inflight.front()->rows.size() <= options.transaction_rows))
+					{
+						auto c = std::move(inflight.front());
+						inflight.pop_front();
+						c->embedded.get();
+						rows += c->rows.size();
+						batch.emplace_back(std::move(c));
+						fill();
+					}
+					write_import_batch(batch, rows);
+					res.rows_imported += rows;
+					res.bytes_read = reader.bytes_read();
+					res.elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+					res.rows_per_second = res.elapsed_seconds > 0.0 ? static_cast<double>(res.rows_imported) / res.elapsed_seconds : 0.0;
+					if (report)
+					{
+						report(res);
+					}
+				}
+			}
+			catch (...)
+			{
+				// 等待仍在生成向量的任务, 它们引用了本表
+				for (auto& c : inflight)
+				{
+					if (c->embedded.valid())
+						c->embedded.wait();
+				}
+				set_fts_automerge(automerge);
+				throw;
+			}
+			set_fts_automerge(automerge);
+			{
+				trace::span optimize_span("table::import_file::fts_optimize", "table");
+				auto lock = m_database->lock();
+				m_db->execute(std::format("INSERT INTO {0}_fts({0}_fts) VALUES('optimize');", m_name));
+			}
+			save_faiss_index();
+			res.elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			res.rows_per_second = res.elapsed_seconds > 0.0 ? static_cast<double>(res.rows_imported) / res.elapsed_seconds : 0.0;
+			return res;
+		}
+		std::optional<select_data> search_id(const std::int64_t id)
+		{
+			trace::span span("table::search_id", "table");
+			span.arg("table", m_name);
+			auto lock = m_database->lock();
+			m_select_main_data_id.reset();
+			m_select_main_data_id.bind(1, id);
+			if (m_select_main_data_id.step() != SQLITE_ROW)
+			{
+				return {};
+			}
+			return { select_data{m_select_main_data_id.get_column_uint64(0),
+				m_select_main_data_id.get_column_uint64(1),
+				m_select_main_data_id.get_column_str(2),
+				m_select_main_data_id.get_column_str(3) ,
+				m_select_main_data_id.get_column_str(4)} };
+		}
+		std::vector<select_data> search_list_uuid(std::string_view uuid)
+		{
+			trace::span span("table::search_list_uuid", "table");
+			span.arg("table", m_name);
+			auto lock = m_database->lock();
+			sqlite::transaction ts(m_db);
+
+			m_select_main_sender_uuid.reset();
+			m_select_main_sender_uuid.bind(1, uuid);
+			std::vector<select_data> res;
+			while (m_select_main_sender_uuid.step() == SQLITE_ROW)
+			{
+				res.emplace_back(m_select_main_sender_uuid.get_column_uint64(0),
+					m_select_main_sender_uuid.get_column_uint64(1),
+					m_select_main_sender_uuid.get_column_str(2),
+					m_select_main_sender_uuid.get_column_str(3),
+					m_select_main_sender_uuid.get_column_str(4)
+				);
+			}
+
+			ts.commit();
+
+			return res;
+		}
+		std::vector<select_data> search_list_uuid_limit(std::string_view uuid, const std::size_t limit)
+		{
+			trace::span span("table::search_list_uuid_limit", "table");
+			span.arg("table", m_name);
+			auto lock = m_database->lock();
+			sqlite::transaction ts(m_db);
+
+			m_select_main_sender_uuid_limit.reset();
+			m_select_main_sender_uuid_limit.bind(1, uuid);
+			m_select_main_sender_uuid_limit.bind(2, limit);
+			std::vector<select_data> res;
+			while (m_select_main_sender_uuid_limit.step() == SQLITE_ROW)
+			{
+				res.emplace_back(m_select_main_sender_uuid_limit.get_column_uint64(0),
+					m_select_main_sender_uuid_limit.get_column_uint64(1),
+					m_select_main_sender_uuid_limit.get_column_str(2),
+					m_select_main_sender_uuid_limit.get_column_str(3),
+					m_select_main_sender_uuid_limit.get_column_str(4)
+				);
+			}
+
+			ts.commit();
+
+			return res;
+		}
+		std::vector<select_data> search_list_time_start(const std::size_t start)
+		{
+			trace::span span("table::search_list_time_start", "table");
+			span.arg("table", m_name);
+			auto lock = m_database->lock();
+			sqlite::transaction ts(m_db);
+
+			m_select_main_data_time_start.reset();
+			m_select_main_data_time_start.bind(1, start);
+			std::vector<select_data> res;
+			while (m_select_main_data_time_start.step() == SQLITE_ROW)
+			{
+				res.emplace_back(m_select_main_data_time_start.get_column_uint64(0),
+					m_select_main_data_time_start.get_column_uint64(1),
+					m_select_main_data_time_start.get_column_str(2),
+					m_select_main_data_time_start.get_column_str(3),
+					m_select_main_data_time_start.get_column_str(4)
+				);
+			}
+
+			ts.commit();
+
+			return res;
+		}
+		std::vector<select_data> search_list_time_end(const std::size_t end)
+		{
+			trace::span span("table::search_list_time_end", "table");
+			span.arg("table", m_name);
+			auto lock = m_database->lock();
+			sqlite::transaction ts(m_db);
+
+			m_select_main_data_time_end.reset();
+			m_select_main_data_time_end.bind(1, end);
+			std::vector<select_data> res;
+			while (m_select_main_data_time_end.step() == SQLITE_ROW)
+			{
+				res.emplace_back(m_select_main_data_time_end.get_column_uint64(0),
+					m_select_main_data_time_end.get_column_uint64(1),
+					m_select_main_data_time_end.get_column_str(2),
+					m_select_main_data_time_end.get_column_str(3),
+					m_select_main_data_time_end.get_column_str(4)
+				);
+			}
+
+			ts.commit();
+
+			return res;
+		}
+		std::vector<select_data> search_list_time_start_end(const std::size_t start, const std::size_t end)
+		{
+			trace::span span("table::search_list_time_start_end", "table");
+			span.arg("table", m_name);
+			auto lock = m_database->lock();
+			sqlite::transaction ts(m_db);
+
+			m_select_main_data_time_start_end.reset();
+			m_select_main_data_time_start_end.bind(1, start);
+			m_select_main_data_time_start_end.bind(2, end);
+			std::vector<select_data> res;
+			while (m_select_main_data_time_start_end.step() == SQLITE_ROW)
+			{
+				res.emplace_back(m_select_main_data_time_start_end.get_column_uint64(0),
+					m_select_main_data_time_start_end.get_column_uint64(1),
+					m_select_main_data_time_start_end.get_column_str(2),
+					m_select_main_data_time_start_end.get_column_str(3),
+					m_select_main_data_time_start_end.get_column_str(4)
+				);
+			}
+
+			ts.commit();
+
+			return res;
+		}
+
+		std::vector<select_fts_data> search_list_fts_impl(
+			const std::optional<std::string_view>& fts = {},
+			const std::optional<std::vector<std::string>>& simple_query = {},
+			const std::optional<std::string_view>& start = {},
+			const std::optional<std::string_view>& end = {},
+			const std::optional<std::size_t>& limit = {})
+		{
+			trace::span span("table::search_list_fts_impl", "table");
+			span.arg("table", m_name);
+			// 参数验证
+			if (fts.has_value() + simple_query.has_value() != 1)
+			{
+				throw exception::invalid_argument("必须且只能提供一种查询类型(fts/simple_query)");
+			}
+
+			if ((simple_query.has_value() && simple_query->empty()) ||
+				(fts.has_value() && fts->empty()))
+			{
+				throw exception::invalid_argument("查询参数不能为空");
+			}
+
+			if (limit.has_value())
+			{
+				check_limit(*limit);
+			}
+
+			// 准备SQL语句
+			std::string message_select = (start.has_value() && end.has_value())
+				? std::format("simple_highlight({}_fts, 0 , ?, ?) AS text", m_name)
+				: "message";
+
+			std::string query_type;
+			std::string arguments;
+
+			if (fts.has_value())
+			{
+				query_type = "?";
+			}
+			else
+			{
+				query_type = "simple_query";
+				arguments = "(?";
+				for (size_t i = 1; i < simple_query->size(); i++)
+				{
+					arguments += ", ?";
+				}
+				arguments += ")";
+			}
+
+			std::string sql = std::format(
+				"SELECT rowid, {} FROM {}_fts WHERE message MATCH {}{} ORDER BY rowid DESC{};",
+				message_select, m_name, query_type, arguments, limit.has_value() ? " LIMIT ?" : ""
+			);
+
+			// 执行查询
+			auto lock = m_database->lock();
+			sqlite::transaction ts(m_db);
+			sqlite::stmt select_stmt(m_db, sql);
+
+			int bind_index = 1;
+
+			// 绑定高亮参数
+			if (start.has_value() && end.has_value())
+			{
+				select_stmt.bind(bind_index++, *start, SQLITE_STATIC);
+				select_stmt.bind(bind_index++, *end, SQLITE_STATIC);
+			}
+
+			// 绑定查询参数
+			if (fts.has_value())
+			{
+				select_stmt.bind(bind_index++, *fts, SQLITE_STATIC);
+			}
+			else
+			{
+				for (const auto& term : *simple_query)
+				{
+					select_stmt.bind(bind_index++, term);
+				}
+			}
+
+			// 绑定limit参数
+			if (limit.has_value())
+			{
+				select_stmt.bind(bind_index++, *limit);
+			}
+
+			// 处理结果
+			std::vector<select_fts_data> res;
+			while (select_stmt.step() == SQLITE_ROW)
+			{
+				m_select_main_data_id_no_message.reset();
+				m_select_main_data_id_no_message.bind(1, select_stmt.get_column_uint64(0));
+				if (m_select_main_data_id_no_message.step() != SQLITE_ROW)
+				{
+					continue;
+				}
+				res.emplace_back(
+					m_select_main_data_id_no_message.get_column_uint64(0),
+					m_select_main_data_id_no_message.get_column_uint64(1),
+					m_select_main_data_id_no_message.get_column_str(2),
+					m_select_main_data_id_no_message.get_column_str(3),
+					select_stmt.get_column_str(1)
+				);
+			}
+
+			ts.commit();
+			return res;
+		}
+
+		// 按BM25相关度返回最相关的limit条, fts与simple_query必须且只能提供一种
+		// 通过FTS5的rank列排序, FTS5按相关度产出候选, 与主表按主键连接后过滤, 得到limit条即停止
+		std::vector<select_fts_rank_data> search_list_fts_ranked(
+			const std::optional<std::string_view>& fts,
+			const std::optional<std::vector<std::string>>& simple_query,
+			const std::size_t limit,
+			const fts_rank_options& options = {})
+		{
+			trace::span span("table::search_list_fts_ranked", "table");
+			span.arg("table", m_name);
+			if (fts.has_value() + simple_query.has_value() != 1)
+			{
+				throw exception::invalid_argument("必须且只能提供一种查询类型(fts/simple_query)");
+			}
+			if ((simple_query.has_value() && simple_query->empty()) ||
+				(fts.has_value() && fts->empty()))
+			{
+				throw exception::invalid_argument("查询参数不能为空");
+			}
+			check_limit(static_cast<faiss::idx_t>(limit));
+			if (options.weights.size() > k_fts_columns)
+			{
+				throw exception::invalid_argument(std::format("weights最多{}个, 但实际为: {}", k_fts_columns, options.weights.size()));
+			}
+			std::string rank = "bm25(";
+			for (std::size_t i = 0; i < options.weights.size(); i++)
+			{
+				if (!std::isfinite(options.weights[i]))
+				{
+					throw exception::invalid_argument(std::format("weights[{}]不是有限值", i));
+				}
+				rank += std::format("{}{}", i == 0 ? "" : ", ", options.weights[i]);
+			}
+			rank += ")";
+
+			const bool highlight = options.highlight_start.has_value() && options.highlight_end.has_value();
+			std::string query = "?";
+			if (simple_query.has_value())
+			{
+				query = "simple_query(?";
+				for (std::size_t i = 1; i < simple_query->size(); i++)
+				{
+					query += ", ?";
+				}
+				query += ")";
+			}
+			std::string filters;
+			if (options.sender_uuid.has_value())
+				filters += " AND m.sender_uuid = ?";
+			if (options.time_start.has_value())
+				filters += " AND m.timestamp >= ?";
+			if (options.time_end.has_value())
+				filters += " AND m.timestamp <= ?";
+			const auto sql = std::format(
+				"SELECT m.id, m.timestamp, m.sender, m.sender_uuid, {1}, {0}_fts.rank FROM {0}_fts JOIN {0} AS m ON m.id = {0}_fts.rowid "
+				"WHERE {0}_fts MATCH {2} AND {0}_fts.rank MATCH ?{3} ORDER BY {0}_fts.rank LIMIT ?;",
+				m_name,
+				highlight ? std::format("simple_highlight({}_fts, 0, ?, ?)", m_name) : "m.message",
+				query,
+				filters);
+
+			auto lock = m_database->lock();
+			sqlite::transaction ts(m_db);
+			sqlite::stmt select_stmt(m_db, sql);
+			int bind_index = 1;
+			if (highlight)
+			{
+				select_stmt.bind(bind_index++, *options.highlight_start);
+				select_stmt.bind(bind_index++, *options.highlight_end);
+			}
+			if (fts.has_value())
+			{
+				select_stmt.bind(bind_index++, *fts, SQLITE_STATIC);
+			}
+			else
+			{
+				for (const auto& term : *simple_query)
+				{
+					select_stmt.bind(bind_index++, term);
+				}
+			}
+			select_stmt.bind(bind_index++, rank);
+			if (options.sender_uuid.has_value())
+				select_stmt.bind(bind_index++, *options.sender_uuid);
+			if (options.time_start.has_value())
+				select_stmt.bind(bind_index++, *options.time_start);
+			if (options.time_end.has_value())
+				select_stmt.bind(bind_index++, *options.time_end);
+			select_stmt.bind(bind_index++, limit);
+
+			std::vector<select_fts_rank_data> res;
+			while (select_stmt.step() == SQLITE_ROW)
+			{
+				res.emplace_back(
+					select_stmt.get_column_uint64(0),
+					select_stmt.get_column_uint64(1),
+					select_stmt.get_column_str(2),
+					select_stmt.get_column_str(3),
+					select_stmt.get_column_str(4),
+					select_stmt.get_column_double(5));
+			}
+			ts.commit();
+			return res;
+		}
+		std::vector<select_vector_data> search_list_vector_text(std::string_view message, const faiss::idx_t k)
+		{
+			trace::span span("table::search_list_vector_text", "table");
+			span.arg("table", m_name);
+			ckeck_k(k);
+
+			constexpr faiss::idx_t limit = 1;
+
+			auto vector = generate_vector(std::string(message));
+
+			auto lock = m_database->lock();
+			sqlite::transaction ts(m_db);
 			std::vector<faiss::idx_t> indices(k * limit); // 索引结果
 			std::vector<float> distances(k * limit);        // 距离结果
-			m_faiss_index->search(limit, vector.data(), k, distances.data(), indices.data());
+			index_search(limit, vector.data(), k, distances.data(), indices.data());
+
+			auto res = hydrate_indices(indices, distances);
+			ts.commit();
+
+			return res;
+
+		}
+		std::vector<select_vector_data> search_list_vector_texts(const std::vector<std::string>& messages, const faiss::idx_t k)
+		{
+			trace::span span("table::search_list_vector_texts", "table");
+			span.arg("table", m_name);
+			if (messages.empty())
+			{
+				throw exception::invalid_argument("messages不能为空, 但实际为空");
+			}
+			ckeck_k(k);
+
+			auto vector = string_generate_vectors(messages);
+
+			auto lock = m_database->lock();
+			sqlite::transaction ts(m_db);
+			std::vector<faiss::idx_t> indices(k * messages.size()); // 索引结果
+			std::vector<float> distances(k * messages.size());        // 距离结果
+			index_search(messages.size(), vector.data(), k, distances.data(), indices.data());
+
+			auto res = hydrate_indices(indices, distances);
+			ts.commit();
+
+			return res;
+		}
+		// 与search_list_vector_texts相同, 但结果按查询分组: res[i]是messages[i]的命中, 按距离升序
+		// 被多个查询命中的行只回表一次; 查询数超过k_batch_search_chunk时按块在线程池上并发搜索
+		std::vector<std::vector<select_vector_data>> search_list_vector_texts_grouped(const std::vector<std::string>& messages, const faiss::idx_t k)
+		{
+			trace::span span("table::search_list_vector_texts_grouped", "table");
+			span.arg("table", m_name);
+			if (messages.empty())
+			{
+				throw exception::invalid_argument("messages不能为空, 但实际为空");
+			}
+			ckeck_k(k);
+
+			auto vector = string_generate_vectors(messages);
+
+			const auto n = messages.size();
+			std::vector<faiss::idx_t> indices(k * n); // 索引结果
+			std::vector<float> distances(k * n);        // 距离结果
+
+			auto lock = m_database->lock();
+			const auto chunks = (n + k_batch_search_chunk - 1) / k_batch_search_chunk;
+			{
+				stats::scoped_timer timer(m_stats, stats::stage::index_search);
+				trace::span stage_span("stage::index_search", "stage");
+				m_stats.add(stats::counter::searches, n);
+				// 调用线程持有数据库锁, 工作线程只做FAISS搜索
+				thread_pool::parallel_for(m_database->m_thread_pool, chunks, [&](const std::size_t chunk)
+					{
+						const auto begin = chunk * k_batch_search_chunk;
+						const auto count = std::min(k_batch_search_chunk, n - begin);
+						faiss_search(count,
+							vector.data() + begin * m_vector_dimension,
+							k,
+							distances.data() + begin * k,
+							indices.data() + begin * k);
+					});
+			}
+
+			sqlite::transaction ts(m_db);
+			std::unordered_map<faiss::idx_t, std::optional<select_vector_data>> rows;
+			rows.reserve(indices.size());
+			{
+				stats::scoped_timer timer(m_stats, stats::stage::hydrate);
+				trace::span stage_span("stage::hydrate", "stage");
+				for (const auto index : indices)
+				{
+					if (index >= 0 && !rows.contains(index))
+					{
+						auto row = hydrate_faiss_index_id(index, 0.0);
+						if (!row.has_value())
+						{
+							m_stats.add(stats::counter::hydrate_misses);
+						}
+						rows.emplace(index, std::move(row));
+					}
+				}
+			}
+			ts.commit();
+
+			std::vector<std::vector<select_vector_data>> res(n);
+			for (std::size_t i = 0; i < n; i++)
+			{
+				res[i].reserve(k);
+				for (std::size_t j = i * k; j < (i + 1) * k; j++)
+				{
+					if (indices[j] < 0)
+					{
+						continue;
+					}
+					const auto& row = rows[indices[j]];
+					if (!row.has_value())
+					{
+						continue;
+					}
+					auto& hit = res[i].emplace_back(*row);
+					hit.distance = distances[j];
+					m_stats.add(stats::counter::hits);
+				}
+			}
+			return res;
+		}
+
+		// 异步接口: 在数据库的线程池上执行对应的同步方法, 要求table由std::shared_ptr持有
+		// 生成向量的回调在工作线程上调用, 多个任务可以同时等待向量生成, 数据库读写仍按连接串行
+		async::task<void> add_async(insert_data data)
+		{
+			return run_async([data = std::move(data)](table& self) { self.add(data); });
+		}
+		async::task<void> adds_async(std::vector<insert_data> datas)
+		{
+			return run_async([datas = std::move(datas)](table& self) { self.adds(datas); });
+		}
+		async::task<std::vector<select_vector_data>> search_list_vector_text_async(std::string message, const faiss::idx_t k)
+		{
+			return run_async([message = std::move(message), k](table& self) { return self.search_list_vector_text(message, k); });
+		}
+		async::task<std::vector<select_vector_data>> search_list_vector_texts_async(std::vector<std::string> messages, const faiss::idx_t k)
+		{
+			return run_async([messages = std::move(messages), k](table& self) { return self.search_list_vector_texts(messages, k); });
+		}
+		async::task<std::vector<std::vector<select_vector_data>>> search_list_vector_texts_grouped_async(std::vector<std::string> messages, const faiss::idx_t k)
+		{
+			return run_async([messages = std::move(messages), k](table& self) { return self.search_list_vector_texts_grouped(messages, k); });
+		}
+		async::task<std::vector<select_fts_rank_data>> search_list_fts_ranked_async(
+			std::optional<std::string> fts,
+			std::optional<std::vector<std::string>> simple_query,
+			const std::size_t limit,
+			fts_rank_options options = {})
+		{
+			return run_async([fts = std::move(fts), simple_query = std::move(simple_query), limit, options = std::move(options)](table& self)
+				{
+					std::optional<std::string_view> view;
+					if (fts.has_value())
+					{
+						view = *fts;
+					}
+					return self.search_list_fts_ranked(view, simple_query, limit, options);
+				});
+		}
+		async::task<std::vector<select_fts_data>> search_list_fts_impl_async(
+			std::optional<std::string> fts = {},
+			std::optional<std::vector<std::string>> simple_query = {},
+			std::optional<std::string> start = {},
+			std::optional<std::string> end = {},
+			std::optional<std::size_t> limit = {})
+		{
+			return run_async([fts = std::move(fts), simple_query = std::move(simple_query), start = std::move(start), end = std::move(end), limit](table& self)
+				{
+					auto view = [](const std::optional<std::string>& str) -> std::optional<std::string_view>
+						{
+							if (str.has_value())
+							{
+								return *str;
+							}
+							return {};
+						};
+					return self.search_list_fts_impl(view(fts), simple_query, view(start), view(end), limit);
+				});
+		}
+
+		void forgotten()
+		{
+			trace::span span("table::forgotten", "table");
+			span.arg("table", m_name);
+			std::vector<std::size_t> ids;
+			std::random_device rd;
+			std::mt19937 generator(rd());
+			std::uniform_real_distribution<double> distribution(0.0, 1.0);
+
+			auto lock = m_database->lock();
+			sqlite::transaction ts(m_db, sqlite::IMMEDIATE);
+
+			m_select_main_id_forget_probability.reset();
+
+			constexpr double k_almost_one = 1.0 - std::numeric_limits<double>::epsilon();
+			constexpr double k_almost_zero = std::numeric_limits<double>::epsilon();
+			while (m_select_main_id_forget_probability.step() == SQLITE_ROW)
+			{
+				auto main_id = m_select_main_id_forget_probability.get_column_uint64(0);
+				auto forget_probability = m_select_main_id_forget_probability.get_column_double(1);
+				if (forget_probability <= k_almost_zero)
+				{
+					continue;
+				}
+				if (forget_probability >= k_almost_one
+					|| distribution(generator) < forget_probability
+					)
+				{
+					ids.emplace_back(main_id);
+					continue;
+				}
+			}
+			// 外部内容的全文索引删除时需要原消息, 先删全文索引再删主表
+			for (const auto& i : ids)
+			{
+				m_del_fts_id.reset();
+				m_del_fts_id.bind(1, i);
+				m_del_fts_id.step();
+				m_del_main_id.reset();
+				m_del_main_id.bind(1, i);
+				m_del_main_id.step();
+			}
+			m_stats.add(stats::counter::rows_deleted, ids.size());
+			commit(ts);
+			lock.unlock();
+			// 正在进行的重建会把这些行的向量留在新索引中, 等它结束后再重建一次
+			// 重建持有数据库锁时不会等待线程池, 在工作线程上等待也不会与之互相等待
+			while (!online_rebuild(false, {}))
+			{
+				lock.lock();
+				m_rebuild_finished.wait(lock, [this] { return !m_rebuilding; });
+				lock.unlock();
+			}
+		}
+
+		// 去掉已删除行留下的向量; 在影子索引中重建, 期间当前索引照常提供搜索并接受插入
+		void rebuild_faiss_index()
+		{
+			trace::span span("table::rebuild_faiss_index", "table");
+			span.arg("table", m_name);
+			if (!online_rebuild(false, {}))
+			{
+				throw exception::runtime_error(std::format("表{}的索引正在重建", m_name));
+			}
+		}
+		// 重新生成所有消息的向量并重建索引, 保持当前的降维设置; 在影子索引中重建, 期间当前索引照常提供搜索并接受插入
+		// 中途失败时当前索引不受影响, 再次调用可从检查点继续
+		void full_rebuild_faiss_index(const rebuild_options& options = {})
+		{
+			trace::span span("table::full_rebuild_faiss_index", "table");
+			span.arg("table", m_name);
+			if (!online_rebuild(true, options))
+			{
+				throw exception::runtime_error(std::format("表{}的索引正在重建", m_name));
+			}
+		}
+		// 在线程池的后台任务中重建
+		async::task<void> rebuild_faiss_index_async()
+		{
+			return run_async([](table& self) { self.rebuild_faiss_index(); }, thread_pool::priority::background);
+		}
+		async::task<void> full_rebuild_faiss_index_async(rebuild_options options = {})
+		{
+			return run_async([options](table& self) { self.full_rebuild_faiss_index(options); }, thread_pool::priority::background);
+		}
+		bool rebuilding()
+		{
+			auto lock = m_database->lock();
+			return m_rebuilding;
+		}
+
+		void drop()
+		{
+			{
+				auto lock = m_database->lock();
+				if (m_rebuilding)
+				{
+					throw exception::runtime_error(std::format("表{}的索引正在重建, 无法删除", m_name));
+				}
+			}
+			// 先注销再加锁, 与跨表搜索保持相同的加锁顺序(登记表锁 -> 数据库锁)
+			m_database->unregister_table(m_name, this);
+
+			auto lock = m_database->lock();
+			m_insert_main_data.close();
+			m_insert_fts_data.close();
+
+			m_select_main_data_id.close();
+			m_select_main_data_id_no_message.close();
+			m_select_main_faiss_index_id.close();
+
+			m_select_main_sender_uuid.close();
+			m_select_main_sender_uuid_limit.close();
+
+			m_select_main_data_time_start.close();
+			m_select_main_data_time_end.close();
+			m_select_main_data_time_start_end.close();
+
+			m_select_main_count.close();
+
+			m_select_main_id_forget_probability.close();
+			m_select_main_id_faiss_index.close();
+			m_select_main_id_faiss_index_after.close();
+			m_select_main_id_message.close();
+
+			m_update_main_id_to_faiss_index.close();
+
+			m_select_main_content_hash.close();
+			m_select_main_duplicate_count.close();
+			m_update_main_duplicate.close();
+
+			m_del_main_id.close();
+			m_del_fts_id.close();
+
+			sqlite::transaction ts(m_db, sqlite::EXCLUSIVE);
+			m_db->execute(std::format("DROP TABLE IF EXISTS {}", m_name));
+			m_db->execute(std::format("DROP TABLE IF EXISTS {}_fts", m_name));
+			sqlite::stmt delete_table(m_db, "DELETE FROM __TABLE_MANAGE__ WHERE tablename = ?", SQLITE_PREPARE_NO_VTAB);
+			delete_table.bind(1, m_name);
+			delete_table.step();
+			m_faiss_index.reset();
+			m_full_vectors.reset();
+			m_transform.reset();
+			fs::remove(m_faiss_fullpath);
+			fs::remove(transform_path());
+			fs::remove(full_vectors_path());
+			discard_rebuild_checkpoint(ts);
+			ts.commit();
+		}
+	private:
+		// 分区表的行与全文索引建在附加的数据库schema中, 其余语句不带schema, 依靠表名在各schema间唯一
+		table(std::shared_ptr<database> db, const std::string& schema, const std::string& name, const int vector_dimension, const int HNWS_max_connect, const metric distance_metric, const fts_storage fts)
+			: m_name(name),
+			m_schema(schema),
+			m_db(db->get()),
+			m_database(db),
+			m_stats(&db->m_stats)
+		{
+			{
+				auto lock = db->lock();
+				sqlite::transaction ts(db->get(), sqlite::transaction_level::EXCLUSIVE);
+
+				init(ts, db, name, vector_dimension, HNWS_max_connect, distance_metric);
+
+				try_create_table(ts, fts);
+				migrate_table(ts);
+				m_fts_storage = read_fts_storage(ts);
+
+				load_faiss_index();
+				ts.commit();
+
+				init_stmt();
+			}
+
+			// 释放数据库锁后再登记, 保持登记表锁 -> 数据库锁的加锁顺序
+			m_database->register_table(m_name, this);
+		}
+
+		std::string m_name;
+		std::string m_schema;
+		std::shared_ptr<sqlite::database> m_db;
+		std::shared_ptr<database> m_database;
+
+		int m_HNSW_max_connect;
+		int m_vector_dimension;
+		metric m_metric = metric::l2;
+
+		std::size_t m_faiss_index_new_id = 0;
+		std::shared_ptr<f::faiss_index> m_faiss_index;
+		fs::path m_faiss_fullpath;
+		std::shared_ptr<faiss::VectorTransform> m_transform; // 降维变换, 为空时不降维
+		std::shared_ptr<faiss::IndexFlat> m_full_vectors;     // 降维时另存的原始向量, 编号与m_faiss_index一致
+
+		py::function<std::vector<float>(std::string)> m_generate_vector_callback;
+		py::function<std::vector<float>(std::vector<std::string>)> m_generate_vectors_callback;
+		std::atomic<std::size_t> m_embedding_parallelism{ 8 };
+		std::size_t m_rerank_oversample = 1;
+		bool m_rebuilding = false; // 影子索引重建进行中, 由数据库锁保护
+		std::condition_variable_any m_rebuild_finished;
+		fts_storage m_fts_storage = fts_storage::internal;
+
+		sqlite::stmt m_insert_main_data;
+		sqlite::stmt m_insert_fts_data;
+
+		sqlite::stmt m_select_main_data_id;
+		sqlite::stmt m_select_main_data_id_no_message;
+		sqlite::stmt m_select_main_faiss_index_id;
+
+		sqlite::stmt m_select_main_sender_uuid;
+		sqlite::stmt m_select_main_sender_uuid_limit;
+
+		sqlite::stmt m_select_main_data_time_start;
+		sqlite::stmt m_select_main_data_time_end;
+		sqlite::stmt m_select_main_data_time_start_end;
+
+		sqlite::stmt m_select_main_count;
+
+		sqlite::stmt m_select_main_id_forget_probability;
+		sqlite::stmt m_select_main_id_faiss_index;
+		sqlite::stmt m_select_main_id_faiss_index_after;
+		sqlite::stmt m_select_main_id_message;
+
+		sqlite::stmt m_update_main_id_to_faiss_index;
+
+		dedup_options m_dedup;
+		stats::recorder m_stats;
+		sqlite::stmt m_select_main_content_hash;
+		sqlite::stmt m_select_main_duplicate_count;
+		sqlite::stmt m_update_main_duplicate;
+
+		sqlite::stmt m_del_main_id;
+		sqlite::stmt m_del_fts_id;
+
+		template <class F>
+		async::task<std::invoke_result_t<F, table&>> run_async(F func, thread_pool::priority p = thread_pool::priority::interactive)
+		{
+			return async::run(m_database->m_thread_pool, [self = shared_from_this(), func = std::move(func)]
+				{
+					return func(*self);
+				}, p);
+		}
+		void commit(sqlite::transaction& ts)
+		{
+			stats::scoped_timer timer(m_stats, stats::stage::commit);
+			trace::span stage_span("stage::commit", "stage");
+			ts.commit();
+		}
+		std::vector<float> generate_vector(const std::string& message)
+		{
+			stats::scoped_timer timer(m_stats, stats::stage::embed);
+			trace::span stage_span("stage::embed", "stage");
+			m_stats.add(stats::counter::embed_texts);
+			auto vector = m_generate_vector_callback(message);
+			if (m_metric == metric::cosine)
+			{
+				simd::normalize(vector.data(), vector.size());
+			}
+			return vector;
+		}
+		void index_search(const faiss::idx_t n, const float* vector, const faiss::idx_t k, float* distances, faiss::idx_t* indices)
+		{
+			stats::scoped_timer timer(m_stats, stats::stage::index_search);
+			trace::span stage_span("stage::index_search", "stage");
+			m_stats.add(stats::counter::searches, n);
+			faiss_search(n, vector, k, distances, indices);
+		}
+		// 调用方需持有数据库锁, 可以在多个线程上并发调用
+		// 降维且保存了原始向量时, 总是用原始向量重算候选距离, 返回的distance与未降维时同一尺度
+		void faiss_search(const faiss::idx_t n, const float* vector, const faiss::idx_t k, float* distances, faiss::idx_t* indices)
+		{
+			std::vector<float> reduced;
+			const float* query = project(n, vector, reduced);
+			const auto oversample = static_cast<faiss::idx_t>(m_rerank_oversample);
+			if (oversample <= 1 && !m_full_vectors)
+			{
+				m_faiss_index->search(n, query, k, distances, indices);
+				for (faiss::idx_t i = 0; i < n * k; i++)
+				{
+					distances[i] = indices[i] < 0 ? std::numeric_limits<float>::infinity() : to_distance(distances[i]);
+				}
+				return;
+			}
+			const auto candidates = k * oversample;
+			std::vector<float> candidate_distances(n * candidates);
+			std::vector<faiss::idx_t> candidate_indices(n * candidates);
+			m_faiss_index->search(n, query, candidates, candidate_distances.data(), candidate_indices.data());
+			if (m_full_vectors)
+			{
+				rerank(n, vector, m_vector_dimension, m_full_vectors->get_xb(), candidates, candidate_indices.data(), k, distances, indices);
+			}
+			else
+			{
+				const auto storage = dynamic_cast<const faiss::IndexFlat*>(m_faiss_index->storage);
+				if (storage == nullptr)
+				{
+					throw exception::runtime_error("FAISS索引没有全精度存储, 无法重排");
+				}
+				rerank(n, query, m_faiss_index->d, storage->get_xb(), candidates, candidate_indices.data(), k, distances, indices);
+			}
+		}
+		// FAISS返回的原始值(平方L2距离或内积)转换为越小越近的距离
+		float to_distance(const float raw) const noexcept
+		{
+			switch (m_metric)
+			{
+			case metric::inner_product: return -raw;
+			case metric::cosine: return 1.0f - raw;
+			default: return raw;
+			}
+		}
+		std::shared_ptr<f::faiss_index> make_faiss_index() const
+		{
+			return make_faiss_index(m_transform.get());
+		}
+		// transform为空时建立原始维度的索引
+		std::shared_ptr<f::faiss_index> make_faiss_index(const faiss::VectorTransform* transform) const
+		{
+			return std::make_shared<f::faiss_index>(transform ? transform->d_out : m_vector_dimension, m_HNSW_max_connect,
+				m_metric == metric::l2 ? faiss::METRIC_L2 : faiss::METRIC_INNER_PRODUCT);
+		}
+		// 把原始维度的向量变换为索引维度, 未降维时直接返回输入
+		// 余弦度量在降维后重新归一化, 使索引中的内积仍是余弦相似度
+		const float* project(const faiss::idx_t n, const float* vector, std::vector<float>& reduced) const
+		{
+			return project(m_transform.get(), n, vector, reduced);
+		}
+		const float* project(const faiss::VectorTransform* transform, const faiss::idx_t n, const float* vector, std::vector<float>& reduced) const
+		{
+			if (!transform || n == 0)
+			{
+				return vector;
+			}
+			reduced.resize(static_cast<std::size_t>(n) * transform->d_out);
+			transform->apply_noalloc(n, vector, reduced.data());
+			if (m_metric == metric::cosine)
+			{
+				simd::normalize_batch(reduced.data(), static_cast<std::size_t>(n), static_cast<std::size_t>(transform->d_out));
+			}
+			return reduced.data();
+		}
+		// 向索引追加原始维度的向量, 调用方需持有数据库锁
+		void index_add(const std::size_t n, const float* vector)
+		{
+			std::vector<float> reduced;
+			m_faiss_index->add(static_cast<faiss::idx_t>(n), project(static_cast<faiss::idx_t>(n), vector, reduced));
+			if (m_full_vectors)
+			{
+				m_full_vectors->add(static_cast<faiss::idx_t>(n), vector);
+			}
+		}
+		// 对每个查询的候选精确重算距离并选出前k个, 不足k个时以-1补齐
+		// stored为按索引编号排列、每条d维的向量, vector为同一维度的查询
+		void rerank(const faiss::idx_t n, const float* vector, const std::size_t d, const float* stored, const faiss::idx_t candidates, const faiss::idx_t* candidate_indices, const faiss::idx_t k, float* distances, faiss::idx_t* indices)
+		{
+			stats::scoped_timer timer(m_stats, stats::stage::rerank);
+			trace::span stage_span("stage::rerank", "stage");
+			std::vector<std::pair<float, faiss::idx_t>> scored;
+			scored.reserve(candidates);
+			for (faiss::idx_t q = 0; q < n; q++)
+			{
+				const float* query = vector + q * d;
+				scored.clear();
+				for (faiss::idx_t c = 0; c < candidates; c++)
+				{
+					const auto id = candidate_indices[q * candidates + c];
+					if (id >= 0)
+					{
+						const float* candidate = stored + id * d;
+						scored.emplace_back(m_metric == metric::l2 ? simd::l2_sqr(query, candidate, d) : to_distance(simd::inner_product(query, candidate, d)), id);
+					}
+				}
+				const auto top = std::min(static_cast<std::size_t>(k), scored.size());
+				std::partial_sort(scored.begin(), scored.begin() + top, scored.end());
+				for (faiss::idx_t j = 0; j < k; j++)
+				{
+					const auto out = q * k + j;
+					if (static_cast<std::size_t>(j) < top)
+					{
+						distances[out] = scored[j].first;
+						indices[out] = scored[j].second;
+					}
+					else
+					{
+						distances[out] = std::numeric_limits<float>::infinity();
+						indices[out] = -1;
+					}
+				}
+			}
+		}
+		// 降维变换与原始向量与索引文件放在一起
+		static fs::path transform_path(const fs::path& faiss_path)
+		{
+			return fs::path(faiss_path).replace_extension(".transform");
+		}
+		static fs::path full_vectors_path(const fs::path& faiss_path)
+		{
+			return fs::path(faiss_path).replace_extension(".full.faiss");
+		}
+		fs::path transform_path() const
+		{
+			return transform_path(m_faiss_fullpath);
+		}
+		fs::path full_vectors_path() const
+		{
+			return full_vectors_path(m_faiss_fullpath);
+		}
+		// 全量重建的中间状态: 已处理到的主表id与已加入新索引的向量数
+		struct rebuild_state
+		{
+			std::uint64_t last_id = 0;
+			std::uint64_t count = 0;
+			std::shared_ptr<f::faiss_index> index;
+			std::shared_ptr<faiss::IndexFlat> full_vectors;
+		};
+		fs::path rebuild_path() const
+		{
+			return fs::path(m_faiss_fullpath).replace_extension(".rebuild.faiss");
+		}
+		std::shared_ptr<faiss::IndexFlat> make_full_vectors() const
+		{
+			return std::make_shared<faiss::IndexFlat>(m_vector_dimension,
+				m_metric == metric::l2 ? faiss::METRIC_L2 : faiss::METRIC_INNER_PRODUCT);
+		}
+		// 先写临时文件再改名, 索引文件保存完整后才在事务中更新检查点记录
+		// 改名后、提交前失败时文件中的向量多于记录, 继续时会被判为不一致而从头开始
+		void write_rebuild_files(const rebuild_state& state) const
+		{
+			trace::span span("table::write_rebuild_files", "table");
+			span.arg("count", state.count);
+			const auto path = rebuild_path();
+			auto write = [](const faiss::Index* index, const fs::path& target)
+				{
+					auto temporary = fs::path(target).concat(".tmp");
+					faiss::write_index(index, temporary.string().c_str());
+					fs::rename(temporary, target);
+				};
+			if (!fs::exists(path.parent_path()))
+				fs::create_directories(path.parent_path());
+			write(state.index.get(), path);
+			if (state.full_vectors)
+				write(state.full_vectors.get(), full_vectors_path(path));
+			else
+				fs::remove(full_vectors_path(path));
+		}
+		void record_rebuild_checkpoint(sqlite::transaction& ts, const rebuild_state& state, const bool reembed)
+		{
+			sqlite::stmt upsert{ ts, R"(INSERT OR REPLACE INTO __REBUILD_CHECKPOINT__ (tablename, last_id, count, index_dimension, reembed) VALUES (?, ?, ?, ?, ?);)" };
+			upsert.bind(1, m_name);
+			upsert.bind(2, state.last_id);
+			upsert.bind(3, state.count);
+			upsert.bind(4, static_cast<int>(state.index->d));
+			upsert.bind(5, reembed ? 1 : 0);
+			upsert.step();
+		}
+		void throw_if_rebuilding() const
+		{
+			if (m_rebuilding)
+			{
+				throw exception::runtime_error(std::format("表{}的索引正在重建", m_name));
+			}
+		}
+		// 影子索引重建: reembed为true时重新生成向量, 否则从当前索引中取出仍存在的行的向量
+		// 每块只在读取与写入映射时短暂持有数据库锁, 向量生成与加入影子索引都不持有锁; 新索引的编号记录在映射表中
+		// 重建期间新插入的行已在当前索引中, 作为追赶缓冲在最后一次持有锁期间从当前索引补入影子索引, 随后改写编号并切换
+		// 重建期间被删除的行的向量留在新索引中, 由下一次重建去掉; 已有重建在进行时返回false
+		// transform有值时影子索引使用该降维变换(可以为空, 即不降维), 切换时一并替换当前的变换; 更换变换必须重新生成向量
+		// 追赶缓冲中的行此时需要重新生成向量, 大部分在切换前不持有锁时生成, 持有锁时只在调用线程上生成其后新插入的少量行
+		// 调用方不能持有数据库锁, 否则释放锁只退出一层递归, 重建期间会一直阻塞其他读写
+		bool online_rebuild(const bool reembed, const rebuild_options& options, const std::optional<std::shared_ptr<faiss::VectorTransform>>& transform = std::nullopt)
+		{
+			if (options.chunk_size < 1)
+			{
+				throw exception::invalid_argument("chunk_size不能小于1, 但实际值为: 0");
+			}
+			auto lock = m_database->lock();
+			const auto target = transform.value_or(m_transform);
+			const bool retransform = target != m_transform;
+			if (retransform && !reembed)
+			{
+				throw exception::invalid_argument("更换降维变换的重建必须重新生成向量");
+			}
+			if (m_rebuilding)
+			{
+				return false;
+			}
+			m_rebuilding = true;
+			struct rebuilding_guard
+			{
+				table& self;
+				~rebuilding_guard()
+				{
+					auto lock = self.m_database->lock();
+					self.m_rebuilding = false;
+					self.m_rebuild_finished.notify_all();
+				}
+			} guard{ *this };
+
+			std::optional<rebuild_state> state;
+			{
+				sqlite::transaction ts(m_db, sqlite::IMMEDIATE);
+				if (options.resume)
+				{
+					state = load_rebuild_checkpoint(reembed, target.get());
+				}
+				if (!state)
+				{
+					discard_rebuild_checkpoint(ts);
+					state.emplace(0, 0, make_faiss_index(target.get()), m_full_vectors ? make_full_vectors() : nullptr);
+					ts.execute(std::format("CREATE TABLE {}_rebuild_map (id INTEGER PRIMARY KEY, faiss_index_id INTEGER NOT NULL);", m_name));
+				}
+				commit(ts);
+			}
+			trace::span span("table::online_rebuild", "table");
+			span.arg("reembed", reembed ? 1 : 0);
+			span.arg("resume_from", state->count);
+
+			struct chunk
+			{
+				std::vector<std::uint64_t> ids;
+				std::vector<std::string> messages; // 需要重新生成向量时的消息
+				std::vector<float> full;           // 原始维度: 重新生成的向量, 或从原始向量存储中取出
+				std::vector<float> index_vectors;  // 索引维度: 从当前索引中取出时使用
+				std::atomic<bool> claimed{ false }; // 线程池任务与调用线程中先取得者生成向量
+				std::future<void> embedded;
+			};
+			// 读取id之后的至多limit行(为负时不限), embed为true时只读取消息, 向量由embed_async/embed_wait生成; 调用方需持有数据库锁
+			auto read_chunk = [&](const std::uint64_t after, const std::int64_t limit, const bool embed) -> std::shared_ptr<chunk>
+				{
+					auto c = std::make_shared<chunk>();
+					if (embed)
+					{
+						m_select_main_id_message.reset();
+						m_select_main_id_message.bind(1, after);
+						m_select_main_id_message.bind(2, limit);
+						while (m_select_main_id_message.step() == SQLITE_ROW)
+						{
+							c->ids.emplace_back(m_select_main_id_message.get_column_uint64(0));
+							c->messages.emplace_back(m_select_main_id_message.get_column_str(1));
+						}
+						return c->ids.empty() ? nullptr : c;
+					}
+					const auto d = static_cast<std::size_t>(m_faiss_index->d);
+					const auto full_d = static_cast<std::size_t>(m_vector_dimension);
+					m_select_main_id_faiss_index_after.reset();
+					m_select_main_id_faiss_index_after.bind(1, after);
+					m_select_main_id_faiss_index_after.bind(2, limit);
+					while (m_select_main_id_faiss_index_after.step() == SQLITE_ROW)
+					{
+						const auto i = c->ids.size();
+						c->ids.emplace_back(m_select_main_id_faiss_index_after.get_column_uint64(0));
+						const auto faiss_id = static_cast<faiss::idx_t>(m_select_main_id_faiss_index_after.get_column_uint64(1));
+						c->index_vectors.resize((i + 1) * d);
+						m_faiss_index->reconstruct(faiss_id, c->index_vectors.data() + i * d);
+						if (m_full_vectors)
+						{
+							c->full.resize((i + 1) * full_d);
+							m_full_vectors->reconstruct(faiss_id, c->full.data() + i * full_d);
+						}
+					}
+					return c->ids.empty() ? nullptr : c;
+				};
+			// 在线程池上提前生成向量, 调用方不能持有数据库锁; 线程池已满时不提交, 由embed_wait在调用线程生成
+			auto embed_async = [&](const std::shared_ptr<chunk>& c)
+				{
+					if (!c || c->messages.empty())
+					{
+						return;
+					}
+					c->embedded = m_database->m_thread_pool.try_enqueue([this, c]
+						{
+							if (!c->claimed.exchange(true))
+							{
+								c->full = string_generate_vectors(c->messages);
+							}
+						}, thread_pool::priority::background);
+				};
+			// 线程池任务尚未开始时由调用线程生成, 不会因工作线程都在等待数据库锁而一直等待
+			auto embed_wait = [&](chunk& c)
+				{
+					if (c.messages.empty())
+					{
+						return;
+					}
+					if (!c.claimed.exchange(true))
+					{
+						c.full = string_generate_vectors(c.messages);
+					}
+					else
+					{
+						c.embedded.get();
+					}
+				};
+			auto add_chunk = [&](chunk& c)
+				{
+					const auto n = static_cast<faiss::idx_t>(c.ids.size());
+					if (c.index_vectors.empty())
+					{
+						std::vector<float> reduced;
+						state->index->add(n, project(target.get(), n, c.full.data(), reduced));
+					}
+					else
+					{
+						state->index->add(n, c.index_vectors.data());
+					}
+					if (state->full_vectors)
+					{
+						state->full_vectors->add(n, c.full.data());
+					}
+				};
+			auto write_map = [&](sqlite::transaction& ts, const chunk& c)
+				{
+					sqlite::stmt insert_map{ ts, std::format("INSERT OR REPLACE INTO {}_rebuild_map (id, faiss_index_id) VALUES (?, ?);", m_name) };
+					for (const auto id : c.ids)
+					{
+						insert_map.reset();
+						insert_map.bind(1, id);
+						insert_map.bind(2, state->count++);
+						insert_map.step();
+					}
+					state->last_id = c.ids.back();
+				};
+
+			const auto limit = static_cast<std::int64_t>(options.chunk_size);
+			std::shared_ptr<chunk> next = read_chunk(state->last_id, limit, reembed);
+			lock.unlock();
+			try
+			{
+				embed_async(next);
+				std::size_t chunks = 0;
+				while (next)
+				{
+					auto current = std::move(next);
+					if (current->ids.size() == options.chunk_size)
+					{
+						lock.lock();
+						next = read_chunk(current->ids.back(), limit, reembed);
+						lock.unlock();
+						embed_async(next);
+					}
+					embed_wait(*current);
+					add_chunk(*current);
+					const bool checkpoint = options.checkpoint_chunks != 0 && ++chunks % options.checkpoint_chunks == 0 && next;
+					if (checkpoint)
+					{
+						// 写文件时当前块的映射尚未提交, 提交后记录与文件一致
+						write_rebuild_files(*state);
+					}
+					lock.lock();
+					sqlite::transaction ts(m_db, sqlite::IMMEDIATE);
+					write_map(ts, *current);
+					if (checkpoint)
+					{
+						record_rebuild_checkpoint(ts, *state, reembed);
+					}
+					commit(ts);
+					lock.unlock();
+				}
+
+				// 更换变换时追赶缓冲需要重新生成向量: 先不持有锁补入最后一块期间插入的行, 切换时只剩其后新插入的少量行
+				if (retransform)
+				{
+					lock.lock();
+					auto rest = read_chunk(state->last_id, -1, true);
+					lock.unlock();
+					if (rest)
+					{
+						embed_wait(*rest);
+						add_chunk(*rest);
+						lock.lock();
+						sqlite::transaction ts(m_db, sqlite::IMMEDIATE);
+						write_map(ts, *rest);
+						commit(ts);
+						lock.unlock();
+					}
+				}
+
+				// 切换: 持有锁期间没有新的插入; 需要生成向量的行在调用线程上生成, 不经过线程池
+				lock.lock();
+				trace::span cutover_span("table::online_rebuild::cutover", "table");
+				sqlite::transaction ts(m_db, sqlite::IMMEDIATE);
+				if (auto rest = read_chunk(state->last_id, -1, retransform))
+				{
+					cutover_span.arg("catch_up", rest->ids.size());
+					embed_wait(*rest);
+					add_chunk(*rest);
+					write_map(ts, *rest);
+				}
+				// 已被删除的行的映射被忽略
+				ts.execute(std::format(R"(
+					UPDATE {0} SET faiss_index_id = (SELECT m.faiss_index_id FROM {0}_rebuild_map AS m WHERE m.id = {0}.id)
+					WHERE id IN (SELECT id FROM {0}_rebuild_map);
+				)", m_name));
+				discard_rebuild_checkpoint(ts);
+				state->index->hnsw.efSearch = m_faiss_index->hnsw.efSearch;
+				m_faiss_index = state->index;
+				m_full_vectors = state->full_vectors;
+				m_transform = target;
+				m_faiss_index_new_id = state->count;
+				commit(ts);
+			}
+			catch (...)
+			{
+				// 已开始的向量生成任务引用了本表, 等待它结束; 尚未开始的由此取消
+				if (next && next->claimed.exchange(true) && next->embedded.valid())
+				{
+					next->embedded.wait();
+				}
+				throw;
+			}
+			save_faiss_index();
+			return true;
+		}
+		// 检查点与当前的维度、度量、原始向量设置及文件内容都一致时才继续, 否则返回空
+		std::optional<rebuild_state> load_rebuild_checkpoint(const bool reembed, const faiss::VectorTransform* transform)
+		{
+			sqlite::stmt select_checkpoint{ m_db, R"(SELECT last_id, count, index_dimension, reembed FROM __REBUILD_CHECKPOINT__ WHERE tablename = ?;)" };
+			select_checkpoint.bind(1, m_name);
+			if (select_checkpoint.step() != SQLITE_ROW)
+			{
+				return {};
+			}
+			rebuild_state state;
+			state.last_id = select_checkpoint.get_column_uint64(0);
+			state.count = select_checkpoint.get_column_uint64(1);
+			const auto dimension = transform ? transform->d_out : m_vector_dimension;
+			const auto path = rebuild_path();
+			if (select_checkpoint.get_column_int(2) != dimension || (select_checkpoint.get_column_int(3) != 0) != reembed || !fs::exists(path)
+				|| fs::exists(full_vectors_path(path)) != (m_full_vectors != nullptr))
+			{
+				return {};
+			}
+			state.index.reset(dynamic_cast<f::faiss_index*>(faiss::read_index(path.string().c_str())));
+			const auto expected = m_metric == metric::l2 ? faiss::METRIC_L2 : faiss::METRIC_INNER_PRODUCT;
+			if (!state.index || state.index->d != dimension || state.index->metric_type != expected
+				|| static_cast<std::uint64_t>(state.index->ntotal) != state.count)
+			{
+				return {};
+			}
+			if (m_full_vectors)
+			{
+				state.full_vectors.reset(dynamic_cast<faiss::IndexFlat*>(faiss::read_index(full_vectors_path(path).string().c_str())));
+				if (!state.full_vectors || state.full_vectors->d != m_vector_dimension
+					|| static_cast<std::uint64_t>(state.full_vectors->ntotal) != state.count)
+				{
+					return {};
+				}
+			}
+			return state;
+		}
+		void discard_rebuild_checkpoint(sqlite::transaction& ts)
+		{
+			ts.execute(std::format("DROP TABLE IF EXISTS {}_rebuild_map;", m_name));
+			sqlite::stmt delete_checkpoint{ ts, "DELETE FROM __REBUILD_CHECKPOINT__ WHERE tablename = ?;", SQLITE_PREPARE_NO_VTAB };
+			delete_checkpoint.bind(1, m_name);
+			delete_checkpoint.step();
+			fs::remove(rebuild_path());
+			fs::remove(full_vectors_path(rebuild_path()));
+		}
+		struct index_snapshot
+		{
+			std::size_t new_id = 0;
+			std::vector<std::uint8_t> index;
+			std::vector<std::uint8_t> transform;    // 未降维时为空
+			std::vector<std::uint8_t> full_vectors; // 未保存原始向量时为空
+		};
+		// 把索引序列化到内存, 调用方需持有数据库锁; 写文件在释放锁之后进行
+		index_snapshot snapshot_faiss_index() const
+		{
+			index_snapshot res;
+			res.new_id = m_faiss_index_new_id;
+			faiss::VectorIOWriter index;
+			faiss::write_index(m_faiss_index.get(), &index);
+			res.index = std::move(index.data);
+			if (m_transform)
+			{
+				faiss::VectorIOWriter transform;
+				faiss::write_VectorTransform(m_transform.get(), &transform);
+				res.transform = std::move(transform.data);
+			}
+			if (m_full_vectors)
+			{
+				faiss::VectorIOWriter full_vectors;
+				faiss::write_index(m_full_vectors.get(), &full_vectors);
+				res.full_vectors = std::move(full_vectors.data);
+			}
+			return res;
+		}
+		struct index_rows
+		{
+			std::vector<std::size_t> ids;
+			std::vector<float> index_vectors; // 索引维度
+			std::vector<float> full_vectors;  // 原始维度, 仅在保存了原始向量时读取
+		};
+		// 按主表中仍存在的行读出索引中的向量, 调用方需持有数据库锁
+		index_rows read_index_rows()
+		{
+			index_rows rows;
+			m_select_main_count.reset();
+			m_select_main_count.step();
+			const auto count = m_select_main_count.get_column_uint64(0);
+			const auto d = static_cast<std::size_t>(m_faiss_index->d);
+			const auto full_d = static_cast<std::size_t>(m_vector_dimension);
+			rows.ids.reserve(count);
+			rows.index_vectors.resize(count * d);
+			if (m_full_vectors)
+				rows.full_vectors.resize(count * full_d);
+			m_select_main_id_faiss_index.reset();
+			while (m_select_main_id_faiss_index.step() == SQLITE_ROW)
+			{
+				const auto i = rows.ids.size();
+				if (i == count)
+					break;
+				auto main_id = m_select_main_id_faiss_index.get_column_uint64(0);
+				auto faiss_id = m_select_main_id_faiss_index.get_column_uint64(1);
+				m_faiss_index->reconstruct(faiss_id, rows.index_vectors.data() + i * d);
+				if (m_full_vectors)
+					m_full_vectors->reconstruct(faiss_id, rows.full_vectors.data() + i * full_d);
+				rows.ids.emplace_back(main_id);
+			}
+			rows.index_vectors.resize(rows.ids.size() * d);
+			if (m_full_vectors)
+				rows.full_vectors.resize(rows.ids.size() * full_d);
+			return rows;
+		}
+		// 用给定的向量重建索引, 并把主表的faiss_index改为新的连续编号
+		// index_vectors为当前变换下的索引维度, full_vectors为原始维度, 为空时不保存原始向量
+		void replace_faiss_index(const std::vector<std::size_t>& ids, const float* index_vectors, const float* full_vectors)
+		{
+			const auto n = static_cast<faiss::idx_t>(ids.size());
+			auto new_faiss_index = make_faiss_index();
+			new_faiss_index->add(n, index_vectors);
+			std::shared_ptr<faiss::IndexFlat> new_full_vectors;
+			if (full_vectors)
+			{
+				new_full_vectors = std::make_shared<faiss::IndexFlat>(m_vector_dimension,
+					m_metric == metric::l2 ? faiss::METRIC_L2 : faiss::METRIC_INNER_PRODUCT);
+				new_full_vectors->add(n, full_vectors);
+			}
+			m_faiss_index_new_id = 0;
+			for (const auto& i : ids)
+			{
+				m_update_main_id_to_faiss_index.reset();
+				m_update_main_id_to_faiss_index.bind(1, m_faiss_index_new_id++);
+				m_update_main_id_to_faiss_index.bind(2, i);
+				m_update_main_id_to_faiss_index.step();
+			}
+			m_faiss_index = new_faiss_index;
+			m_full_vectors = new_full_vectors;
+		}
+		// 按搜索结果的顺序回表, 跳过无效下标与已删除的行
+		std::vector<select_vector_data> hydrate_indices(const std::vector<faiss::idx_t>& indices, const std::vector<float>& distances)
+		{
+			stats::scoped_timer timer(m_stats, stats::stage::hydrate);
+			trace::span stage_span("stage::hydrate", "stage");
+			std::vector<select_vector_data> res;
+			res.reserve(indices.size());
+			for (std::size_t i = 0; i < indices.size(); i++)
+			{
+				if (indices[i] < 0)
+				{
+					continue;
+				}
+				auto row = hydrate_faiss_index_id(indices[i], distances[i]);
+				if (!row.has_value())
+				{
+					m_stats.add(stats::counter::hydrate_misses);
+					continue;
+				}
+				res.emplace_back(std::move(*row));
+			}
+			m_stats.add(stats::counter::hits, res.size());
+			return res;
+		}
+		// 调用方需持有数据库锁并开启事务, 返回新行的id
+		std::int64_t insert_main_data(const insert_data& data, const std::int64_t content_hash)
+		{
+			m_insert_fts_data.reset();
+			m_insert_main_data.reset();
+			m_insert_main_data.bind(6, m_faiss_index_new_id++);
+			m_insert_main_data.bind(1, data.time);
+			if (data.sender.empty()) { m_insert_main_data.bind(2, ""); }
+			else { m_insert_main_data.bind(2, data.sender); }
+			m_insert_main_data.bind(3, data.sender_uuid);
+			m_insert_main_data.bind(4, data.message);
+			m_insert_main_data.bind(5, data.forget_probability);
+			m_insert_main_data.bind(7, content_hash);
+			m_insert_main_data.step();
+			const auto id = m_db->last_insert_rowid();
+			m_insert_fts_data.bind(1, id);
+			m_insert_fts_data.bind(2, data.message);
+			m_insert_fts_data.step();
+			m_stats.add(stats::counter::rows_inserted);
+			return id;
+		}
+		// 哈希相同时再比较规范化内容, 排除哈希碰撞; 有多行时取最新的一行
+		std::optional<std::int64_t> find_exact_duplicate(const dedup_options& dedup, const insert_data& data, const std::string& normalized, const std::int64_t hash)
+		{
+			m_select_main_content_hash.reset();
+			m_select_main_content_hash.bind(1, hash);
+			while (m_select_main_content_hash.step() == SQLITE_ROW)
+			{
+				if (dedup.same_sender && data.sender_uuid != m_select_main_content_hash.get_column_str(2))
+				{
+					continue;
+				}
+				if (normalize_message(m_select_main_content_hash.get_column_str(1)) == normalized)
+				{
+					return m_select_main_content_hash.get_column_int64(0);
+				}
+			}
+			return {};
+		}
+		// 把已生成向量的若干块在一个事务内写入, 向量拼接后一次加入索引
+		template <class Chunk>
+		void write_import_batch(const std::vector<std::shared_ptr<Chunk>>& batch, const std::size_t rows)
+		{
+			std::vector<std::int64_t> hashes;
+			hashes.reserve(rows);
+			for (const auto& c : batch)
+			{
+				for (const auto& data : c->rows)
+				{
+					hashes.emplace_back(message_hash(normalize_message(data.message)));
+				}
+			}
+			std::vector<float> joined;
+			const float* vectors = batch.front()->vectors.data();
+			if (batch.size() > 1)
+			{
+				joined.reserve(rows * m_vector_dimension);
+				for (const auto& c : batch)
+				{
+					joined.insert(joined.end(), c->vectors.begin(), c->vectors.end());
+				}
+				vectors = joined.data();
+			}
+
+			auto lock = m_database->lock();
+			sqlite::transaction ts(m_db, sqlite::IMMEDIATE);
+			index_add(rows, vectors);
+			std::size_t i = 0;
+			for (const auto& c : batch)
+			{
+				for (const auto& data : c->rows)
+				{
+					insert_main_data(data, hashes[i++]);
+				}
+			}
+			commit(ts);
+		}
+		// FTS5的automerge配置, 没有设置过时为默认值4
+		int fts_automerge()
+		{
+			auto lock = m_database->lock();
+			sqlite::stmt select_automerge{ m_db, std::format("SELECT v FROM {}_fts_config WHERE k = 'automerge';", m_name) };
+			if (select_automerge.step() != SQLITE_ROW)
+			{
+				return 4;
+			}
+			return select_automerge.get_column_int(0);
+		}
+		void set_fts_automerge(const int automerge)
+		{
+			auto lock = m_database->lock();
+			m_db->execute(std::format("INSERT INTO {0}_fts({0}_fts, rank) VALUES('automerge', {1});", m_name, automerge));
+		}
+		// 行所在的schema以只读方式附加, 例如已封存的分区
+		bool read_only()
+		{
+			auto lock = m_database->lock();
+			return m_db->readonly(m_schema);
+		}
+		// FTS5增量合并, 最多写入pages页; sqlite3_total_changes的差值不小于2时说明合并了段
+		bool merge_fts(const int pages)
+		{
+			auto lock = m_database->lock();
+			const auto before = m_db->total_changes();
+			m_db->execute(std::format("INSERT INTO {0}_fts({0}_fts, rank) VALUES('merge', {1});", m_name, pages));
+			return m_db->total_changes() - before >= 2;
+		}
+		std::optional<std::int64_t> find_near_duplicate(const dedup_options& dedup, const insert_data& data, const float* vector)
+		{
+			if (dedup.near_distance <= 0.0f || m_faiss_index->ntotal == 0)
+			{
+				return {};
+			}
+			faiss::idx_t index = -1;
+			float distance = 0.0f;
+			faiss_search(1, vector, 1, &distance, &index);
+			if (index < 0 || distance > dedup.near_distance)
+			{
+				return {};
+			}
+			auto row = hydrate_faiss_index_id(index, distance);
+			if (!row.has_value() || (dedup.same_sender && row->sender_uuid != data.sender_uuid))
+			{
+				return {};
+			}
+			return static_cast<std::int64_t>(row->id);
+		}
+		void merge_duplicate(const dedup_options& dedup, const std::int64_t id, const std::size_t time)
+		{
+			m_stats.add(stats::counter::duplicates_merged);
+			m_update_main_duplicate.reset();
+			m_update_main_duplicate.bind(1, dedup.refresh_time ? time : std::size_t{ 0 }); // max(timestamp, 0)即保持原时间
+			m_update_main_duplicate.bind(2, id);
+			m_update_main_duplicate.step();
+		}
+		bool merge_exact_duplicate(const dedup_options& dedup, const insert_data& data, const std::string& normalized, const std::int64_t hash)
+		{
+			auto id = find_exact_duplicate(dedup, data, normalized, hash);
+			if (id.has_value())
+			{
+				merge_duplicate(dedup, *id, data.time);
+			}
+			return id.has_value();
+		}
+		bool merge_near_duplicate(const dedup_options& dedup, const insert_data& data, const float* vector)
+		{
+			auto id = find_near_duplicate(dedup, data, vector);
+			if (id.has_value())
+			{
+				merge_duplicate(dedup, *id, data.time);
+			}
+			return id.has_value();
+		}
+		// 按faiss_index_id回表查询一行, 行已被删除时返回空
+		std::optional<select_vector_data> hydrate_faiss_index_id(const faiss::idx_t faiss_index_id, const double distance)
+		{
+			m_select_main_faiss_index_id.reset();
+			m_select_main_faiss_index_id.bind(1, faiss_index_id);
+			if (m_select_main_faiss_index_id.step() != SQLITE_ROW)
+			{
+				return {};
+			}
+			return { select_vector_data{
+				m_select_main_faiss_index_id.get_column_uint64(0),
+				m_select_main_faiss_index_id.get_column_uint64(1),
+				m_select_main_faiss_index_id.get_column_str(2),
+				m_select_main_faiss_index_id.get_column_str(3),
+				m_select_main_faiss_index_id.get_column_str(4),
+				distance } };
+		}
+		// 返回datas.size() * m_vector_dimension个float
+		// 只设置了单条回调时, 在数据库的线程池上并发调用, 并发数由set_embedding_parallelism控制
+		// 回调在调用时才获取GIL(ENABLE_GET_GIL_BEFORE_CALL), 回调内部释放GIL的IO可以重叠
+		std::vector<float> string_generate_vectors(const std::vector<std::string>& datas)
+		{
+			stats::scoped_timer timer(m_stats, stats::stage::embed);
+			trace::span stage_span("stage::embed", "stage");
+			m_stats.add(stats::counter::embed_texts, datas.size());
+			const auto size = datas.size() * m_vector_dimension;
+			if (this->m_generate_vectors_callback)
+			{
+				auto vector = m_generate_vectors_callback(datas);
+				if (vector.size() != size)
+				{
+					throw exception::invalid_argument(std::format("批量向量回调返回了{}个float, 期望{}个({}条 x {}维)",
+						vector.size(), size, datas.size(), m_vector_dimension));
+				}
+				if (m_metric == metric::cosine)
+				{
+					simd::normalize_batch(vector.data(), datas.size(), m_vector_dimension);
+				}
+				return vector;
+			}
+
+			std::vector<float> vector(size);
+			thread_pool::parallel_for(m_database->m_thread_pool, datas.size(), [&](const std::size_t i)
+				{
+					const auto res = this->m_generate_vector_callback(datas[i]);
+					if (res.size() != static_cast<std::size_t>(m_vector_dimension))
+					{
+						throw exception::invalid_argument(std::format("向量回调返回的维度为{}, 与表的向量维度{}不一致",
+							res.size(), m_vector_dimension));
+					}
+					std::copy(res.begin(), res.end(), vector.begin() + i * m_vector_dimension);
+					if (m_metric == metric::cosine)
+					{
+						simd::normalize(vector.data() + i * m_vector_dimension, m_vector_dimension);
+					}
+				}, py::holds_gil() ? 1 : m_embedding_parallelism.load(std::memory_order_relaxed));
+			return vector;
+		}
+		void try_create_table(sqlite::transaction& ts, const fts_storage fts)
+		{
+			ts.execute(std::format(R"(
+				CREATE TABLE IF NOT EXISTS {}.{} (
+				id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
+				timestamp INTEGER NOT NULL,
+				sender TEXT,
+				sender_uuid TEXT NOT NULL,
+				message TEXT NOT NULL,
+				forget_probability REAL NOT NULL DEFAULT 0.0 CHECK (forget_probability >= 0.0 AND forget_probability <= 1.0),
+				faiss_index_id INTEGER NOT NULL,
+				content_hash INTEGER,
+				duplicate_count INTEGER NOT NULL DEFAULT 1);
+			)", m_schema, m_name));
+			ts.execute(std::format("CREATE VIRTUAL TABLE IF NOT EXISTS {}.{}_fts USING {};", m_schema, m_name, fts_definition(fts)));
+		}
+		std::string fts_definition(const fts_storage fts) const
+		{
+			if (fts == fts_storage::external_content)
+			{
+				return std::format("fts5(message, content = '{}', content_rowid = 'id', tokenize = 'simple')", m_name);
+			}
+			return "fts5(message, tokenize = 'simple')";
+		}
+		// 以建表语句为准, 不另外记录
+		fts_storage read_fts_storage(sqlite::transaction& ts)
+		{
+			sqlite::stmt select_sql{ ts, std::format("SELECT sql FROM {}.sqlite_master WHERE type = 'table' AND name = ?;", m_schema), SQLITE_PREPARE_NO_VTAB };
+			select_sql.bind(1, std::format("{}_fts", m_name));
+			if (select_sql.step() != SQLITE_ROW)
+			{
+				throw exception::bad_database(std::format("表{}缺少全文索引{}_fts", m_name, m_name));
+			}
+			const std::string_view sql = select_sql.get_column_str(0);
+			return sql.find("content_rowid") != std::string_view::npos ? fts_storage::external_content : fts_storage::internal;
+		}
+		// 旧版本创建的表缺少去重所需的列, 补齐列并为已有行计算内容哈希
+		void migrate_table(sqlite::transaction& ts)
+		{
+			sqlite::stmt table_info{ ts, std::format("PRAGMA table_info({});", m_name) };
+			bool has_content_hash = false;
+			bool has_duplicate_count = false;
+			while (table_info.step() == SQLITE_ROW)
+			{
+				const std::string_view column = table_info.get_column_str(1);
+				has_content_hash = has_content_hash || column == "content_hash";
+				has_duplicate_count = has_duplicate_count || column == "duplicate_count";
+			}
+			if (!has_duplicate_count)
+			{
+				ts.execute(std::format("ALTER TABLE {} ADD COLUMN duplicate_count INTEGER NOT NULL DEFAULT 1;", m_name));
+			}
+			if (!has_content_hash)
+			{
+				ts.execute(std::format("ALTER TABLE {} ADD COLUMN content_hash INTEGER;", m_name));
+
+				std::vector<std::pair<std::int64_t, std::int64_t>> hashes;
+				sqlite::stmt select_message{ ts, std::format("SELECT id, message FROM {};", m_name) };
+				while (select_message.step() == SQLITE_ROW)
+				{
+					hashes.emplace_back(select_message.get_column_int64(0), message_hash(normalize_message(select_message.get_column_str(1))));
+				}
+				sqlite::stmt update_hash{ ts, std::format("UPDATE {} SET content_hash = ? WHERE id = ?;", m_name) };
+				for (const auto& [id, hash] : hashes)
+				{
+					update_hash.reset();
+					update_hash.bind(1, hash);
+					update_hash.bind(2, id);
+					update_hash.step();
+				}
+			}
+			ts.execute(std::format("CREATE INDEX IF NOT EXISTS {0}.{1}_content_hash ON {1} (content_hash);", m_schema, m_name));
+		}
+		void load_faiss_index()
+		{
+			if (fs::exists(m_faiss_fullpath))
+			{
+				auto faiss_index = faiss::read_index(m_faiss_fullpath.string().c_str());
+				std::shared_ptr<f::faiss_index> index_HNSW(dynamic_cast<f::faiss_index*>(faiss_index));
+				if (index_HNSW == nullptr)
+					throw exception::runtime_error();
+				const auto expected = m_metric == metric::l2 ? faiss::METRIC_L2 : faiss::METRIC_INNER_PRODUCT;
+				if (index_HNSW->metric_type != expected)
+				{
+					throw exception::runtime_error(std::format("FAISS索引文件{}的距离度量与表{}的度量{}不一致",
+						m_faiss_fullpath.string(), m_name, metric_name(m_metric)));
+				}
+				m_faiss_index = index_HNSW;
+				if (fs::exists(transform_path()))
+				{
+					std::shared_ptr<faiss::VectorTransform> transform(faiss::read_VectorTransform(transform_path().string().c_str()));
+					if (transform->d_in != m_vector_dimension || transform->d_out != m_faiss_index->d)
+					{
+						throw exception::runtime_error(std::format("降维文件{}的维度{}->{}与表{}不一致",
+							transform_path().string(), transform->d_in, transform->d_out, m_name));
+					}
+					m_transform = transform;
+				}
+				else if (m_faiss_index->d != m_vector_dimension)
+				{
+					throw exception::runtime_error(std::format("FAISS索引文件{}的维度{}与表{}的维度{}不一致",
+						m_faiss_fullpath.string(), m_faiss_index->d, m_name, m_vector_dimension));
+				}
+				if (fs::exists(full_vectors_path()))
+				{
+					std::shared_ptr<faiss::IndexFlat> full_vectors(dynamic_cast<faiss::IndexFlat*>(faiss::read_index(full_vectors_path().string().c_str())));
+					if (full_vectors == nullptr || full_vectors->d != m_vector_dimension || full_vectors->ntotal != m_faiss_index->ntotal)
+					{
+						throw exception::runtime_error(std::format("原始向量文件{}与表{}的索引不一致", full_vectors_path().string(), m_name));
+					}
+					m_full_vectors = full_vectors;
+				}
+			}
+			else
+			{
+				m_faiss_index = make_faiss_index();
+				m_faiss_index_new_id = 0;
+			}
+		}
+		void init(sqlite::transaction& ts, std::shared_ptr<memory::database>& db, const std::string& name, const int vector_dimension, const int HNWS_max_connect, const metric distance_metric)
+		{
+			sqlite::stmt where_table{ ts, R"(
+				SELECT COUNT(*) FROM __TABLE_MANAGE__ WHERE tablename = ?;
+			)" };
+			where_table.bind(1, name);
+			where_table.step();
+			if (where_table.get_column_int(0))
+			{
+				sqlite::stmt get_table_info{ ts, R"(
+					SELECT vector_dimension, faiss_fullpath, HNWS_max_connect, faiss_new_id, metric FROM __TABLE_MANAGE__ WHERE tablename = ?;
+				)" };
+				get_table_info.bind(1, name);
+				get_table_info.step();
+				m_faiss_index_new_id = get_table_info.get_column_uint64(3);
+				m_HNSW_max_connect = get_table_info.get_column_int(2);
+				m_faiss_fullpath = db->resolve_path((const char*)(get_table_info.get_column_str(1)));
+				m_vector_dimension = get_table_info.get_column_int(0);
+				m_metric = parse_metric(get_table_info.get_column_str(4));
+			}
+			else
+			{
+				m_faiss_fullpath = db->db_file_path().parent_path() / db->db_file_path().stem() / std::format("{}.faiss", m_name);
+				m_vector_dimension = vector_dimension;
+				m_HNSW_max_connect = HNWS_max_connect;
+				m_metric = distance_metric;
+				sqlite::stmt insert_table_info{ ts, R"(
+					INSERT INTO __TABLE_MANAGE__ (tablename, vector_dimension, faiss_fullpath, HNWS_max_connect, faiss_new_id, metric) VALUES (?, ?, ?, ?, ?, ?);
+				)" };
+				insert_table_info.bind(1, m_name);
+				insert_table_info.bind(2, m_vector_dimension);
+				insert_table_info.bind(3, m_faiss_fullpath.string().c_str());
+				insert_table_info.bind(4, m_HNSW_max_connect);
+				insert_table_info.bind(5, m_faiss_index_new_id);
+				insert_table_info.bind(6, metric_name(m_metric));
+				insert_table_info.step();
+			}
+		}
+		// 全文索引的写入语句随存储方式不同: 外部内容的删除需要用'delete'命令并提供原消息
+		void prepare_fts_stmt()
+		{
+			m_insert_fts_data = sqlite::stmt(m_db, std::format(R"(INSERT INTO {}_fts (rowid, message) VALUES (?, ?);)", m_name), SQLITE_PREPARE_PERSISTENT);
+			if (m_fts_storage == fts_storage::external_content)
+			{
+				m_del_fts_id = sqlite::stmt(m_db, std::format(R"(INSERT INTO {0}_fts ({0}_fts, rowid, message) SELECT 'delete', id, message FROM {0} WHERE id = ?;)", m_name), SQLITE_PREPARE_PERSISTENT);
+			}
+			else
+			{
+				m_del_fts_id = sqlite::stmt(m_db, std::format(R"(DELETE FROM {}_fts WHERE rowid = ?;)", m_name), SQLITE_PREPARE_PERSISTENT);
+			}
+		}
+		void init_stmt()
+		{
+			m_insert_main_data = sqlite::stmt(m_db, std::format(R"(INSERT INTO {} 
+			(timestamp, sender, sender_uuid, message, forget_probability, faiss_index_id, content_hash) 
+			VALUES (?, ?, ?, ?, ?, ?, ?);)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+
+			m_select_main_data_id = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid, message FROM {} WHERE id = ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+			m_select_main_faiss_index_id = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid, message FROM {} WHERE faiss_index_id = ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+
+			m_select_main_sender_uuid = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid, message FROM {} WHERE sender_uuid = ? ORDER BY id DESC;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+			m_select_main_sender_uuid_limit = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid, message FROM {} WHERE sender_uuid = ? ORDER BY id DESC LIMIT ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+
+			m_select_main_data_id_no_message = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid FROM {} WHERE id = ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+
+			m_select_main_data_time_start = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid, message FROM {} WHERE timestamp >= ? ORDER BY timestamp DESC;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+			m_select_main_data_time_end = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid, message FROM {} WHERE timestamp <= ? ORDER BY timestamp DESC;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+			m_select_main_data_time_start_end = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid, message FROM {} WHERE timestamp >= ? AND timestamp <= ? ORDER BY timestamp DESC;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+
+			m_select_main_count = sqlite::stmt(m_db, std::format(R"(SELECT count(*) FROM {};)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+
+			m_select_main_id_forget_probability = sqlite::stmt(m_db, std::format(R"(SELECT id, forget_probability FROM {};)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+			m_select_main_id_faiss_index = sqlite::stmt(m_db, std::format(R"(SELECT id, faiss_index_id FROM {};)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+			m_select_main_id_faiss_index_after = sqlite::stmt(m_db, std::format(R"(SELECT id, faiss_index_id FROM {} WHERE id > ? ORDER BY id LIMIT ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+			m_select_main_id_message = sqlite::stmt(m_db, std::format(R"(SELECT id, message FROM {} WHERE id > ? ORDER BY id LIMIT ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+
+			m_update_main_id_to_faiss_index = sqlite::stmt(m_db, std::format(R"(UPDATE {} SET faiss_index_id = ? WHERE id = ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+
+			m_select_main_content_hash = sqlite::stmt(m_db, std::format(R"(SELECT id, message, sender_uuid FROM {} WHERE content_hash = ? ORDER BY id DESC;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+			m_select_main_duplicate_count = sqlite::stmt(m_db, std::format(R"(SELECT duplicate_count FROM {} WHERE id = ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+			m_update_main_duplicate = sqlite::stmt(m_db, std::format(R"(UPDATE {} SET duplicate_count = duplicate_count + 1, timestamp = max(timestamp, ?) WHERE id = ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+
+			m_del_main_id = sqlite::stmt(m_db, std::format(R"(DELETE FROM {} WHERE id = ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
+			prepare_fts_stmt();
+		}
+	};
+
+	inline std::vector<select_table_vector_data> database::search_list_vector_text_tables(const std::vector<std::string>& table_names, std::string_view message, const faiss::idx_t k)
+	{
+		trace::span span("database::search_list_vector_text_tables", "database");
+		span.arg("tables", table_names.size());
+		if (table_names.empty())
+		{
+			throw exception::invalid_argument("table_names不能为空, 但实际为空");
+		}
+		ckeck_k(k);
+
+		// 只在查找时持有登记表的锁, 之后由shared_ptr保证表不被析构
+		// 生成向量会调用Python回调并获取GIL, 持有登记表的锁调用会与在GIL下析构表的线程互相等待
+		std::vector<std::shared_ptr<table>> pinned;
+		pinned.reserve(table_names.size());
+		{
+			std::lock_guard<std::mutex> tables_lock(m_tables_mutex);
+			for (const auto& name : table_names)
+			{
+				pinned.emplace_back(find_table(name));
+			}
+		}
+		std::vector<table*> tables;
+		tables.reserve(pinned.size());
+		for (const auto& t : pinned)
+		{
+			tables.emplace_back(t.get());
+		}
+		const int vector_dimension = tables.front()->m_vector_dimension;
+		for (const auto t : tables)
+		{
+			if (t->m_vector_dimension != vector_dimension)
+			{
+				throw exception::invalid_argument(std::format("表{}的向量维度为{}, 与表{}的向量维度{}不一致",
+					t->m_name, t->m_vector_dimension, tables.front()->m_name, vector_dimension));
+			}
+			if (t->m_metric != tables.front()->m_metric)
+			{
+				throw exception::invalid_argument(std::format("表{}的距离度量为{}, 与表{}的距离度量{}不一致",
+					t->m_name, metric_name(t->m_metric), tables.front()->m_name, metric_name(tables.front()->m_metric)));
+			}
+		}
+
+		// 查询文本只生成一次向量
+		const auto vector = tables.front()->generate_vector(std::string(message));
+		return search_vector_tables(tables, vector.data(), k);
+	}
+
+	inline std::shared_ptr<table> database::find_table(const std::string& name)
+	{
+		auto it = m_tables.find(name);
+		// 析构已开始的表仍在登记中, 直到析构函数取得m_tables_mutex注销为止, 此时weak_from_this为空
+		auto res = it == m_tables.end() ? nullptr : it->second->weak_from_this().lock();
+		if (!res)
+		{
+			throw exception::invalid_argument(std::format("表未打开或不存在: {}", name));
+		}
+		return res;
+	}
+
+	inline std::vector<select_table_vector_data> database::search_vector_tables(const std::vector<table*>& tables, const float* vector, const faiss::idx_t k)
+	{
+		struct search_result
+		{
+			std::vector<faiss::idx_t> indices;
+			std::vector<float> distances;
+		};
+		std::vector<search_result> results(tables.size());
+
+		// 调用线程持有数据库锁, 保证搜索期间没有写入修改索引; 工作线程只做FAISS搜索, 不访问数据库连接
+		auto lock = this->lock();
+		for (const auto t : tables)
+		{
+			if (!t->m_faiss_index)
+			{
+				throw exception::invalid_argument(std::format("表已被删除: {}", t->m_name));
+			}
+		}
+		{
+			stats::scoped_timer timer(m_stats, stats::stage::index_search);
+			trace::span stage_span("stage::index_search", "stage");
+			m_stats.add(stats::counter::searches);
+			thread_pool::parallel_for(m_thread_pool, tables.size(), [&](const std::size_t i)
+				{
+					auto& result = results[i];
+					result.indices.resize(k);
+					result.distances.resize(k);
+					tables[i]->faiss_search(1, vector, k, result.distances.data(), result.indices.data());
+				});
+		}
+
+		// 每个表的结果已按距离升序排列, 用小根堆做k路归并
+		struct cursor
+		{
+			float distance;
+			std::size_t table;
+			std::size_t pos;
+		};
+		auto greater = [](const cursor& a, const cursor& b) { return a.distance > b.distance; };
+		std::priority_queue<cursor, std::vector<cursor>, decltype(greater)> heap(greater);
+		for (std::size_t i = 0; i < results.size(); i++)
+		{
+			if (!results[i].indices.empty() && results[i].indices[0] >= 0)
+			{
+				heap.emplace(results[i].distances[0], i, 0);
+			}
+		}
+
+		// 同一数据库连接上的预编译语句不能并发使用, 回表统一在当前线程的一个事务中完成
+		// 只回表全局top-k命中的行, 已被删除的行跳过并由堆中的下一个候选补位
+		sqlite::transaction ts(m_db);
+		std::vector<select_table_vector_data> res;
+		res.reserve(k);
+		stats::scoped_timer timer(m_stats, stats::stage::hydrate);
+		trace::span stage_span("stage::hydrate", "stage");
+		while (!heap.empty() && res.size() < static_cast<std::size_t>(k))
+		{
+			auto top = heap.top();
+			heap.pop();
+			auto& result = results[top.table];
+			auto row = tables[top.table]->hydrate_faiss_index_id(result.indices[top.pos], top.distance);
+			if (row.has_value())
+			{
+				res.emplace_back(tables[top.table]->m_name,
+					row->id,
+					row->time,
+					std::move(row->sender),
+					std::move(row->sender_uuid),
+					std::move(row->message),
+					row->distance);
+			}
+			else
+			{
+				m_stats.add(stats::counter::hydrate_misses);
+			}
+			if (top.pos + 1 < result.indices.size() && result.indices[top.pos + 1] >= 0)
+			{
+				heap.emplace(result.distances[top.pos + 1], top.table, top.pos + 1);
+			}
+		}
+		ts.commit();
+		m_stats.add(stats::counter::hits, res.size());
 
-			std::vector<select_vector_data> res;
-			res.reserve(indices.size());
-			for (std::size_t i = 0; i < indices.size(); i++)
+		return res;
+	}
+
+	inline backup_report database::backup(const fs::path& directory, const backup_options& options)
+	{
+		trace::span span("database::backup", "database");
+		span.arg("directory", directory.string());
+		if (options.pages_per_step == 0)
+		{
+			throw exception::invalid_argument("pages_per_step不能为0");
+		}
+		const auto start = std::chrono::steady_clock::now();
+		backup_report res;
+		const auto db_file = directory / m_db_file_path.filename();
+		const auto faiss_directory = directory / m_db_file_path.stem();
+		if (fs::exists(db_file))
+		{
+			throw exception::invalid_argument(std::format("备份目标已存在: {}", db_file.string()));
+		}
+		fs::create_directories(faiss_directory);
+		res.db_file = db_file.string();
+
+		auto destination = std::make_shared<sqlite::database>(db_file.string());
+		std::optional<sqlite::backup> copy;
+		{
+			auto lock = this->lock();
+			copy.emplace(*destination, *m_db);
+		}
+		// 增量复制, 每步之间释放数据库锁; 期间通过本连接的写入会同步到备份中
+		while (true)
+		{
 			{
-				if (indices[i] < 0)
+				auto lock = this->lock();
+				res.steps++;
+				if (copy->step(options.pages_per_step))
 				{
-					continue;
+					break;
 				}
-				m_select_main_faiss_index_id.reset();
-				m_select_main_faiss_index_id.bind(1, indices[i]);
-				if (m_select_main_faiss_index_id.step() != SQLITE_ROW)
+				// 只剩少量页时, 最后一步与索引快照一起完成
+				if (options.pages_per_step > 0 && copy->remaining() <= options.pages_per_step)
 				{
-					continue;
+					break;
 				}
-				res.emplace_back(
-					m_select_main_faiss_index_id.get_column_uint64(0),
-					m_select_main_faiss_index_id.get_column_uint64(1),
-					m_select_main_faiss_index_id.get_column_str(2),
-					m_select_main_faiss_index_id.get_column_str(3),
-					m_select_main_faiss_index_id.get_column_str(4),
-					distances[i]
-				);
+			}
+			if (options.step_interval.count() > 0)
+			{
+				std::this_thread::sleep_for(options.step_interval);
+			}
+		}
 
+		// 与跨表搜索相同的加锁顺序(登记表锁 -> 数据库锁), 持有期间没有新的写入, 也没有表被关闭
+		struct table_files
+		{
+			std::string name;
+			fs::path source;
+			table::index_snapshot snapshot;
+			bool open;
+		};
+		std::vector<table_files> tables;
+		{
+			std::lock_guard<std::mutex> tables_lock(m_tables_mutex);
+			auto lock = this->lock();
+			while (!copy->step(-1))
+			{
+				std::this_thread::yield();
 			}
+			res.steps++;
+			res.pages = static_cast<std::uint64_t>(copy->pagecount());
+			copy->finish();
 
-			ts.commit();
+			sqlite::stmt select_tables{ m_db, "SELECT tablename, faiss_fullpath FROM __TABLE_MANAGE__;", SQLITE_PREPARE_NO_VTAB };
+			while (select_tables.step() == SQLITE_ROW)
+			{
+				auto& files = tables.emplace_back(select_tables.get_column_str(0), resolve_path(select_tables.get_column_str(1)));
+				auto it = m_tables.find(files.name);
+				files.open = it != m_tables.end();
+				if (files.open)
+				{
+					files.snapshot = it->second->snapshot_faiss_index();
+				}
+				else
+				{
+					// 未打开的表的索引文件只会在表打开后被写入, 持有登记表锁时复制是安全的
+					// 新表的登记在构造完成之后, 构造期间只读取索引文件
+					const auto target = faiss_directory / std::format("{}.faiss", files.name);
+					for (const auto& [from, to] : { std::pair{ files.source, target },
+						{ table::transform_path(files.source), table::transform_path(target) },
+						{ table::full_vectors_path(files.source), table::full_vectors_path(target) } })
+					{
+						if (fs::exists(from))
+						{
+							fs::copy_file(from, to, fs::copy_options::overwrite_existing);
+						}
+					}
+				}
+			}
 
-			return res;
+			// 分区数据库: 附加中的分区通过连接复制, 与主库处于同一时刻; 未附加的分区文件只会在附加后被写入, 持有数据库锁时直接复制
+			std::unordered_set<std::string> attached;
+			for (const auto& [schema, file] : attached_databases())
+			{
+				attached.emplace(schema);
+			}
+			sqlite::stmt select_partitions{ m_db, "SELECT partition_name, db_file FROM __PARTITION_MANAGE__;", SQLITE_PREPARE_NO_VTAB };
+			while (select_partitions.step() == SQLITE_ROW)
+			{
+				const std::string name = select_partitions.get_column_str(0);
+				const auto source = resolve_path(select_partitions.get_column_str(1));
+				const auto target = faiss_directory / std::format("{}.db", name);
+				const auto schema = partition_schema_name(name);
+				if (attached.contains(schema))
+				{
+					sqlite::database partition(target.string());
+					sqlite::backup partition_copy(partition, *m_db, schema);
+					while (!partition_copy.step(-1))
+					{
+						std::this_thread::yield();
+					}
+					partition_copy.finish();
+				}
+				else
+				{
+					for (const auto& [from, to] : { std::pair{ source, target },
+						{ fs::path(source).concat("-wal"), fs::path(target).concat("-wal") } })
+					{
+						if (fs::exists(from))
+						{
+							fs::copy_file(from, to, fs::copy_options::overwrite_existing);
+						}
+					}
+				}
+				res.partitions.emplace_back(name);
+			}
+		}
 
+		// 释放锁后写出索引快照, 并让备份中的__TABLE_MANAGE__以相对路径指向备份目录中的索引, 恢复或移动备份后不会指向原来的文件
+		auto write_file = [](const fs::path& path, const std::vector<std::uint8_t>& data)
+			{
+				std::ofstream file(path, std::ios::binary | std::ios::trunc);
+				file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+				if (!file)
+				{
+					throw exception::runtime_error(std::format("无法写入备份文件: {}", path.string()));
+				}
+			};
+		sqlite::transaction ts(destination, sqlite::IMMEDIATE);
+		sqlite::stmt update_path{ ts, "UPDATE __TABLE_MANAGE__ SET faiss_fullpath = ? WHERE tablename = ?;" };
+		sqlite::stmt update_partition{ ts, "UPDATE __PARTITION_MANAGE__ SET db_file = ? WHERE partition_name = ?;" };
+		for (const auto& name : res.partitions)
+		{
+			update_partition.reset();
+			update_partition.bind(1, (fs::path(m_db_file_path.stem()) / std::format("{}.db", name)).string());
+			update_partition.bind(2, name);
+			update_partition.step();
 		}
-		std::vector<select_vector_data> search_list_vector_texts(const std::vector<std::string>& messages, const faiss::idx_t k)
+		sqlite::stmt update_new_id{ ts, "UPDATE __TABLE_MANAGE__ SET faiss_new_id = ? WHERE tablename = ?;" };
+		for (const auto& files : tables)
 		{
-			if (messages.empty())
+			const auto target = faiss_directory / std::format("{}.faiss", files.name);
+			if (files.open)
 			{
-				throw exception::invalid_argument("messages不能为空, 但实际为空");
+				write_file(target, files.snapshot.index);
+				if (!files.snapshot.transform.empty())
+					write_file(table::transform_path(target), files.snapshot.transform);
+				if (!files.snapshot.full_vectors.empty())
+					write_file(table::full_vectors_path(target), files.snapshot.full_vectors);
+				update_new_id.reset();
+				update_new_id.bind(1, files.snapshot.new_id);
+				update_new_id.bind(2, files.name);
+				update_new_id.step();
 			}
-			ckeck_k(k);
+			update_path.reset();
+			update_path.bind(1, (fs::path(m_db_file_path.stem()) / std::format("{}.faiss", files.name)).string());
+			update_path.bind(2, files.name);
+			update_path.step();
+			res.tables.emplace_back(files.name);
+		}
+		ts.commit();
 
-			sqlite::transaction ts(m_db);
+		res.elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return res;
+	}
 
-			auto vector = string_generate_vectors(messages);
-			std::vector<faiss::idx_t> indices(k * messages.size()); // 索引结果
-			std::vector<float> distances(k * messages.size());        // 距离结果
-			m_faiss_index->search(messages.size(), vector.data(), k, distances.data(), indices.data());
+	inline maintenance_report database::run_maintenance(const maintenance_options& options, const bool force)
+	{
+		trace::span span("database::run_maintenance", "database");
+		std::lock_guard<std::mutex> pass_lock(m_maintenance_pass_mutex);
+		const auto start = std::chrono::steady_clock::now();
+		auto& state = m_maintenance_state;
+		maintenance_report res;
+		res.passes = 1;
 
-			std::vector<select_vector_data> res;
-			res.reserve(indices.size());
-			for (std::size_t i = 0; i < indices.size(); i++)
+		const auto writes = write_count(m_stats.take());
+		if (writes != state.writes)
+		{
+			state.writes = writes;
+			state.last_write = start;
+		}
+		const bool quiet = force || (in_quiet_window(options.quiet_windows) && start - state.last_write >= options.idle_for);
+		res.quiet_passes = quiet ? 1 : 0;
+		span.arg("quiet", quiet);
+
+		auto attempt = [&res](auto&& step)
 			{
-				if (indices[i] < 0)
+				try
 				{
-					continue;
+					step();
 				}
-				m_select_main_faiss_index_id.reset();
-				m_select_main_faiss_index_id.bind(1, indices[i]);
-				if (m_select_main_faiss_index_id.step() != SQLITE_ROW)
+				catch (const std::exception& e)
 				{
-					continue;
+					res.errors++;
+					res.last_error = e.what();
 				}
-				res.emplace_back(
-					m_select_main_faiss_index_id.get_column_uint64(0),
-					m_select_main_faiss_index_id.get_column_uint64(1),
-					m_select_main_faiss_index_id.get_column_str(2),
-					m_select_main_faiss_index_id.get_column_str(3),
-					m_select_main_faiss_index_id.get_column_str(4),
-					distances[i]
-				);
+			};
+
+		// 按各数据库自己的WAL大小选择检查点模式, 平时只做不阻塞读写的PASSIVE; 附加的分区数据库各有自己的WAL
+		// 持有数据库锁期间附加的数据库不会变化
+		attempt([&]
+			{
+				auto lock = this->lock();
+				for (const auto& [schema, file] : attached_databases())
+				{
+					attempt([&]
+						{
+							const auto wal = wal_bytes(file);
+							const bool truncate = quiet && options.wal_truncate_bytes > 0 && wal >= options.wal_truncate_bytes;
+							if (!truncate && (options.wal_passive_bytes == 0 || wal < options.wal_passive_bytes))
+							{
+								return;
+							}
+							int log = 0;
+							int ckpt = 0;
+							m_db->wal_checkpoint(truncate ? sqlite::checkpoint::TRUNCATE : sqlite::checkpoint::PASSIVE, schema, &log, &ckpt);
+							(truncate ? res.truncate_checkpoints : res.passive_checkpoints)++;
+							res.checkpointed_frames += static_cast<std::uint64_t>(std::max(ckpt, 0));
+							res.last_actions.emplace_back(std::format("wal_checkpoint {} {}: WAL {}字节, 写回{}/{}帧", schema, truncate ? "TRUNCATE" : "PASSIVE", wal, ckpt, log));
+						});
+				}
+			});
 
+		if (quiet)
+		{
+			// 与跨表搜索相同的加锁顺序(登记表锁 -> 数据库锁), 每个操作单独持有数据库锁
+			std::lock_guard<std::mutex> tables_lock(m_tables_mutex);
+			if (options.fts_merge_pages > 0)
+			{
+				for (const auto& [name, t] : m_tables)
+				{
+					attempt([&]
+						{
+							if (!t->read_only() && t->merge_fts(options.fts_merge_pages))
+							{
+								res.fts_merges++;
+								res.last_actions.emplace_back(std::format("fts merge: {}", name));
+							}
+						});
+				}
+			}
+			if (options.snapshot_interval.count() > 0 && (force || start - state.last_snapshot >= options.snapshot_interval))
+			{
+				state.last_snapshot = start;
+				for (const auto& [name, t] : m_tables)
+				{
+					attempt([&]
+						{
+							const auto table_writes = write_count(t->stats());
+							auto it = state.snapshot_writes.find(name);
+							if (it != state.snapshot_writes.end() && it->second == table_writes)
+							{
+								return;
+							}
+							t->save_faiss_index();
+							state.snapshot_writes[name] = table_writes;
+							res.index_snapshots++;
+							res.last_actions.emplace_back(std::format("index snapshot: {}", name));
+						});
+				}
 			}
+		}
+		if (quiet && options.vacuum_pages > 0)
+		{
+			attempt([&]
+				{
+					auto lock = this->lock();
+					for (const auto& [schema, file] : attached_databases())
+					{
+						attempt([&]
+							{
+								if (m_db->readonly(schema) || m_db->pragma_int("auto_vacuum", schema) != 2)
+								{
+									return;
+								}
+								const auto before = m_db->pragma_int("freelist_count", schema);
+								if (before == 0)
+								{
+									return;
+								}
+								m_db->execute(std::format("PRAGMA {}.incremental_vacuum({});", schema, options.vacuum_pages));
+								const auto freed = before - m_db->pragma_int("freelist_count", schema);
+								res.vacuumed_pages += static_cast<std::uint64_t>(std::max<std::int64_t>(freed, 0));
+								res.last_actions.emplace_back(std::format("incremental_vacuum {}: 释放{}页", schema, freed));
+							});
+					}
+				});
+		}
 
-			ts.commit();
+		attempt([&]
+			{
+				auto lock = this->lock();
+				for (const auto& [schema, file] : attached_databases())
+				{
+					res.wal_bytes += wal_bytes(file);
+					res.freelist_pages += static_cast<std::uint64_t>(m_db->pragma_int("freelist_count", schema));
+				}
+			});
+		res.elapsed_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
-			return res;
+		std::lock_guard<std::mutex> lock(m_maintenance_mutex);
+		auto& total = m_maintenance_total;
+		total.passes += res.passes;
+		total.quiet_passes += res.quiet_passes;
+		total.passive_checkpoints += res.passive_checkpoints;
+		total.truncate_checkpoints += res.truncate_checkpoints;
+		total.checkpointed_frames += res.checkpointed_frames;
+		total.fts_merges += res.fts_merges;
+		total.vacuumed_pages += res.vacuumed_pages;
+		total.index_snapshots += res.index_snapshots;
+		total.errors += res.errors;
+		total.wal_bytes = res.wal_bytes;
+		total.freelist_pages = res.freelist_pages;
+		total.last_actions = res.last_actions;
+		if (!res.last_error.empty())
+		{
+			total.last_error = res.last_error;
 		}
+		total.elapsed_seconds += res.elapsed_seconds;
+		return res;
+	}
 
-		void forgotten()
+	// 按时间分区的表: 每个时间段一个数据库文件与FAISS索引, 通过ATTACH附加到数据库连接上
+	// 新行按时间写入所在的分区, 较早的分区封存为只读并可以进一步压缩; 按时间范围的查询只访问相关的分区
+	// 每个分区是一个表名为"<name>__<时间段>"的普通table, 行与全文索引在分区文件中, 索引参数仍登记在主库的__TABLE_MANAGE__中
+	class partitioned_table : public std::enable_shared_from_this<partitioned_table>
+	{
+	public:
+		// 已存在的分区表沿用建表时的分区粒度、向量维度、HNSW参数、距离度量与全文索引存储方式
+		partitioned_table(std::shared_ptr<database> db, const std::string& name, const int vector_dimension, const int HNWS_max_connect = 32, const metric distance_metric = metric::l2, const fts_storage fts = fts_storage::internal, const partition_options& options = {})
+			: m_database(db),
+			m_db(db->get()),
+			m_name(name),
+			m_vector_dimension(vector_dimension),
+			m_HNSW_max_connect(HNWS_max_connect),
+			m_metric(distance_metric),
+			m_fts_storage(fts),
+			m_options(options)
 		{
-			std::vector<std::size_t> ids;
-			std::random_device rd;
-			std::mt19937 generator(rd());
-			std::uniform_real_distribution<double> distribution(0.0, 1.0);
-
+			if (options.writable_partitions < 1)
+			{
+				throw exception::invalid_argument("writable_partitions不能小于1, 但实际值为: 0");
+			}
+			if (options.max_attached < 1)
+			{
+				throw exception::invalid_argument("max_attached不能小于1, 但实际值为: 0");
+			}
+			auto lock = m_database->lock();
 			sqlite::transaction ts(m_db, sqlite::IMMEDIATE);
+			sqlite::stmt select_table{ ts, "SELECT period, vector_dimension, HNWS_max_connect, metric, fts_storage FROM __PARTITIONED_TABLE__ WHERE tablename = ?;" };
+			select_table.bind(1, m_name);
+			if (select_table.step() == SQLITE_ROW)
+			{
+				m_options.period = parse_partition_period(select_table.get_column_str(0));
+				m_vector_dimension = select_table.get_column_int(1);
+				m_HNSW_max_connect = select_table.get_column_int(2);
+				m_metric = parse_metric(select_table.get_column_str(3));
+				m_fts_storage = std::string_view(select_table.get_column_str(4)) == "external_content" ? fts_storage::external_content : fts_storage::internal;
+			}
+			else
+			{
+				sqlite::stmt insert_table{ ts, "INSERT INTO __PARTITIONED_TABLE__ (tablename, period, vector_dimension, HNWS_max_connect, metric, fts_storage) VALUES (?, ?, ?, ?, ?, ?);" };
+				insert_table.bind(1, m_name);
+				insert_table.bind(2, partition_period_name(m_options.period));
+				insert_table.bind(3, m_vector_dimension);
+				insert_table.bind(4, m_HNSW_max_connect);
+				insert_table.bind(5, metric_name(m_metric));
+				insert_table.bind(6, m_fts_storage == fts_storage::external_content ? "external_content" : "internal");
+				insert_table.step();
+			}
+			sqlite::stmt select_partitions{ ts, "SELECT partition_name, time_start, time_end, db_file, read_only, compacted FROM __PARTITION_MANAGE__ WHERE tablename = ?;" };
+			select_partitions.bind(1, m_name);
+			while (select_partitions.step() == SQLITE_ROW)
+			{
+				partition_slot slot;
+				slot.info = partition_info{ select_partitions.get_column_str(0),
+					select_partitions.get_column_uint64(1),
+					select_partitions.get_column_uint64(2),
+					m_database->resolve_path(select_partitions.get_column_str(3)).string(),
+					select_partitions.get_column_int(4) != 0,
+					select_partitions.get_column_int(5) != 0,
+					false };
+				m_partitions.emplace(slot.info.time_start, std::move(slot));
+			}
+			ts.commit();
+		}
+		// 仍被partition()的调用方持有的分区保持附加, 随数据库连接关闭
+		~partitioned_table()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (auto& [start, slot] : m_partitions)
+			{
+				try
+				{
+					detach(slot);
+				}
+				catch (const std::exception&) {}
+			}
+		}
 
-			m_select_main_id_forget_probability.reset();
-
-			constexpr double k_almost_one = 1.0 - std::numeric_limits<double>::epsilon();
-			constexpr double k_almost_zero = std::numeric_limits<double>::epsilon();
-			while (m_select_main_id_forget_probability.step() == SQLITE_ROW)
+		const std::string& name() const noexcept
+		{
+			return m_name;
+		}
+		partition_period period() const noexcept
+		{
+			return m_options.period;
+		}
+		// 向量生成回调函数, 应用到已打开与之后打开的所有分区
+		void set_vector(std::function<std::vector<float>(std::string)> func)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_generate_vector_callback = func;
+			for (auto& [start, slot] : m_partitions)
 			{
-				auto main_id = m_select_main_id_forget_probability.get_column_uint64(0);
-				auto forget_probability = m_select_main_id_forget_probability.get_column_double(1);
-				if (forget_probability <= k_almost_zero)
+				if (slot.handle)
 				{
-					continue;
+					slot.handle->set_vector(func);
 				}
-				if (forget_probability >= k_almost_one
-					|| distribution(generator) < forget_probability
-					)
+			}
+		}
+		void set_vectors(std::function<std::vector<float>(std::vector<std::string>)> func)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_generate_vectors_callback = func;
+			for (auto& [start, slot] : m_partitions)
+			{
+				if (slot.handle)
 				{
-					ids.emplace_back(main_id);
-					continue;
+					slot.handle->set_vectors(func);
 				}
 			}
-			for (const auto& i : ids)
+		}
+
+		// 按时间升序
+		std::vector<partition_info> partitions()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::vector<partition_info> res;
+			res.reserve(m_partitions.size());
+			for (const auto& [start, slot] : m_partitions)
 			{
-				m_del_main_id.reset();
-				m_del_main_id.bind(1, i);
-				m_del_main_id.step();
-				m_del_fts_id.reset();
-				m_del_fts_id.bind(1, i);
-				m_del_fts_id.step();
+				res.emplace_back(slot.info);
 			}
-			m_select_main_count.reset();
-			m_select_main_count.step();
+			return res;
+		}
+		// 附加并返回单个分区, 可以使用table的全部接口; 持有期间分区不会被分离或封存
+		std::shared_ptr<table> partition(const std::string& partition_name)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return open(find_partition(partition_name));
+		}
 
-			auto faiss_index_size = m_select_main_count.get_column_uint64(0);
-			std::vector<float> vec(faiss_index_size * m_vector_dimension);
-			auto vec_begin = vec.begin();
-			ids.clear();
-			m_select_main_id_faiss_index.reset();
-			while (m_select_main_id_faiss_index.step() == SQLITE_ROW)
+		// 写入time所在的分区, 分区不存在时创建; 所在分区已封存时抛出异常
+		void add(const insert_data& data)
+		{
+			trace::span span("partitioned_table::add", "table");
+			span.arg("table", m_name);
+			std::shared_ptr<table> t;
 			{
-				auto main_id = m_select_main_id_faiss_index.get_column_uint64(0);
-				auto faiss_id = m_select_main_id_faiss_index.get_column_uint64(1);
-				m_faiss_index->reconstruct(faiss_id, vec_begin._Ptr);
-				vec_begin += m_vector_dimension;
-				ids.emplace_back(main_id);
+				std::lock_guard<std::mutex> lock(m_mutex);
+				t = writable_partition(data.time);
 			}
-			auto  new_faiss_index = std::make_shared<f::faiss_index>(m_vector_dimension, m_HNSW_max_connect);
-			new_faiss_index->add(faiss_index_size, vec.data());
-			m_faiss_index_new_id = 0;
-			for (const auto& i : ids)
+			t->add(data);
+		}
+		// 按分区分组后依次写入, 每个分区一个事务, 不同分区之间不是原子的
+		void adds(const std::vector<insert_data>& datas)
+		{
+			trace::span span("partitioned_table::adds", "table");
+			span.arg("table", m_name);
+			std::map<std::size_t, std::vector<insert_data>> groups;
+			for (const auto& i : datas)
 			{
-				m_update_main_id_to_faiss_index.reset();
-				m_update_main_id_to_faiss_index.bind(2, i);
-				m_update_main_id_to_faiss_index.bind(1, m_faiss_index_new_id++);
-				m_update_main_id_to_faiss_index.step();
+				groups[partition_range(m_options.period, i.time).first].emplace_back(i);
+			}
+			for (const auto& [start, rows] : groups)
+			{
+				std::shared_ptr<table> t;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					t = writable_partition(start);
+				}
+				t->adds(rows);
 			}
-			m_faiss_index = new_faiss_index;
-			ts.commit();
 		}
 
-		void rebuild_faiss_index()
+		// 只访问与[start, end]相交的分区, 按时间降序
+		std::vector<select_table_data> search_list_time_start_end(const std::size_t start, const std::size_t end)
 		{
-			std::vector<std::size_t> ids;
-			sqlite::transaction ts(m_db, sqlite::IMMEDIATE);
+			trace::span span("partitioned_table::search_list_time_start_end", "table");
+			span.arg("table", m_name);
+			const auto starts = relevant_partitions(start, end);
+			span.arg("partitions", starts.size());
+			std::vector<select_table_data> res;
+			// 分区的时间段互不重叠, 从新到旧依次拼接即为整体的降序
+			for (auto it = starts.rbegin(); it != starts.rend(); ++it)
+			{
+				std::shared_ptr<table> t;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					t = open(m_partitions.at(*it));
+				}
+				for (auto& row : t->search_list_time_start_end(start, end))
+				{
+					res.emplace_back(t->name(), row.id, row.time, std::move(row.sender), std::move(row.sender_uuid), std::move(row.message));
+				}
+			}
+			return res;
+		}
+		// 向量搜索只分发到与时间范围相交的分区, 查询文本只生成一次向量, 再按距离归并出全局top-k
+		// 时间段完全在范围内的分区直接归并; 边界分区单独搜索并按时间过滤, 范围内的命中不足k条时加倍候选数重新搜索, 直到凑满k条或取遍整个分区
+		std::vector<select_table_vector_data> search_list_vector_text(std::string_view message, const faiss::idx_t k, const std::optional<std::size_t> time_start = std::nullopt, const std::optional<std::size_t> time_end = std::nullopt)
+		{
+			trace::span span("partitioned_table::search_list_vector_text", "table");
+			span.arg("table", m_name);
+			ckeck_k(k);
+			const auto start = time_start.value_or(0);
+			const auto end = time_end.value_or(std::numeric_limits<std::size_t>::max());
+			const auto starts = relevant_partitions(start, end);
+			span.arg("partitions", starts.size());
 
-			m_select_main_count.reset();
-			m_select_main_count.step();
+			std::vector<float> vector;
+			std::vector<select_table_vector_data> res;
+			auto search_boundary = [&](table& t)
+				{
+					const std::vector<table*> tables{ &t };
+					std::vector<select_table_vector_data> hits;
+					for (auto candidates = k; ; )
+					{
+						hits.clear();
+						for (auto& row : m_database->search_vector_tables(tables, vector.data(), candidates))
+						{
+							if (row.time >= start && row.time <= end)
+							{
+								hits.emplace_back(std::move(row));
+							}
+						}
+						const auto total = index_total(t);
+						if (hits.size() >= static_cast<std::size_t>(k) || candidates >= total)
+						{
+							return hits;
+						}
+						candidates = std::min(candidates * 2, total);
+					}
+				};
+			// 每批最多附加max_attached个分区, 批之间释放分区以便分离
+			for (std::size_t first = 0; first < starts.size(); first += m_options.max_attached)
+			{
+				std::vector<std::shared_ptr<table>> batch;
+				std::vector<bool> inside;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					for (std::size_t i = first; i < std::min(starts.size(), first + m_options.max_attached); i++)
+					{
+						auto& slot = m_partitions.at(starts[i]);
+						batch.emplace_back(open(slot));
+						inside.emplace_back(slot.info.time_start >= start && slot.info.time_end - 1 <= end);
+					}
+				}
+				if (vector.empty())
+				{
+					vector = batch.front()->generate_vector(std::string(message));
+				}
+				std::vector<table*> tables;
+				tables.reserve(batch.size());
+				for (std::size_t i = 0; i < batch.size(); i++)
+				{
+					if (inside[i])
+					{
+						tables.emplace_back(batch[i].get());
+						continue;
+					}
+					for (auto& row : search_boundary(*batch[i]))
+					{
+						res.emplace_back(std::move(row));
+					}
+				}
+				if (!tables.empty())
+				{
+					for (auto& row : m_database->search_vector_tables(tables, vector.data(), k))
+					{
+						res.emplace_back(std::move(row));
+					}
+				}
+			}
+			std::ranges::stable_sort(res, {}, &select_table_vector_data::distance);
+			if (res.size() > static_cast<std::size_t>(k))
+			{
+				res.resize(static_cast<std::size_t>(k));
+			}
+			return res;
+		}
+		async::task<std::vector<select_table_vector_data>> search_list_vector_text_async(std::string message, const faiss::idx_t k, const std::optional<std::size_t> time_start = std::nullopt, const std::optional<std::size_t> time_end = std::nullopt)
+		{
+			return async::run(m_database->m_thread_pool, [self = shared_from_this(), message = std::move(message), k, time_start, time_end]
+				{
+					return self->search_list_vector_text(message, k, time_start, time_end);
+				});
+		}
+
+		// 封存最新writable_partitions个分区之前的可写分区, 返回封存的分区数; 正在使用的分区留到下次
+		std::size_t seal_partitions()
+		{
+			trace::span span("partitioned_table::seal_partitions", "table");
+			span.arg("table", m_name);
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return seal_old(std::nullopt);
+		}
+		// 压缩已封存的分区: 重建索引去掉遗忘留下的空洞(或按reduction降维), 合并全文索引的段并VACUUM分区文件
+		// 期间分区以可写方式附加, 仍可被搜索, 其他分区的读写不受影响; 完成后重新以只读方式附加
+		void compact_partition(const std::string& partition_name, const std::optional<reduction_options>& reduction = std::nullopt)
+		{
+			trace::span span("partitioned_table::compact_partition", "table");
+			span.arg("partition", partition_name);
+			partition_slot* slot = nullptr;
+			std::shared_ptr<table> t;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				slot = &find_partition(partition_name);
+				if (!slot->info.read_only)
+				{
+					throw exception::invalid_argument(std::format("分区{}尚未封存, 只能压缩只读分区", partition_name));
+				}
+				if (slot->busy)
+				{
+					throw exception::runtime_error(std::format("分区{}正在压缩", partition_name));
+				}
+				if (slot->handle && !detach(*slot))
+				{
+					throw exception::runtime_error(std::format("分区{}正在被使用, 无法以可写方式重新附加", partition_name));
+				}
+				slot->info.read_only = false;
+				try
+				{
+					t = open(*slot);
+				}
+				catch (...)
+				{
+					slot->info.read_only = true;
+					throw;
+				}
+				slot->busy = true;
+			}
 
-			auto faiss_index_size = m_select_main_count.get_column_uint64(0);
-			std::vector<float> vec(faiss_index_size * m_vector_dimension);
-			auto vec_begin = vec.begin();
-			ids.clear();
-			m_select_main_id_faiss_index.reset();
-			while (m_select_main_id_faiss_index.step() == SQLITE_ROW)
+			bool compacted = false;
+			try
 			{
-				auto main_id = m_select_main_id_faiss_index.get_column_uint64(0);
-				auto faiss_id = m_select_main_id_faiss_index.get_column_uint64(1);
-				m_faiss_index->reconstruct(faiss_id, vec_begin._Ptr);
-				vec_begin += m_vector_dimension;
-				ids.emplace_back(main_id);
+				if (reduction)
+				{
+					t->enable_reduction(*reduction);
+				}
+				else
+				{
+					t->rebuild_faiss_index();
+				}
+				optimize_fts(*slot);
+				compacted = true;
 			}
-			auto  new_faiss_index = std::make_shared<f::faiss_index>(m_vector_dimension, m_HNSW_max_connect);
-			new_faiss_index->add(faiss_index_size, vec.data());
-			m_faiss_index_new_id = 0;
-			for (const auto& i : ids)
+			catch (...)
 			{
-				m_update_main_id_to_faiss_index.reset();
-				m_update_main_id_to_faiss_index.bind(2, i);
-				m_update_main_id_to_faiss_index.bind(1, m_faiss_index_new_id++);
-				m_update_main_id_to_faiss_index.step();
+				std::lock_guard<std::mutex> lock(m_mutex);
+				t.reset();
+				slot->busy = false;
+				if (wait_idle(*slot))
+				{
+					seal_attached(*slot, false);
+				}
+				throw;
 			}
-			m_faiss_index = new_faiss_index;
-			ts.commit();
-		}
-		void full_rebuild_faiss_index()
-		{
-			sqlite::transaction ts(m_db, sqlite::IMMEDIATE);
 
-			m_select_main_count.reset();
-			m_select_main_count.step();
-			auto faiss_index_size = m_select_main_count.get_column_uint64(0);
-			std::vector<std::size_t> ids;
-			std::vector<std::string> messages;
-			m_select_main_id_message.reset();
-			while (m_select_main_id_message.step() == SQLITE_ROW)
-			{
-				ids.emplace_back(m_select_main_id_message.get_column_uint64(0));
-				messages.emplace_back(m_select_main_id_message.get_column_str(1));
-			}
-			auto vec = string_generate_vectors(messages);
-			auto new_faiss_index = std::make_shared<f::faiss_index>(m_vector_dimension, m_HNSW_max_connect);
-			new_faiss_index->add(faiss_index_size, vec.data());
-			m_faiss_index_new_id = 0;
-			for (const auto& i : ids)
+			std::lock_guard<std::mutex> lock(m_mutex);
+			t.reset();
+			slot->busy = false;
+			if (!wait_idle(*slot))
 			{
-				m_update_main_id_to_faiss_index.reset();
-				m_update_main_id_to_faiss_index.bind(1, m_faiss_index_new_id++);
-				m_update_main_id_to_faiss_index.bind(2, i);
-				m_update_main_id_to_faiss_index.step();
+				throw exception::runtime_error(std::format("分区{}的索引已压缩, 但仍在被使用, 稍后调用seal_partitions重新封存", partition_name));
 			}
-			m_faiss_index = new_faiss_index;
-			ts.commit();
+			slot->info.compacted = compacted;
+			seal_attached(*slot, true);
 		}
-
-		void drop()
+		async::task<void> compact_partition_async(std::string partition_name, std::optional<reduction_options> reduction = std::nullopt)
 		{
-			m_insert_main_data.close();
-			m_insert_fts_data.close();
-
-			m_select_main_data_id.close();
-			m_select_main_data_id_no_message.close();
-			m_select_main_faiss_index_id.close();
-
-			m_select_main_sender_uuid.close();
-			m_select_main_sender_uuid_limit.close();
-
-			m_select_main_data_time_start.close();
-			m_select_main_data_time_end.close();
-			m_select_main_data_time_start_end.close();
-
-			m_select_main_count.close();
-
-			m_select_main_id_forget_probability.close();
-			m_select_main_id_faiss_index.close();
-			m_select_main_id_message.close();
-
-			m_update_main_id_to_faiss_index.close();
-
-			m_del_main_id.close();
-			m_del_fts_id.close();
-
-			sqlite::transaction ts(m_db, sqlite::EXCLUSIVE);
-			m_db->execute(std::format("DROP TABLE IF EXISTS {}", m_name));
-			m_db->execute(std::format("DROP TABLE IF EXISTS {}_fts", m_name));
-			sqlite::stmt delete_table(m_db, "DELETE FROM __TABLE_MANAGE__ WHERE tablename = ?", SQLITE_PREPARE_NO_VTAB);
-			delete_table.bind(1, m_name);
-			delete_table.step();
-			m_faiss_index.reset();
-			fs::remove(m_faiss_fullpath);
-			ts.commit();
+			return async::run(m_database->m_thread_pool, [self = shared_from_this(), partition_name = std::move(partition_name), reduction = std::move(reduction)]
+				{
+					self->compact_partition(partition_name, reduction);
+				}, thread_pool::priority::background);
 		}
 	private:
-		std::string m_name;
-		std::shared_ptr<sqlite::database> m_db;
+		struct partition_slot
+		{
+			partition_info info;
+			std::shared_ptr<table> handle; // 附加期间打开的表
+			std::uint64_t last_used = 0;
+			bool busy = false;             // 正在压缩, 不会被分离、封存或写入新行
+		};
 
-		int m_HNSW_max_connect;
+		std::shared_ptr<database> m_database;
+		std::shared_ptr<sqlite::database> m_db;
+		std::string m_name;
 		int m_vector_dimension;
+		int m_HNSW_max_connect;
+		metric m_metric;
+		fts_storage m_fts_storage;
+		partition_options m_options;
+		std::function<std::vector<float>(std::string)> m_generate_vector_callback;
+		std::function<std::vector<float>(std::vector<std::string>)> m_generate_vectors_callback;
 
-		std::size_t m_faiss_index_new_id = 0;
-		std::shared_ptr<f::faiss_index> m_faiss_index;
-		fs::path m_faiss_fullpath;
-
-		py::function<std::vector<float>(std::string)> m_generate_vector_callback;
-		py::function<std::vector<float>(std::vector<std::string>)> m_generate_vectors_callback;
-
-		sqlite::stmt m_insert_main_data;
-		sqlite::stmt m_insert_fts_data;
-
-		sqlite::stmt m_select_main_data_id;
-		sqlite::stmt m_select_main_data_id_no_message;
-		sqlite::stmt m_select_main_faiss_index_id;
-
-		sqlite::stmt m_select_main_sender_uuid;
-		sqlite::stmt m_select_main_sender_uuid_limit;
-
-		sqlite::stmt m_select_main_data_time_start;
-		sqlite::stmt m_select_main_data_time_end;
-		sqlite::stmt m_select_main_data_time_start_end;
-
-		sqlite::stmt m_select_main_count;
-
-		sqlite::stmt m_select_main_id_forget_probability;
-		sqlite::stmt m_select_main_id_faiss_index;
-		sqlite::stmt m_select_main_id_message;
-
-		sqlite::stmt m_update_main_id_to_faiss_index;
+		// 加锁顺序: m_mutex -> 登记表锁 -> 数据库锁; 分区的引用只在持有m_mutex时发出
+		std::mutex m_mutex;
+		std::map<std::size_t, partition_slot> m_partitions; // 按time_start
+		std::uint64_t m_clock = 0;
 
-		sqlite::stmt m_del_main_id;
-		sqlite::stmt m_del_fts_id;
+		// 发出的分区引用释放时通知wait_idle; 引用可能在分区表析构之后才释放, 因此单独共享持有
+		struct idle_signal
+		{
+			std::mutex mutex;
+			std::condition_variable condition;
+		};
+		std::shared_ptr<idle_signal> m_idle = std::make_shared<idle_signal>();
+		static constexpr std::chrono::seconds k_idle_timeout{ 1 };
 
-		std::vector<float> insert_data_generate_vectors(const std::vector<insert_data>& datas)
+		static std::string schema_name(const partition_info& info)
 		{
-			if (this->m_generate_vectors_callback)
+			return partition_schema_name(info.name);
+		}
+		// ATTACH使用URI文件名以便指定只读, 数据库连接以SQLITE_OPEN_URI打开
+		static std::string database_uri(const fs::path& path, const bool read_only)
+		{
+			const auto absolute = fs::absolute(path).generic_string();
+			std::string res = absolute.starts_with('/') ? "file://" : "file:///";
+			for (const auto c : absolute)
 			{
-				return m_generate_vectors_callback(
-					datas |
-					std::views::transform([](const insert_data& data) { return data.message; }) |
-					std::ranges::to<std::vector<std::string>>()
-				);
+				if (c == '%' || c == '?' || c == '#')
+				{
+					res += std::format("%{:02X}", static_cast<unsigned char>(c));
+				}
+				else
+				{
+					res += c;
+				}
 			}
-			else
+			res += read_only ? "?mode=ro" : "?mode=rwc";
+			return res;
+		}
+		std::string partition_label(const std::size_t start) const
+		{
+			using namespace std::chrono;
+			const year_month_day ymd{ floor<days>(sys_seconds{ seconds{ static_cast<std::int64_t>(start) } }) };
+			const auto y = static_cast<int>(ymd.year());
+			const auto m = static_cast<unsigned>(ymd.month());
+			const auto d = static_cast<unsigned>(ymd.day());
+			switch (m_options.period)
+			{
+			case partition_period::day: return std::format("{:04}{:02}{:02}", y, m, d);
+			case partition_period::year: return std::format("{:04}", y);
+			default: return std::format("{:04}{:02}", y, m);
+			}
+		}
+		// 调用方需持有m_mutex
+		partition_slot& find_partition(const std::string& partition_name)
+		{
+			for (auto& [start, slot] : m_partitions)
 			{
-				std::vector<float> vector;
-				vector.reserve(datas.size());
-				for (const auto i : datas | std::views::transform([](const insert_data& data) { return data.message; }))
+				if (slot.info.name == partition_name)
 				{
-					for (const auto& i : this->m_generate_vector_callback(i))
-					{
-						vector.emplace_back(i);
-					}
+					return slot;
 				}
-				return vector;
 			}
+			throw exception::invalid_argument(std::format("分区不存在: {}", partition_name));
 		}
-		std::vector<float> string_generate_vectors(const std::vector<std::string>& datas)
+		// 与[start, end]相交的分区的time_start, 升序
+		std::vector<std::size_t> relevant_partitions(const std::size_t start, const std::size_t end)
 		{
-			if (this->m_generate_vectors_callback)
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::vector<std::size_t> res;
+			for (auto it = m_partitions.begin(); it != m_partitions.end() && it->first <= end; ++it)
 			{
-				return m_generate_vectors_callback(
-					datas
-				);
+				if (it->second.info.time_end > start)
+				{
+					res.emplace_back(it->first);
+				}
 			}
-			else
+			return res;
+		}
+		// 调用方需持有m_mutex
+		std::shared_ptr<table> open(partition_slot& slot)
+		{
+			slot.last_used = ++m_clock;
+			if (slot.handle)
 			{
-				std::vector<float> vector;
-				vector.reserve(datas.size());
-				for (const auto i : datas)
+				return lease(slot);
+			}
+			evict();
+			const auto schema = schema_name(slot.info);
+			{
+				auto lock = m_database->lock();
+				sqlite::stmt attach{ m_db, "ATTACH DATABASE ? AS ?;" };
+				attach.bind(1, database_uri(slot.info.db_file, slot.info.read_only));
+				attach.bind(2, schema);
+				attach.step();
+				if (!slot.info.read_only)
 				{
-					for (const auto& i : this->m_generate_vector_callback(i))
-					{
-						vector.emplace_back(i);
-					}
+					m_db->execute(std::format("PRAGMA {}.journal_mode=WAL;", schema));
 				}
-				return vector;
 			}
+			try
+			{
+				slot.handle = std::shared_ptr<table>(new table(m_database, schema, slot.info.name, m_vector_dimension, m_HNSW_max_connect, m_metric, m_fts_storage));
+			}
+			catch (...)
+			{
+				detach_schema(schema);
+				throw;
+			}
+			if (m_generate_vector_callback)
+			{
+				slot.handle->set_vector(m_generate_vector_callback);
+			}
+			if (m_generate_vectors_callback)
+			{
+				slot.handle->set_vectors(m_generate_vectors_callback);
+			}
+			slot.info.attached = true;
+			return lease(slot);
 		}
-		void try_create_table(sqlite::transaction& ts)
+		// 调用方需持有m_mutex; 发出的引用持有一份slot.handle, 释放时先放下它再通知wait_idle
+		std::shared_ptr<table> lease(const partition_slot& slot)
 		{
-			ts.execute(std::format(R"(
-				CREATE TABLE IF NOT EXISTS {} (
-				id INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL,
-				timestamp INTEGER NOT NULL,
-				sender TEXT,
-				sender_uuid TEXT NOT NULL,
-				message TEXT NOT NULL,
-				forget_probability REAL NOT NULL DEFAULT 0.0 CHECK (forget_probability >= 0.0 AND forget_probability <= 1.0),
-				faiss_index_id INTEGER NOT NULL);
-			)", m_name));
-			ts.execute(std::format(R"(
-				CREATE VIRTUAL TABLE IF NOT EXISTS {}_fts USING fts5(message, tokenize = 'simple');
-			)", m_name));
+			return std::shared_ptr<table>(slot.handle.get(), [handle = slot.handle, idle = m_idle](table*) mutable
+				{
+					handle.reset();
+					std::lock_guard<std::mutex> lock(idle->mutex);
+					idle->condition.notify_all();
+				});
 		}
-		void load_faiss_index()
+		// 分离最久未使用且没有被其他地方持有的分区, 直到附加数小于上限; 都在使用时允许超出
+		void evict()
 		{
-			if (fs::exists(m_faiss_fullpath))
+			while (true)
 			{
-				auto faiss_index = faiss::read_index(m_faiss_fullpath.string().c_str());
-				std::shared_ptr<f::faiss_index> index_HNSW(dynamic_cast<f::faiss_index*>(faiss_index));
-				if (index_HNSW == nullptr)
-					throw exception::runtime_error();
-				m_faiss_index = index_HNSW;
+				std::size_t attached = 0;
+				partition_slot* victim = nullptr;
+				for (auto& [start, slot] : m_partitions)
+				{
+					if (!slot.handle)
+					{
+						continue;
+					}
+					attached++;
+					if (!slot.busy && slot.handle.use_count() == 1 && (victim == nullptr || slot.last_used < victim->last_used))
+					{
+						victim = &slot;
+					}
+				}
+				if (attached < m_options.max_attached || victim == nullptr)
+				{
+					return;
+				}
+				detach(*victim);
 			}
-			else
+		}
+		// 调用方需持有m_mutex; 分区仍被其他地方持有时不分离并返回false
+		bool detach(partition_slot& slot)
+		{
+			if (!slot.handle)
 			{
-				m_faiss_index = std::make_shared<f::faiss_index>(m_vector_dimension, m_HNSW_max_connect);
-				m_faiss_index_new_id = 0;
+				return true;
+			}
+			if (slot.busy || slot.handle.use_count() > 1)
+			{
+				return false;
 			}
+			slot.handle.reset(); // 析构时保存索引并结束预编译语句
+			detach_schema(schema_name(slot.info));
+			slot.info.attached = false;
+			return true;
 		}
-		void init(sqlite::transaction& ts, std::shared_ptr<memory::database>& db, const std::string& name, const int vector_dimension, const int HNWS_max_connect)
+		void detach_schema(const std::string& schema)
 		{
-			sqlite::stmt where_table{ ts, R"(
-				SELECT COUNT(*) FROM __TABLE_MANAGE__ WHERE tablename = ?;
-			)" };
-			where_table.bind(1, name);
-			where_table.step();
-			if (where_table.get_column_int(0))
+			auto lock = m_database->lock();
+			sqlite::stmt detach{ m_db, "DETACH DATABASE ?;" };
+			detach.bind(1, schema);
+			detach.step();
+		}
+		// 进行中的操作在发出引用后不再需要m_mutex, 调用方持有m_mutex时等待它们释放引用, 最多等待k_idle_timeout
+		bool wait_idle(partition_slot& slot)
+		{
+			std::unique_lock<std::mutex> lock(m_idle->mutex);
+			return m_idle->condition.wait_for(lock, k_idle_timeout, [&slot] { return !slot.handle || slot.handle.use_count() == 1; });
+		}
+		// 分区索引中的向量数, 包括已删除的行留下的向量
+		faiss::idx_t index_total(const table& t)
+		{
+			auto lock = m_database->lock();
+			return t.m_faiss_index ? t.m_faiss_index->ntotal : 0;
+		}
+		void optimize_fts(const partition_slot& slot)
+		{
+			auto lock = m_database->lock();
+			m_db->execute(std::format("INSERT INTO {0}_fts({0}_fts) VALUES('optimize');", slot.info.name));
+		}
+		// 调用方需持有m_mutex
+		std::shared_ptr<table> writable_partition(const std::size_t time)
+		{
+			const auto [start, end] = partition_range(m_options.period, time);
+			auto it = m_partitions.find(start);
+			if (it == m_partitions.end())
 			{
-				sqlite::stmt get_table_info{ ts, R"(
-					SELECT vector_dimension, faiss_fullpath, HNWS_max_connect, faiss_new_id FROM __TABLE_MANAGE__ WHERE tablename = ?;
-				)" };
-				get_table_info.bind(1, name);
-				get_table_info.step();
-				m_faiss_index_new_id = get_table_info.get_column_uint64(3);
-				m_HNSW_max_connect = get_table_info.get_column_int(2);
-				m_faiss_fullpath = (const char*)(get_table_info.get_column_str(1));
-				m_vector_dimension = get_table_info.get_column_int(0);
+				partition_slot slot;
+				slot.info.name = std::format("{}__{}", m_name, partition_label(start));
+				slot.info.time_start = start;
+				slot.info.time_end = end;
+				// __PARTITION_MANAGE__中记录相对于数据库文件所在目录的路径, 备份或移动后仍指向同一目录下的分区文件
+				const auto relative = fs::path(m_database->db_file_path().stem()) / std::format("{}.db", slot.info.name);
+				fs::create_directories(m_database->resolve_path(relative).parent_path());
+				slot.info.db_file = m_database->resolve_path(relative).string();
+				slot.info.read_only = false;
+				slot.info.compacted = false;
+				slot.info.attached = false;
+				{
+					auto lock = m_database->lock();
+					sqlite::stmt insert_partition{ m_db, "INSERT INTO __PARTITION_MANAGE__ (partition_name, tablename, time_start, time_end, db_file) VALUES (?, ?, ?, ?, ?);" };
+					insert_partition.bind(1, slot.info.name);
+					insert_partition.bind(2, m_name);
+					insert_partition.bind(3, start);
+					insert_partition.bind(4, end);
+					insert_partition.bind(5, relative.string());
+					insert_partition.step();
+				}
+				it = m_partitions.emplace(start, std::move(slot)).first;
+				seal_old(start);
 			}
-			else
+			if (it->second.info.read_only || it->second.busy)
 			{
-				m_faiss_fullpath = db->db_file_path().parent_path() / db->db_file_path().stem() / std::format("{}.faiss", m_name);
-				m_vector_dimension = vector_dimension;
-				m_HNSW_max_connect = HNWS_max_connect;
-				sqlite::stmt insert_table_info{ ts, R"(
-					INSERT INTO __TABLE_MANAGE__ (tablename, vector_dimension, faiss_fullpath, HNWS_max_connect, faiss_new_id) VALUES (?, ?, ?, ?, ?);
-				)" };
-				insert_table_info.bind(1, m_name);
-				insert_table_info.bind(2, m_vector_dimension);
-				insert_table_info.bind(3, m_faiss_fullpath.string().c_str());
-				insert_table_info.bind(4, m_HNSW_max_connect);
-				insert_table_info.bind(5, m_faiss_index_new_id);
-				insert_table_info.step();
+				throw exception::invalid_argument(std::format("时间{}所在的分区{}已封存为只读", time, it->second.info.name));
 			}
+			return open(it->second);
 		}
-		void init_stmt()
+		// 调用方需持有m_mutex; except为正在写入的分区, 即使较早也不封存
+		std::size_t seal_old(const std::optional<std::size_t> except)
 		{
-			m_insert_main_data = sqlite::stmt(m_db, std::format(R"(INSERT INTO {} 
-			(timestamp, sender, sender_uuid, message, forget_probability, faiss_index_id) 
-			VALUES (?, ?, ?, ?, ?, ?);)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-			m_insert_fts_data = sqlite::stmt(m_db, std::format(R"(INSERT INTO {}_fts (rowid, message) VALUES (?, ?);)", m_name), SQLITE_PREPARE_PERSISTENT);
-
-			m_select_main_data_id = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid, message FROM {} WHERE id = ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-			m_select_main_faiss_index_id = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid, message FROM {} WHERE faiss_index_id = ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-
-			m_select_main_sender_uuid = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid, message FROM {} WHERE sender_uuid = ? ORDER BY id DESC;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-			m_select_main_sender_uuid_limit = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid, message FROM {} WHERE sender_uuid = ? ORDER BY id DESC LIMIT ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-
-			m_select_main_data_id_no_message = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid FROM {} WHERE id = ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-
-			m_select_main_data_time_start = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid, message FROM {} WHERE timestamp >= ? ORDER BY timestamp DESC;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-			m_select_main_data_time_end = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid, message FROM {} WHERE timestamp <= ? ORDER BY timestamp DESC;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-			m_select_main_data_time_start_end = sqlite::stmt(m_db, std::format(R"(SELECT id, timestamp, sender, sender_uuid, message FROM {} WHERE timestamp >= ? AND timestamp <= ? ORDER BY timestamp DESC;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-
-			m_select_main_count = sqlite::stmt(m_db, std::format(R"(SELECT count(*) FROM {};)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-
-			m_select_main_id_forget_probability = sqlite::stmt(m_db, std::format(R"(SELECT id, forget_probability FROM {};)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-			m_select_main_id_faiss_index = sqlite::stmt(m_db, std::format(R"(SELECT id, faiss_index_id FROM {};)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-			m_select_main_id_message = sqlite::stmt(m_db, std::format(R"(SELECT id, message FROM {};)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-
-			m_update_main_id_to_faiss_index = sqlite::stmt(m_db, std::format(R"(UPDATE {} SET faiss_index_id = ? WHERE id = ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-
-			m_del_main_id = sqlite::stmt(m_db, std::format(R"(DELETE FROM {} WHERE id = ?;)", m_name), SQLITE_PREPARE_NO_VTAB | SQLITE_PREPARE_PERSISTENT);
-			m_del_fts_id = sqlite::stmt(m_db, std::format(R"(DELETE FROM {}_fts WHERE rowid = ?;)", m_name), SQLITE_PREPARE_PERSISTENT);
+			std::size_t kept = 0;
+			std::size_t sealed = 0;
+			for (auto it = m_partitions.rbegin(); it != m_partitions.rend(); ++it)
+			{
+				auto& slot = it->second;
+				if (kept < m_options.writable_partitions)
+				{
+					kept++;
+					continue;
+				}
+				if (slot.info.read_only || slot.busy || it->first == except || (slot.handle && slot.handle.use_count() > 1))
+				{
+					continue;
+				}
+				open(slot);
+				optimize_fts(slot);
+				seal_attached(slot, false);
+				sealed++;
+			}
+			return sealed;
+		}
+		// 调用方需持有m_mutex, 分区以可写方式附加且没有被其他地方持有
+		// 把WAL写回并改为回滚日志模式后分离, 之后以只读方式附加, 只读附加不需要创建-wal与-shm文件
+		void seal_attached(partition_slot& slot, const bool vacuum)
+		{
+			slot.handle.reset();
+			const auto schema = schema_name(slot.info);
+			{
+				auto lock = m_database->lock();
+				if (vacuum)
+				{
+					m_db->execute(std::format("VACUUM {};", schema));
+				}
+				m_db->execute(std::format("PRAGMA {}.wal_checkpoint(TRUNCATE);", schema));
+				m_db->execute(std::format("PRAGMA {}.journal_mode=DELETE;", schema));
+				sqlite::stmt update_partition{ m_db, "UPDATE __PARTITION_MANAGE__ SET read_only = 1, compacted = ? WHERE partition_name = ?;" };
+				update_partition.bind(1, slot.info.compacted ? 1 : 0);
+				update_partition.bind(2, slot.info.name);
+				update_partition.step();
+			}
+			detach_schema(schema);
+			slot.info.attached = false;
+			slot.info.read_only = true;
 		}
 	};
-}
\ No newline at end of file
+}
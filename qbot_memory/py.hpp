@@ -8,6 +8,16 @@
 
 namespace memory::py
 {
+	// 当前线程是否持有GIL; 持有GIL的线程不能等待其他需要GIL的线程, 否则会死锁
+	inline bool holds_gil() noexcept
+	{
+#ifdef ENABLE_GET_GIL_BEFORE_CALL
+		return PyGILState_Check() != 0;
+#else
+		return false;
+#endif
+	}
+
 	template <class F>
 	class function
 	{
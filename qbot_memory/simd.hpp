@@ -0,0 +1,357 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define QBOT_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define QBOT_SIMD_X86 0
+#endif
+
+// MSVC不需要为单个函数开启指令集, GCC/Clang需要target属性才能在未开启-mavx2的编译单元里使用内建函数
+#if QBOT_SIMD_X86 && !defined(_MSC_VER)
+#define QBOT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define QBOT_TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define QBOT_TARGET_AVX2
+#define QBOT_TARGET_AVX512
+#endif
+
+// 手写向量化的距离核, 启动时按CPU支持的指令集选择一次实现
+// 常用维度(384/768/1024)使用编译期固定长度的特化, 循环次数为常量, 编译器可以完全展开
+namespace memory::simd
+{
+	enum class level
+	{
+		scalar,
+		avx2,   // AVX2 + FMA
+		avx512  // AVX-512F
+	};
+
+	namespace detail
+	{
+		// 4路累加打断依赖链, 便于编译器自动向量化
+		template <std::size_t D>
+		inline float l2_sqr_scalar(const float* a, const float* b, const std::size_t d) noexcept
+		{
+			const std::size_t n = D == 0 ? d : D;
+			float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+			std::size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+			{
+				const float d0 = a[i] - b[i], d1 = a[i + 1] - b[i + 1], d2 = a[i + 2] - b[i + 2], d3 = a[i + 3] - b[i + 3];
+				s0 += d0 * d0; s1 += d1 * d1; s2 += d2 * d2; s3 += d3 * d3;
+			}
+			if constexpr (D == 0 || D % 4 != 0)
+			{
+				for (; i < n; i++)
+				{
+					const float d0 = a[i] - b[i];
+					s0 += d0 * d0;
+				}
+			}
+			return (s0 + s1) + (s2 + s3);
+		}
+		template <std::size_t D>
+		inline float inner_product_scalar(const float* a, const float* b, const std::size_t d) noexcept
+		{
+			const std::size_t n = D == 0 ? d : D;
+			float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+			std::size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+			{
+				s0 += a[i] * b[i]; s1 += a[i + 1] * b[i + 1]; s2 += a[i + 2] * b[i + 2]; s3 += a[i + 3] * b[i + 3];
+			}
+			if constexpr (D == 0 || D % 4 != 0)
+			{
+				for (; i < n; i++)
+				{
+					s0 += a[i] * b[i];
+				}
+			}
+			return (s0 + s1) + (s2 + s3);
+		}
+		inline void scale_scalar(float* v, const std::size_t d, const float factor) noexcept
+		{
+			for (std::size_t i = 0; i < d; i++)
+			{
+				v[i] *= factor;
+			}
+		}
+
+#if QBOT_SIMD_X86
+		QBOT_TARGET_AVX2 inline float hsum_avx2(const __m256 v) noexcept
+		{
+			__m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+			lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+			lo = _mm_add_ss(lo, _mm_movehdup_ps(lo));
+			return _mm_cvtss_f32(lo);
+		}
+		template <std::size_t D>
+		QBOT_TARGET_AVX2 inline float l2_sqr_avx2(const float* a, const float* b, const std::size_t d) noexcept
+		{
+			const std::size_t n = D == 0 ? d : D;
+			__m256 s0 = _mm256_setzero_ps();
+			__m256 s1 = _mm256_setzero_ps();
+			std::size_t i = 0;
+			for (; i + 16 <= n; i += 16)
+			{
+				const __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+				const __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+				s0 = _mm256_fmadd_ps(d0, d0, s0);
+				s1 = _mm256_fmadd_ps(d1, d1, s1);
+			}
+			if (i + 8 <= n)
+			{
+				const __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+				s0 = _mm256_fmadd_ps(d0, d0, s0);
+				i += 8;
+			}
+			float res = hsum_avx2(_mm256_add_ps(s0, s1));
+			for (; i < n; i++)
+			{
+				const float d0 = a[i] - b[i];
+				res += d0 * d0;
+			}
+			return res;
+		}
+		template <std::size_t D>
+		QBOT_TARGET_AVX2 inline float inner_product_avx2(const float* a, const float* b, const std::size_t d) noexcept
+		{
+			const std::size_t n = D == 0 ? d : D;
+			__m256 s0 = _mm256_setzero_ps();
+			__m256 s1 = _mm256_setzero_ps();
+			std::size_t i = 0;
+			for (; i + 16 <= n; i += 16)
+			{
+				s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+				s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), s1);
+			}
+			if (i + 8 <= n)
+			{
+				s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+				i += 8;
+			}
+			float res = hsum_avx2(_mm256_add_ps(s0, s1));
+			for (; i < n; i++)
+			{
+				res += a[i] * b[i];
+			}
+			return res;
+		}
+		QBOT_TARGET_AVX2 inline void scale_avx2(float* v, const std::size_t d, const float factor) noexcept
+		{
+			const __m256 f = _mm256_set1_ps(factor);
+			std::size_t i = 0;
+			for (; i + 8 <= d; i += 8)
+			{
+				_mm256_storeu_ps(v + i, _mm256_mul_ps(_mm256_loadu_ps(v + i), f));
+			}
+			for (; i < d; i++)
+			{
+				v[i] *= factor;
+			}
+		}
+
+		// 不使用_mm512_reduce_add_ps, 部分GCC版本在其内部产生未初始化警告
+		QBOT_TARGET_AVX512 inline float hsum_avx512(const __m512 v) noexcept
+		{
+			alignas(64) float lanes[16];
+			_mm512_store_ps(lanes, v);
+			float res = 0.0f;
+			for (const auto lane : lanes)
+			{
+				res += lane;
+			}
+			return res;
+		}
+		// 尾部用掩码加载, 不需要标量循环
+		template <std::size_t D>
+		QBOT_TARGET_AVX512 inline float l2_sqr_avx512(const float* a, const float* b, const std::size_t d) noexcept
+		{
+			const std::size_t n = D == 0 ? d : D;
+			__m512 s0 = _mm512_setzero_ps();
+			__m512 s1 = _mm512_setzero_ps();
+			std::size_t i = 0;
+			for (; i + 32 <= n; i += 32)
+			{
+				const __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+				const __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+				s0 = _mm512_fmadd_ps(d0, d0, s0);
+				s1 = _mm512_fmadd_ps(d1, d1, s1);
+			}
+			for (; i < n; i += 16)
+			{
+				const auto mask = n - i >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << (n - i)) - 1);
+				const __m512 d0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i));
+				s0 = _mm512_fmadd_ps(d0, d0, s0);
+			}
+			return hsum_avx512(_mm512_add_ps(s0, s1));
+		}
+		template <std::size_t D>
+		QBOT_TARGET_AVX512 inline float inner_product_avx512(const float* a, const float* b, const std::size_t d) noexcept
+		{
+			const std::size_t n = D == 0 ? d : D;
+			__m512 s0 = _mm512_setzero_ps();
+			__m512 s1 = _mm512_setzero_ps();
+			std::size_t i = 0;
+			for (; i + 32 <= n; i += 32)
+			{
+				s0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s0);
+				s1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), s1);
+			}
+			for (; i < n; i += 16)
+			{
+				const auto mask = n - i >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << (n - i)) - 1);
+				s0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, a + i), _mm512_maskz_loadu_ps(mask, b + i), s0);
+			}
+			return hsum_avx512(_mm512_add_ps(s0, s1));
+		}
+		QBOT_TARGET_AVX512 inline void scale_avx512(float* v, const std::size_t d, const float factor) noexcept
+		{
+			const __m512 f = _mm512_set1_ps(factor);
+			for (std::size_t i = 0; i < d; i += 16)
+			{
+				const auto mask = d - i >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << (d - i)) - 1);
+				_mm512_mask_storeu_ps(v + i, mask, _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, v + i), f));
+			}
+		}
+#endif
+
+		using distance_func = float(*)(const float*, const float*, std::size_t) noexcept;
+		using scale_func = void(*)(float*, std::size_t, float) noexcept;
+
+		// 按维度分派到固定长度的特化
+#define QBOT_SIMD_DISPATCH_DIMENSION(kernel)                                               \
+		[](const float* a, const float* b, const std::size_t d) noexcept -> float      \
+		{                                                                              \
+			switch (d)                                                                 \
+			{                                                                          \
+			case 384: return kernel<384>(a, b, d);                                     \
+			case 768: return kernel<768>(a, b, d);                                     \
+			case 1024: return kernel<1024>(a, b, d);                                   \
+			default: return kernel<0>(a, b, d);                                        \
+			}                                                                          \
+		}
+
+		struct kernels
+		{
+			level lvl;
+			distance_func l2_sqr;
+			distance_func inner_product;
+			scale_func scale;
+		};
+
+		inline kernels make_kernels(const level lvl) noexcept
+		{
+			switch (lvl)
+			{
+#if QBOT_SIMD_X86
+			case level::avx512:
+				return { level::avx512, QBOT_SIMD_DISPATCH_DIMENSION(l2_sqr_avx512), QBOT_SIMD_DISPATCH_DIMENSION(inner_product_avx512), scale_avx512 };
+			case level::avx2:
+				return { level::avx2, QBOT_SIMD_DISPATCH_DIMENSION(l2_sqr_avx2), QBOT_SIMD_DISPATCH_DIMENSION(inner_product_avx2), scale_avx2 };
+#endif
+			default:
+				return { level::scalar, QBOT_SIMD_DISPATCH_DIMENSION(l2_sqr_scalar), QBOT_SIMD_DISPATCH_DIMENSION(inner_product_scalar), scale_scalar };
+			}
+		}
+#undef QBOT_SIMD_DISPATCH_DIMENSION
+
+		inline level detect() noexcept
+		{
+#if QBOT_SIMD_X86
+#if defined(_MSC_VER)
+			int info[4];
+			__cpuid(info, 1);
+			const bool osxsave = (info[2] & (1 << 27)) != 0;
+			const bool fma = (info[2] & (1 << 12)) != 0;
+			if (!osxsave)
+			{
+				return level::scalar;
+			}
+			const auto xcr0 = _xgetbv(0);
+			__cpuidex(info, 7, 0);
+			const bool avx2 = fma && (info[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+			const bool avx512 = (info[1] & (1 << 16)) != 0 && (xcr0 & 0xE6) == 0xE6;
+#else
+			__builtin_cpu_init();
+			const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+			const bool avx512 = __builtin_cpu_supports("avx512f");
+#endif
+			if (avx512)
+			{
+				return level::avx512;
+			}
+			if (avx2)
+			{
+				return level::avx2;
+			}
+#endif
+			return level::scalar;
+		}
+
+		inline kernels& active() noexcept
+		{
+			static kernels res = make_kernels(detect());
+			return res;
+		}
+	}
+
+	// CPU支持的最高指令集
+	inline level detected_level() noexcept
+	{
+		static const level res = detail::detect();
+		return res;
+	}
+	inline level active_level() noexcept
+	{
+		return detail::active().lvl;
+	}
+	// 切换实现(例如对比基准), 高于CPU支持的级别时使用支持的最高级别; 应在没有并发搜索时调用
+	inline void set_level(const level lvl) noexcept
+	{
+		detail::active() = detail::make_kernels(lvl > detected_level() ? detected_level() : lvl);
+	}
+	inline const char* level_name(const level lvl) noexcept
+	{
+		switch (lvl)
+		{
+		case level::avx512: return "avx512";
+		case level::avx2: return "avx2";
+		default: return "scalar";
+		}
+	}
+
+	// 平方L2距离
+	inline float l2_sqr(const float* a, const float* b, const std::size_t d) noexcept
+	{
+		return detail::active().l2_sqr(a, b, d);
+	}
+	inline float inner_product(const float* a, const float* b, const std::size_t d) noexcept
+	{
+		return detail::active().inner_product(a, b, d);
+	}
+	// 原地归一化为单位向量, 零向量保持不变
+	inline void normalize(float* v, const std::size_t d) noexcept
+	{
+		const auto& k = detail::active();
+		const float norm = k.inner_product(v, v, d);
+		if (norm > 0.0f)
+		{
+			k.scale(v, d, 1.0f / std::sqrt(norm));
+		}
+	}
+	inline void normalize_batch(float* v, const std::size_t n, const std::size_t d) noexcept
+	{
+		for (std::size_t i = 0; i < n; i++)
+		{
+			normalize(v + i * d, d);
+		}
+	}
+}
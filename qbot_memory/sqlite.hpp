@@ -1,12 +1,17 @@
 #pragma once
 
 #include "exception.hpp"
+#include "trace.hpp"
+#include <algorithm>
 #include <any>
 #include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <deque>
 #include <format>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <sqlite3.h>
 #include <stdexcept>
 #include <string>
@@ -55,6 +60,152 @@ namespace memory::sqlite
 	using exec_callback_func_ptr = int(void*, int, char**, char**);
 	using exec_callback_func = std::function<exec_callback_func_ptr>;
 
+	// 同一SQL文本的所有执行的累计, 计数来自sqlite3_stmt_status
+	struct statement_profile
+	{
+		std::string sql;
+		std::uint64_t calls = 0;
+		double total_ms = 0.0;
+		double max_ms = 0.0;
+		std::uint64_t fullscan_steps = 0; // 全表扫描的步数, 持续增长通常意味着缺少索引
+		std::uint64_t sorts = 0;
+		std::uint64_t autoindexes = 0;    // 临时自动索引插入的行数
+		std::uint64_t vm_steps = 0;
+	};
+
+	// 一次超过阈值的执行
+	struct slow_query
+	{
+		std::string sql;
+		std::string expanded_sql; // 绑定参数已代入
+		double ms = 0.0;
+		std::uint64_t fullscan_steps = 0;
+		std::uint64_t sorts = 0;
+		std::uint64_t autoindexes = 0;
+		std::uint64_t vm_steps = 0;
+		std::string query_plan;   // 读取慢查询日志时生成的EXPLAIN QUERY PLAN
+	};
+
+	namespace detail
+	{
+		// sqlite3_trace_v2的SQLITE_TRACE_PROFILE回调, 在执行语句的线程上调用
+		// 回调中只做计数与复制SQL, 不在连接上执行其他语句
+		class profiler
+		{
+		public:
+			static constexpr std::size_t k_max_statements = 4096; // 超出后的SQL文本合并到同一项, 防止动态SQL无限增长
+
+			profiler(const std::chrono::nanoseconds slow_threshold, const std::size_t slow_capacity)
+				: m_slow_threshold{ slow_threshold }, m_slow_capacity{ slow_capacity }
+			{
+			}
+
+			static int callback(unsigned type, void* context, void* p, void* x)
+			{
+				if (type == SQLITE_TRACE_PROFILE && !t_suspended)
+				{
+					static_cast<profiler*>(context)->on_profile(static_cast<sqlite3_stmt*>(p), *static_cast<sqlite3_int64*>(x));
+				}
+				return 0;
+			}
+
+			std::vector<statement_profile> statements() const
+			{
+				std::vector<statement_profile> res;
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					res.reserve(m_statements.size());
+					for (const auto& [sql, profile] : m_statements)
+					{
+						res.emplace_back(profile);
+					}
+				}
+				std::ranges::sort(res, std::ranges::greater{}, &statement_profile::total_ms);
+				return res;
+			}
+			std::vector<slow_query> slow_queries() const
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				return { m_slow.begin(), m_slow.end() };
+			}
+			void reset()
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_statements.clear();
+				m_slow.clear();
+			}
+
+			// 作用域内当前线程执行的语句不计入统计, 用于生成查询计划
+			class suspend
+			{
+			public:
+				suspend() noexcept : m_previous{ t_suspended } { t_suspended = true; }
+				~suspend() { t_suspended = m_previous; }
+				suspend(const suspend&) = delete;
+				suspend& operator=(const suspend&) = delete;
+			private:
+				bool m_previous;
+			};
+		private:
+			static inline thread_local bool t_suspended = false;
+
+			const std::chrono::nanoseconds m_slow_threshold;
+			const std::size_t m_slow_capacity;
+			mutable std::mutex m_mutex;
+			std::unordered_map<std::string, statement_profile> m_statements;
+			std::deque<slow_query> m_slow;
+
+			void on_profile(sqlite3_stmt* stmt, const sqlite3_int64 ns)
+			{
+				// 读取后清零, 使计数只对应本次执行
+				const auto fullscan_steps = static_cast<std::uint64_t>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1));
+				const auto sorts = static_cast<std::uint64_t>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1));
+				const auto autoindexes = static_cast<std::uint64_t>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1));
+				const auto vm_steps = static_cast<std::uint64_t>(sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1));
+				const char* sql = sqlite3_sql(stmt);
+				const std::string_view sql_view = sql == nullptr ? std::string_view{} : std::string_view{ sql };
+				const double ms = static_cast<double>(ns) / 1e6;
+
+				std::string expanded;
+				const bool slow = std::chrono::nanoseconds(ns) >= m_slow_threshold;
+				if (slow)
+				{
+					if (char* expanded_sql = sqlite3_expanded_sql(stmt))
+					{
+						expanded = expanded_sql;
+						sqlite3_free(expanded_sql);
+					}
+				}
+
+				std::lock_guard<std::mutex> lock(m_mutex);
+				auto it = m_statements.find(std::string(sql_view));
+				if (it == m_statements.end())
+				{
+					const auto key = m_statements.size() < k_max_statements ? std::string(sql_view) : std::string("<其他>");
+					it = m_statements.try_emplace(key).first;
+					it->second.sql = key;
+				}
+				auto& profile = it->second;
+				profile.calls++;
+				profile.total_ms += ms;
+				profile.max_ms = std::max(profile.max_ms, ms);
+				profile.fullscan_steps += fullscan_steps;
+				profile.sorts += sorts;
+				profile.autoindexes += autoindexes;
+				profile.vm_steps += vm_steps;
+
+				if (slow && m_slow_capacity != 0)
+				{
+					if (m_slow.size() >= m_slow_capacity)
+					{
+						m_slow.pop_front();
+					}
+					m_slow.emplace_back(std::string(sql_view), std::move(expanded), ms, fullscan_steps, sorts, autoindexes, vm_steps, std::string{});
+				}
+			}
+		};
+	}
+
 	class database
 	{
 	public:
@@ -62,6 +213,11 @@ namespace memory::sqlite
 		{
 			open(path);
 		}
+		// flags为sqlite3_open_v2的打开标志, 例如SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX
+		database(std::string_view path, const int flags)
+		{
+			open(path, flags);
+		}
 		~database()
 		{
 			try
@@ -74,12 +230,14 @@ namespace memory::sqlite
 		database(database&& _That) noexcept
 		{
 			this->m_db = std::move(_That.m_db);
+			this->m_profiler = std::move(_That.m_profiler);
 			_That.m_db = nullptr;
 		}
 		database& operator=(const database& _That) = delete;
 		database& operator=(database&& _That) noexcept
 		{
 			this->m_db = std::move(_That.m_db);
+			this->m_profiler = std::move(_That.m_profiler);
 			_That.m_db = nullptr;
 			return *this;
 		}
@@ -93,6 +251,15 @@ namespace memory::sqlite
 				return;
 			}
 		}
+		void open(std::string_view path, const int flags)
+		{
+			if (sqlite3_open_v2(path.data(), &m_db, flags, nullptr) != SQLITE_OK)
+			{
+				std::string errMsg = m_db == nullptr ? "内存不足" : errmsg();
+				close();
+				throw exception::bad_database(std::format("数据库连接打开时: {}", errMsg));
+			}
+		}
 		void close()
 		{
 			if (m_db != nullptr)
@@ -108,6 +275,8 @@ namespace memory::sqlite
 		}
 		int execute(const std::string& sql, exec_callback_func callback_func = nullptr, void* user_ptr = nullptr) const
 		{
+			trace::span span("sqlite::execute", "sqlite");
+			span.arg("sql", sql);
 			char* errMsg = nullptr;
 			int res;
 			if (res = sqlite3_exec(m_db, sql.c_str(), *(callback_func.target<exec_callback_func_ptr>()), user_ptr, &errMsg) != SQLITE_OK)
@@ -151,6 +320,62 @@ namespace memory::sqlite
 		{
 			return sqlite3_last_insert_rowid(m_db);
 		}
+		sqlite_int64 total_changes()
+		{
+			return sqlite3_total_changes64(m_db);
+		}
+		void busy_timeout(const int ms)
+		{
+			if (sqlite3_busy_timeout(m_db, ms) != SQLITE_OK)
+			{
+				throw exception::bad_database(std::format("无法设置忙等待超时: {}", errmsg()));
+			}
+		}
+		// db_name不存在时也返回false
+		bool readonly(std::string_view db_name = "main")
+		{
+			return sqlite3_db_readonly(m_db, std::string(db_name).c_str()) == 1;
+		}
+		// 以SQLITE_OPEN_NOMUTEX打开的连接没有互斥量, 需要调用方保证不被多个线程同时使用
+		bool serialized()
+		{
+			return sqlite3_db_mutex(m_db) != nullptr;
+		}
+		// 读取返回单个文本的PRAGMA, 例如journal_mode
+		std::string pragma_text(std::string_view pragma, std::string_view db_name = "main")
+		{
+			const auto sql = std::format("PRAGMA {}.{};", db_name, pragma);
+			sqlite3_stmt* stmt = nullptr;
+			if (sqlite3_prepare_v2(m_db, sql.c_str(), static_cast<int>(sql.size()), &stmt, nullptr) != SQLITE_OK)
+			{
+				throw exception::sqlite_call_error(std::format("读取PRAGMA失败: {}\nSQL: {}", errmsg(), sql));
+			}
+			std::string res;
+			if (sqlite3_step(stmt) == SQLITE_ROW)
+			{
+				const auto text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+				res = text == nullptr ? "" : text;
+			}
+			sqlite3_finalize(stmt);
+			return res;
+		}
+		// 读取返回单个整数的PRAGMA, 例如page_count/freelist_count/auto_vacuum
+		std::int64_t pragma_int(std::string_view pragma, std::string_view db_name = "main")
+		{
+			const auto sql = std::format("PRAGMA {}.{};", db_name, pragma);
+			sqlite3_stmt* stmt = nullptr;
+			if (sqlite3_prepare_v2(m_db, sql.c_str(), static_cast<int>(sql.size()), &stmt, nullptr) != SQLITE_OK)
+			{
+				throw exception::sqlite_call_error(std::format("读取PRAGMA失败: {}\nSQL: {}", errmsg(), sql));
+			}
+			std::int64_t res = 0;
+			if (sqlite3_step(stmt) == SQLITE_ROW)
+			{
+				res = sqlite3_column_int64(stmt, 0);
+			}
+			sqlite3_finalize(stmt);
+			return res;
+		}
 		const char* errmsg() const
 		{
 			return sqlite3_errmsg(m_db);
@@ -198,6 +423,88 @@ namespace memory::sqlite
 				throw exception::bad_database(std::format("无法设置WAL自动检查点: {}\nSQL: {}", errMsg, sql));
 			}
 		}
+		// sqlite3_db_status的当前值, op为SQLITE_DBSTATUS_*, reset为true时读取后清零
+		int db_status(const int op, const bool reset = false)
+		{
+			int current = 0;
+			int highwater = 0;
+			if (sqlite3_db_status(m_db, op, &current, &highwater, reset ? 1 : 0) != SQLITE_OK)
+			{
+				throw exception::bad_database(std::format("读取数据库状态失败: {}", op));
+			}
+			return current;
+		}
+		// 开启语句级性能分析: 按SQL文本累计耗时与sqlite3_stmt_status计数, 耗时不小于slow_threshold的执行记入慢查询日志
+		// 慢查询日志最多保留slow_capacity条, 超出时丢弃最早的; 重复开启会清空已有数据
+		void enable_profiling(const std::chrono::nanoseconds slow_threshold, const std::size_t slow_capacity = 128)
+		{
+			auto profiler = std::make_unique<detail::profiler>(slow_threshold, slow_capacity);
+			if (sqlite3_trace_v2(m_db, SQLITE_TRACE_PROFILE, detail::profiler::callback, profiler.get()) != SQLITE_OK)
+			{
+				throw exception::bad_database(std::format("开启语句性能分析失败: {}", errmsg()));
+			}
+			m_profiler = std::move(profiler);
+		}
+		void disable_profiling()
+		{
+			sqlite3_trace_v2(m_db, 0, nullptr, nullptr);
+			m_profiler.reset();
+		}
+		bool profiling() const noexcept
+		{
+			return m_profiler != nullptr;
+		}
+		// 按累计耗时降序
+		std::vector<statement_profile> statement_profiles() const
+		{
+			return m_profiler ? m_profiler->statements() : std::vector<statement_profile>{};
+		}
+		// 查询计划在读取时生成, 反映的是当前的表结构与统计信息; 需要独占连接, 调用方负责加锁
+		std::vector<slow_query> slow_queries()
+		{
+			if (!m_profiler)
+			{
+				return {};
+			}
+			auto res = m_profiler->slow_queries();
+			for (auto& i : res)
+			{
+				i.query_plan = explain_query_plan(i.expanded_sql.empty() ? i.sql : i.expanded_sql);
+			}
+			return res;
+		}
+		void reset_profiling()
+		{
+			if (m_profiler)
+			{
+				m_profiler->reset();
+			}
+		}
+		// EXPLAIN QUERY PLAN的结果, 每行一个节点, 按层级缩进
+		std::string explain_query_plan(std::string_view sql)
+		{
+			detail::profiler::suspend suspend;
+			const auto explain = std::format("EXPLAIN QUERY PLAN {}", sql);
+			sqlite3_stmt* stmt = nullptr;
+			if (sqlite3_prepare_v2(m_db, explain.c_str(), static_cast<int>(explain.size()), &stmt, nullptr) != SQLITE_OK)
+			{
+				return std::format("无法生成查询计划: {}", errmsg());
+			}
+			std::string res;
+			std::unordered_map<int, int> depth;
+			while (sqlite3_step(stmt) == SQLITE_ROW)
+			{
+				const auto id = sqlite3_column_int(stmt, 0);
+				const auto parent = sqlite3_column_int(stmt, 1);
+				const auto it = depth.find(parent);
+				const auto level = it == depth.end() ? 0 : it->second + 1;
+				depth[id] = level;
+				const auto detail = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 3));
+				res += std::format("{:{}}{}\n", "", level * 2, detail == nullptr ? "" : detail);
+			}
+			sqlite3_finalize(stmt);
+			return res;
+		}
 		void wal_checkpoint(checkpoint::checkpoint moed, std::string_view db_name, int* log, int* ckpt)
 		{
 			auto res = sqlite3_wal_checkpoint_v2(m_db, db_name.data(),static_cast<int>(moed), log, ckpt);
@@ -214,6 +521,72 @@ namespace memory::sqlite
 		}
 	private:
 		sqlite3* m_db;
+		std::unique_ptr<detail::profiler> m_profiler;
+	};
+
+	// sqlite3_backup的封装: 把source连接的db_name库按页复制到destination连接的main库
+	// 两次step之间源库可以被继续写入; 通过同一source连接的写入会自动同步到备份, 其他连接的写入会使复制从头开始
+	// 调用方需保证step时没有其他线程同时使用source连接
+	class backup
+	{
+	public:
+		backup(database& destination, database& source, const std::string& db_name = "main")
+			: m_destination{ destination.get() }
+		{
+			m_backup = sqlite3_backup_init(m_destination, "main", source.get(), db_name.c_str());
+			if (m_backup == nullptr)
+			{
+				throw exception::bad_database(std::format("无法开始在线备份: {}", sqlite3_errmsg(m_destination)));
+			}
+		}
+		~backup()
+		{
+			if (m_backup != nullptr)
+			{
+				sqlite3_backup_finish(m_backup);
+			}
+		}
+		backup(const backup&) = delete;
+		backup& operator=(const backup&) = delete;
+
+		// 复制至多pages页, pages为负时复制剩余的全部页; 全部复制完成时返回true
+		// 源库或目标库暂时被锁时返回false, 稍后再次调用即可
+		bool step(const int pages)
+		{
+			trace::span span("sqlite::backup_step", "sqlite");
+			const auto res = sqlite3_backup_step(m_backup, pages);
+			switch (res)
+			{
+			case SQLITE_DONE:
+				return true;
+			case SQLITE_OK:
+			case SQLITE_BUSY:
+			case SQLITE_LOCKED:
+				return false;
+			default:
+				throw exception::bad_database(std::format("在线备份复制失败: {}", sqlite3_errstr(res)));
+			}
+		}
+		// 上一次step之后尚未复制的页数与总页数
+		int remaining() const noexcept
+		{
+			return sqlite3_backup_remaining(m_backup);
+		}
+		int pagecount() const noexcept
+		{
+			return sqlite3_backup_pagecount(m_backup);
+		}
+		void finish()
+		{
+			const auto res = sqlite3_backup_finish(std::exchange(m_backup, nullptr));
+			if (res != SQLITE_OK)
+			{
+				throw exception::bad_database(std::format("结束在线备份时: {}", sqlite3_errmsg(m_destination)));
+			}
+		}
+	private:
+		sqlite3* m_destination;
+		sqlite3_backup* m_backup = nullptr;
 	};
 
 	class stmt_buffer
@@ -618,6 +991,11 @@ namespace memory::sqlite
 		int step(sqlite3_stmt*& in)
 		{
 			in = m_stmt;
+			trace::span span("sqlite::step", "sqlite");
+			if (span)
+			{
+				span.arg("sql", sqlite3_sql(m_stmt));
+			}
 			const auto res = sqlite3_step(m_stmt);
 			switch (res)
 			{
@@ -634,6 +1012,11 @@ namespace memory::sqlite
 
 		int step()
 		{
+			trace::span span("sqlite::step", "sqlite");
+			if (span)
+			{
+				span.arg("sql", sqlite3_sql(m_stmt));
+			}
 			const auto res = sqlite3_step(m_stmt);
 			switch (res)
 			{
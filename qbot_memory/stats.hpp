@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace memory::stats
+{
+	// 被计时的阶段
+	enum class stage
+	{
+		embed,        // 调用向量回调
+		index_search, // FAISS搜索
+		hydrate,      // 按搜索结果回表
+		commit,       // 提交事务
+		index_save,   // 保存FAISS索引
+		rerank,       // 按全精度向量重算候选距离
+	};
+	inline constexpr std::size_t stage_count = 6;
+	inline constexpr const char* stage_names[stage_count] = { "embed", "index_search", "hydrate", "commit", "index_save", "rerank" };
+
+	enum class counter
+	{
+		rows_inserted,     // 新增的行
+		rows_deleted,      // 被遗忘删除的行
+		duplicates_merged, // 插入时被合并到已有行的重复消息
+		embed_texts,       // 生成向量的文本数
+		searches,          // 向量搜索的查询数
+		hits,              // 向量搜索返回的行数
+		hydrate_misses,    // 索引命中但行已不存在
+	};
+	inline constexpr std::size_t counter_count = 7;
+	inline constexpr const char* counter_names[counter_count] = { "rows_inserted", "rows_deleted", "duplicates_merged", "embed_texts", "searches", "hits", "hydrate_misses" };
+
+	// 无锁的对数-线性直方图, 单位纳秒
+	// 每个2的幂区间再等分为4个桶, 分位数的相对误差不超过1/4
+	class histogram
+	{
+	public:
+		static constexpr std::size_t k_sub_bits = 2;
+		static constexpr std::size_t k_sub_buckets = std::size_t{ 1 } << k_sub_bits;
+		static constexpr std::size_t k_buckets = 64 * k_sub_buckets;
+
+		void record(const std::uint64_t ns) noexcept
+		{
+			m_buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+			m_count.fetch_add(1, std::memory_order_relaxed);
+			m_sum.fetch_add(ns, std::memory_order_relaxed);
+			auto max = m_max.load(std::memory_order_relaxed);
+			while (ns > max && !m_max.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+			{
+			}
+		}
+		void reset() noexcept
+		{
+			for (auto& i : m_buckets)
+			{
+				i.store(0, std::memory_order_relaxed);
+			}
+			m_count.store(0, std::memory_order_relaxed);
+			m_sum.store(0, std::memory_order_relaxed);
+			m_max.store(0, std::memory_order_relaxed);
+		}
+		// 与并发的record之间没有同步, 快照内各字段可能相差正在进行的几次记录
+		void add_to(std::array<std::uint64_t, k_buckets>& buckets, std::uint64_t& count, std::uint64_t& sum, std::uint64_t& max) const noexcept
+		{
+			for (std::size_t i = 0; i < k_buckets; i++)
+			{
+				buckets[i] += m_buckets[i].load(std::memory_order_relaxed);
+			}
+			count += m_count.load(std::memory_order_relaxed);
+			sum += m_sum.load(std::memory_order_relaxed);
+			max = std::max(max, m_max.load(std::memory_order_relaxed));
+		}
+
+		static std::size_t bucket(const std::uint64_t ns) noexcept
+		{
+			if (ns < k_sub_buckets)
+			{
+				return static_cast<std::size_t>(ns);
+			}
+			const auto exponent = static_cast<std::size_t>(std::bit_width(ns)) - 1;
+			const auto sub = static_cast<std::size_t>(ns >> (exponent - k_sub_bits)) & (k_sub_buckets - 1);
+			return std::min((exponent - k_sub_bits + 1) * k_sub_buckets + sub, k_buckets - 1);
+		}
+		// 桶的上界(不含)
+		static std::uint64_t bucket_upper(const std::size_t index) noexcept
+		{
+			if (index < k_sub_buckets)
+			{
+				return index + 1;
+			}
+			const auto exponent = index / k_sub_buckets + k_sub_bits - 1;
+			const auto sub = index % k_sub_buckets;
+			if (exponent >= 63 && sub + 1 == k_sub_buckets)
+			{
+				return UINT64_MAX;
+			}
+			return (std::uint64_t{ 1 } << exponent) + ((sub + 1) << (exponent - k_sub_bits));
+		}
+	private:
+		std::array<std::atomic<std::uint64_t>, k_buckets> m_buckets{};
+		std::atomic<std::uint64_t> m_count{ 0 };
+		std::atomic<std::uint64_t> m_sum{ 0 };
+		std::atomic<std::uint64_t> m_max{ 0 };
+	};
+
+	struct stage_snapshot
+	{
+		std::string name;
+		std::uint64_t count = 0;
+		double total_us = 0.0;
+		double mean_us = 0.0;
+		double p50_us = 0.0;
+		double p99_us = 0.0;
+		double p999_us = 0.0;
+		double max_us = 0.0;
+	};
+
+	struct snapshot
+	{
+		std::vector<stage_snapshot> stages;
+		std::map<std::string, std::uint64_t> counters;
+	};
+
+	// 每个表一个, 数据库也有一个汇总所有表; 记录时同时写入parent
+	class recorder
+	{
+	public:
+		explicit recorder(recorder* parent = nullptr) noexcept : m_parent{ parent } {}
+		recorder(const recorder&) = delete;
+		recorder& operator=(const recorder&) = delete;
+
+		void record(const stage s, const std::chrono::steady_clock::duration elapsed) noexcept
+		{
+			const auto ns = static_cast<std::uint64_t>(std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), 0));
+			for (auto r = this; r != nullptr; r = r->m_parent)
+			{
+				r->m_stages[static_cast<std::size_t>(s)].record(ns);
+			}
+		}
+		void add(const counter c, const std::uint64_t n = 1) noexcept
+		{
+			for (auto r = this; r != nullptr; r = r->m_parent)
+			{
+				r->m_counters[static_cast<std::size_t>(c)].fetch_add(n, std::memory_order_relaxed);
+			}
+		}
+		// 只清空自己, 不影响parent
+		void reset() noexcept
+		{
+			for (auto& i : m_stages)
+			{
+				i.reset();
+			}
+			for (auto& i : m_counters)
+			{
+				i.store(0, std::memory_order_relaxed);
+			}
+		}
+		snapshot take() const
+		{
+			snapshot res;
+			for (std::size_t s = 0; s < stage_count; s++)
+			{
+				std::array<std::uint64_t, histogram::k_buckets> buckets{};
+				std::uint64_t count = 0;
+				std::uint64_t sum = 0;
+				std::uint64_t max = 0;
+				m_stages[s].add_to(buckets, count, sum, max);
+
+				auto percentile = [&](const double p) -> double
+					{
+						if (count == 0)
+						{
+							return 0.0;
+						}
+						const auto rank = static_cast<std::uint64_t>(p * static_cast<double>(count - 1)) + 1;
+						std::uint64_t seen = 0;
+						for (std::size_t i = 0; i < histogram::k_buckets; i++)
+						{
+							seen += buckets[i];
+							if (seen >= rank)
+							{
+								return static_cast<double>(std::min(histogram::bucket_upper(i), max)) / 1e3;
+							}
+						}
+						return static_cast<double>(max) / 1e3;
+					};
+				res.stages.emplace_back(stage_names[s],
+					count,
+					static_cast<double>(sum) / 1e3,
+					count == 0 ? 0.0 : static_cast<double>(sum) / 1e3 / static_cast<double>(count),
+					percentile(0.50),
+					percentile(0.99),
+					percentile(0.999),
+					static_cast<double>(max) / 1e3);
+			}
+			for (std::size_t c = 0; c < counter_count; c++)
+			{
+				res.counters[counter_names[c]] = m_counters[c].load(std::memory_order_relaxed);
+			}
+			return res;
+		}
+	private:
+		recorder* m_parent;
+		std::array<histogram, stage_count> m_stages;
+		std::array<std::atomic<std::uint64_t>, counter_count> m_counters{};
+	};
+
+	// 作用域计时, 析构时记录
+	class scoped_timer
+	{
+	public:
+		scoped_timer(recorder& r, const stage s) noexcept
+			: m_recorder{ r }, m_stage{ s }, m_start{ std::chrono::steady_clock::now() }
+		{
+		}
+		~scoped_timer()
+		{
+			m_recorder.record(m_stage, std::chrono::steady_clock::now() - m_start);
+		}
+		scoped_timer(const scoped_timer&) = delete;
+		scoped_timer& operator=(const scoped_timer&) = delete;
+	private:
+		recorder& m_recorder;
+		stage m_stage;
+		std::chrono::steady_clock::time_point m_start;
+	};
+}
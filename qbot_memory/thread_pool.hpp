@@ -1,10 +1,19 @@
 #pragma once
+#include "exception.hpp"
+#include "trace.hpp"
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <format>
+#include <exception>
 #include <functional>
 #include <future>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <optional>
 #include <thread>
 #include <utility>
 #include <vector>
@@ -12,82 +21,441 @@
 
 namespace memory::thread_pool
 {
-	template <std::size_t threads = 4, std::size_t max_tasks = 64>
+	// 任务优先级, 空闲的工作线程总是先取交互任务, 没有交互任务时才执行后台任务
+	enum class priority
+	{
+		interactive = 0, // 交互任务, 例如搜索
+		background = 1   // 后台维护任务, 例如索引重建/检查点
+	};
+
+	inline constexpr std::size_t priority_count = 2;
+
+	namespace detail
+	{
+		// 线程池的共享状态, 由线程池对象与各工作线程共同持有
+		// 线程池在自己的工作线程上被析构(例如任务持有线程池所有者的最后一个引用)时, 工作线程仍能安全访问这些状态
+		class scheduler
+		{
+		public:
+			explicit scheduler(std::size_t threads, std::size_t max_tasks)
+				: m_max_tasks{ max_tasks == 0 ? 1 : max_tasks },
+				m_queues(threads == 0 ? 1 : threads)
+			{
+			}
+
+			void stop(bool drain)
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_discard = !drain;
+					m_stop = true;
+				}
+				m_not_full.notify_all();
+				m_condition.notify_all();
+			}
+			void clear()
+			{
+				for (auto& queue : m_queues)
+				{
+					std::lock_guard<std::mutex> lock(queue.mutex);
+					for (auto& tasks : queue.tasks)
+					{
+						tasks.clear();
+					}
+				}
+				m_pending = 0;
+			}
+			std::size_t size() const noexcept
+			{
+				return m_pending;
+			}
+			std::size_t threads() const noexcept
+			{
+				return m_queues.size();
+			}
+			std::size_t max_tasks() const noexcept
+			{
+				return m_max_tasks;
+			}
+
+			struct worker_queue
+			{
+				std::mutex mutex;
+				std::deque<std::function<void()>> tasks[priority_count];
+			};
+
+			const std::size_t m_max_tasks;
+			std::vector<worker_queue> m_queues;
+			std::atomic<std::size_t> m_next_queue{ 0 };
+
+			// 排队中的任务数, 入队前占位, 出队时释放
+			std::atomic<std::size_t> m_pending{ 0 };
+			// 正在休眠的工作线程数/正在等待空位的提交者数, 为0时入队/出队无需加锁通知
+			std::atomic<std::size_t> m_sleeping{ 0 };
+			std::atomic<std::size_t> m_blocked{ 0 };
+			std::atomic_bool m_discard{ false };
+
+			// 同步原语, 只在休眠/唤醒时使用
+			std::atomic_bool m_stop{ false };
+			std::mutex m_mutex;
+			std::condition_variable m_condition;
+			std::condition_variable m_not_full;
+
+			// 当前线程所属的调度器与工作线程序号, 用于把工作线程内提交的任务放进自己的队列
+			static inline thread_local scheduler* t_scheduler = nullptr;
+			static inline thread_local std::size_t t_index = 0;
+
+			bool on_worker_thread() const noexcept
+			{
+				return t_scheduler == this;
+			}
+
+			bool try_acquire_slot() noexcept
+			{
+				auto pending = m_pending.load();
+				while (pending < m_max_tasks)
+				{
+					if (m_pending.compare_exchange_weak(pending, pending + 1))
+					{
+						return true;
+					}
+				}
+				return false;
+			}
+
+			// 占用一个排队名额, deadline为空时无限等待; 工作线程内提交不受容量限制, 避免任务互相等待造成死锁
+			bool acquire_slot(const std::optional<std::chrono::steady_clock::time_point>& deadline)
+			{
+				if (on_worker_thread())
+				{
+					m_pending++;
+				}
+				else if (!try_acquire_slot())
+				{
+					std::unique_lock<std::mutex> lock(m_mutex);
+					m_blocked++;
+					auto ready = [this] { return m_stop || try_acquire_slot(); };
+					const bool acquired = deadline.has_value()
+						? m_not_full.wait_until(lock, *deadline, ready)
+						: (m_not_full.wait(lock, ready), true);
+					m_blocked--;
+					if (!acquired || m_stop)
+					{
+						// 谓词因m_stop返回时没有占到名额, 直接失败即可
+						return false;
+					}
+				}
+				// 先占名额再检查关闭标志: 工作线程只在没有占用名额时退出, 保证已接受的任务一定会被执行
+				if (m_stop)
+				{
+					release_slot();
+					return false;
+				}
+				return true;
+			}
+
+			void release_slot()
+			{
+				m_pending--;
+				if (m_blocked != 0)
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_not_full.notify_one();
+				}
+			}
+
+			std::future<void> push(std::function<void(void)> f, priority p)
+			{
+				auto promise = std::make_shared<std::promise<void>>();
+				auto future = promise->get_future();
+				auto func = [promise, f = std::move(f), ctx = trace::capture(), p]
+					{
+						trace::adopt adopt(ctx);
+						trace::span span(p == priority::interactive ? "thread_pool::task" : "thread_pool::background_task", "thread_pool");
+						try
+						{
+							f();
+							promise->set_value();
+						}
+						catch (...) { promise->set_exception(std::current_exception()); }
+					};
+				const auto index = on_worker_thread()
+					? t_index
+					: m_next_queue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+				{
+					auto& queue = m_queues[index];
+					std::lock_guard<std::mutex> lock(queue.mutex);
+					queue.tasks[static_cast<std::size_t>(p)].emplace_back(std::move(func));
+				}
+				if (m_sleeping != 0)
+				{
+					// 持锁通知, 避免工作线程在检查条件与进入等待之间错过唤醒
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_condition.notify_one();
+				}
+				return future;
+			}
+
+			std::optional<std::function<void()>> pop_local(std::size_t index, std::size_t level)
+			{
+				auto& queue = m_queues[index];
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				auto& tasks = queue.tasks[level];
+				if (tasks.empty())
+				{
+					return {};
+				}
+				auto task = std::move(tasks.back());
+				tasks.pop_back();
+				return task;
+			}
+
+			std::optional<std::function<void()>> steal(std::size_t index, std::size_t level)
+			{
+				const auto count = m_queues.size();
+				for (std::size_t offset = 1; offset < count; offset++)
+				{
+					auto& queue = m_queues[(index + offset) % count];
+					std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+					if (!lock.owns_lock())
+					{
+						continue;
+					}
+					auto& tasks = queue.tasks[level];
+					if (tasks.empty())
+					{
+						continue;
+					}
+					auto task = std::move(tasks.front());
+					tasks.pop_front();
+					return task;
+				}
+				return {};
+			}
+
+			std::optional<std::function<void()>> take(std::size_t index)
+			{
+				for (std::size_t level = 0; level < priority_count; level++)
+				{
+					if (auto task = pop_local(index, level))
+					{
+						return task;
+					}
+					if (auto task = steal(index, level))
+					{
+						return task;
+					}
+				}
+				return {};
+			}
+
+			void worker_func(std::size_t index)
+			{
+				t_scheduler = this;
+				t_index = index;
+				trace::set_thread_name(std::format("thread_pool worker {}", index));
+				while (!m_discard)
+				{
+					auto task = take(index);
+					if (!task)
+					{
+						if (m_pending != 0)
+						{
+							// 有名额被占用但没有取到任务: 任务正在入队或正被其他线程取走, 让出后重试
+							std::this_thread::yield();
+							continue;
+						}
+						std::unique_lock<std::mutex> lock(m_mutex);
+						if (m_stop && m_pending == 0)
+						{
+							return;
+						}
+						m_sleeping++;
+						m_condition.wait(lock, [this] { return m_stop || m_pending != 0; });
+						m_sleeping--;
+						continue;
+					}
+					release_slot();
+					(*task)();
+				}
+			}
+		};
+	}
+
+	// 每个工作线程持有自己的双端队列, 本线程从队尾取任务, 其他线程从队首窃取
+	// 队列容量满时enqueue阻塞等待(背压), try_enqueue/try_enqueue_for可以不阻塞或限时等待
+	// 析构时默认等待所有已入队任务执行完毕再退出
 	class thread_pool
 	{
 	public:
-		thread_pool() : m_stop{}, m_tasks_conut(0)
+		explicit thread_pool(std::size_t threads = default_threads(), std::size_t max_tasks = 1024)
+			: m_scheduler{ std::make_shared<detail::scheduler>(threads, max_tasks) }
 		{
-			for (size_t i = 0; i < threads; i++)
+			const auto count = m_scheduler->threads();
+			m_workers.reserve(count);
+			for (std::size_t i = 0; i < count; i++)
 			{
-				m_workers.emplace_back([this] { worker_func(); });
+				m_workers.emplace_back([scheduler = m_scheduler, i] { scheduler->worker_func(i); });
 			}
 		}
 		~thread_pool()
 		{
-			m_stop.test_and_set();
-			m_condition.notify_all();
+			shutdown(true);
 		}
+		thread_pool(const thread_pool& _That) = delete;
 		thread_pool(thread_pool&& _That) = delete;
+		thread_pool& operator=(const thread_pool& _That) = delete;
+		thread_pool& operator=(thread_pool&& _That) = delete;
+
+		// 队列已满时阻塞直到有空位, 线程池已关闭时抛出异常
+		std::future<void> enqueue(std::function<void(void)> f, priority p = priority::interactive)
+		{
+			if (!m_scheduler->acquire_slot(std::nullopt))
+			{
+				throw exception::runtime_error("线程池已关闭, 无法提交任务");
+			}
+			return m_scheduler->push(std::move(f), p);
+		}
 
-		std::future<void> enqueue(std::function<void(void)> f)
+		// 队列已满时最多等待timeout, 超时或线程池已关闭返回空的std::future
+		template <class Rep, class Period>
+		std::future<void> try_enqueue_for(std::function<void(void)> f, const std::chrono::duration<Rep, Period>& timeout, priority p = priority::interactive)
 		{
-			if (m_tasks_conut >= max_tasks)
+			if (!m_scheduler->acquire_slot(std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout)))
+			{
 				return {};
-			auto promise = std::make_shared<std::promise<void>>();
-			auto future = promise->get_future();
-			auto func = [promise, f]
+			}
+			return m_scheduler->push(std::move(f), p);
+		}
+
+		// 不阻塞, 队列已满或线程池已关闭返回空的std::future
+		std::future<void> try_enqueue(std::function<void(void)> f, priority p = priority::interactive)
+		{
+			return try_enqueue_for(std::move(f), std::chrono::nanoseconds::zero(), p);
+		}
+
+		// drain为true时等待所有已入队任务执行完毕, 否则丢弃未开始的任务(其future得到broken_promise)
+		void shutdown(bool drain = true)
+		{
+			std::lock_guard<std::mutex> lock(m_shutdown_mutex);
+			if (m_workers.empty())
+			{
+				return;
+			}
+			m_scheduler->stop(drain);
+			for (auto& worker : m_workers)
+			{
+				if (worker.get_id() == std::this_thread::get_id())
 				{
-					try
-					{
-						f();
-						promise->set_value();
-					}
-					catch (...) { promise->set_exception(std::current_exception()); }
-				};
+					// 在自己的工作线程上关闭时不能join自己, 分离后由该线程在任务结束后自行退出
+					worker.detach();
+				}
+			}
+			m_workers.clear();
+			if (!drain)
 			{
-				std::unique_lock<std::mutex> lock(m_mutex);
-				m_tasks_conut++;
-				m_tasks.emplace(func);
+				m_scheduler->clear();
 			}
-			m_condition.notify_one();
-			return future;
 		}
 
-		std::size_t size()
+		// 排队中(尚未开始执行)的任务数
+		std::size_t size() const noexcept
 		{
-			return m_tasks_conut;
+			return m_scheduler->size();
+		}
+		std::size_t threads() const noexcept
+		{
+			return m_scheduler->threads();
+		}
+		std::size_t max_tasks() const noexcept
+		{
+			return m_scheduler->max_tasks();
+		}
+
+		static std::size_t default_threads() noexcept
+		{
+			return std::max<std::size_t>(1, std::thread::hardware_concurrency());
 		}
 	private:
-		std::atomic_flag m_stop;
-		std::atomic<std::size_t> m_tasks_conut;
+		std::shared_ptr<detail::scheduler> m_scheduler;
 		std::vector<std::jthread> m_workers;
-		std::queue<std::function<void()>> m_tasks;
+		std::mutex m_shutdown_mutex;
+	};
 
-		// 同步原语
-		std::mutex m_mutex;
-		std::condition_variable m_condition;
+	// 把[0, count)分给线程池并发执行func(i), 调用线程也参与执行, 全部完成后返回
+	// 线程池繁忙或在工作线程内调用时, 未被领取的下标由调用线程自己完成, 不会因等待线程池而死锁
+	// parallelism为同时执行的最大线程数(含调用线程), 为0时使用线程池线程数+1; func抛出的第一个异常会在返回前重新抛出
+	template <class F>
+	void parallel_for(thread_pool& pool, const std::size_t count, F&& func, std::size_t parallelism = 0, priority p = priority::interactive)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+		if (parallelism == 0)
+		{
+			parallelism = pool.threads() + 1;
+		}
 
-		void worker_func(void)
+		struct state
 		{
-			while (true)
+			std::function<void(std::size_t)> func;
+			std::size_t count;
+			std::atomic<std::size_t> next{ 0 };
+			std::atomic<std::size_t> done{ 0 };
+			std::mutex mutex;
+			std::condition_variable condition;
+			std::exception_ptr exception;
+		};
+		auto st = std::make_shared<state>();
+		st->func = std::ref(func);
+		st->count = count;
+
+		// 晚于调用方返回才开始执行的辅助任务领不到下标, 不会再访问func
+		auto work = [](state& st)
 			{
-				std::function<void()> task;
+				while (true)
 				{
-					std::unique_lock<std::mutex> lock(this->m_mutex);
-					this->m_condition.wait(lock, [this] { return this->m_stop.test() || !this->m_tasks.empty(); });
-					if (this->m_stop.test())
+					const auto i = st.next++;
+					if (i >= st.count)
+					{
 						return;
-					task = std::move(this->m_tasks.front());
-					this->m_tasks.pop();
-				}
-				try
-				{
-					task();
+					}
+					try
+					{
+						st.func(i);
+					}
+					catch (...)
+					{
+						std::lock_guard<std::mutex> lock(st.mutex);
+						if (!st.exception)
+						{
+							st.exception = std::current_exception();
+						}
+					}
+					if (++st.done == st.count)
+					{
+						std::lock_guard<std::mutex> lock(st.mutex);
+						st.condition.notify_all();
+					}
 				}
-				catch (...) {}
-				m_tasks_conut--;
+			};
+
+		const auto helpers = std::min(parallelism, count) - 1;
+		for (std::size_t i = 0; i < helpers; i++)
+		{
+			if (!pool.try_enqueue([st, work] { work(*st); }, p).valid())
+			{
+				break;
 			}
 		}
-	};
+		work(*st);
+
+		std::unique_lock<std::mutex> lock(st->mutex);
+		st->condition.wait(lock, [&] { return st->done == st->count; });
+		if (st->exception)
+		{
+			std::rethrow_exception(st->exception);
+		}
+	}
 }
\ No newline at end of file
@@ -0,0 +1,437 @@
+#pragma once
+#include "exception.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// 请求级时间线追踪, 导出Chrome trace-event JSON, 可直接在Perfetto(ui.perfetto.dev)或chrome://tracing中打开
+//
+// 关闭时每个span只有一次relaxed原子读
+// 开启后按sample_rate对最外层span(请求)采样, 被采中请求的所有嵌套span都会记录, 未被采中的请求不产生任何事件
+// 线程池任务继承提交者的采样状态, 并用flow箭头连接提交点与执行点, 以便跨线程追踪同一个请求
+namespace memory::trace
+{
+	namespace detail
+	{
+		struct event
+		{
+			const char* name;
+			const char* category;
+			char phase;              // 'X'完整事件, 's'/'f'跨线程flow的起点/终点
+			std::uint64_t start_ns;
+			std::uint64_t duration_ns;
+			std::uint64_t flow_id;
+			std::string args;        // 已序列化的JSON对象成员, 不含外层花括号
+		};
+
+		// 每个线程一个, 线程退出后仍由registry持有直到被导出并清空
+		struct thread_buffer
+		{
+			std::mutex mutex;
+			std::vector<event> events;
+			std::uint64_t tid = 0;
+			std::string name;
+		};
+
+		inline std::chrono::steady_clock::time_point epoch() noexcept
+		{
+			static const auto res = std::chrono::steady_clock::now();
+			return res;
+		}
+		inline std::uint64_t now_ns() noexcept
+		{
+			return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch()).count());
+		}
+
+		class registry
+		{
+		public:
+			static registry& instance()
+			{
+				static registry res;
+				return res;
+			}
+
+			std::atomic_bool enabled{ false };
+			std::atomic<double> sample_rate{ 1.0 };
+			std::atomic<std::size_t> max_events{ 1'000'000 };
+			std::atomic<std::size_t> events{ 0 };
+			std::atomic<std::size_t> dropped{ 0 };
+			std::atomic<std::uint64_t> next_flow{ 1 };
+
+			std::shared_ptr<thread_buffer> create_buffer(std::string name)
+			{
+				auto res = std::make_shared<thread_buffer>();
+				res->name = std::move(name);
+				std::lock_guard<std::mutex> lock(m_mutex);
+				res->tid = ++m_next_tid;
+				m_buffers.emplace_back(res);
+				return res;
+			}
+			std::vector<std::shared_ptr<thread_buffer>> buffers()
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				return m_buffers;
+			}
+			// 清空所有事件, 并丢弃已退出线程的缓冲区
+			void clear()
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				std::erase_if(m_buffers, [](const std::shared_ptr<thread_buffer>& buffer) { return buffer.use_count() == 1; });
+				for (auto& buffer : m_buffers)
+				{
+					std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+					buffer->events.clear();
+				}
+				events = 0;
+				dropped = 0;
+			}
+		private:
+			std::mutex m_mutex;
+			std::vector<std::shared_ptr<thread_buffer>> m_buffers;
+			std::uint64_t m_next_tid = 0;
+		};
+
+		// 当前线程的span嵌套深度与当前请求是否被采中
+		inline thread_local std::size_t t_depth = 0;
+		inline thread_local bool t_sampled = false;
+		inline thread_local std::string t_thread_name;
+		inline thread_local std::shared_ptr<thread_buffer> t_buffer;
+
+		inline bool sample()
+		{
+			const auto rate = registry::instance().sample_rate.load(std::memory_order_relaxed);
+			if (rate >= 1.0)
+			{
+				return true;
+			}
+			if (rate <= 0.0)
+			{
+				return false;
+			}
+			thread_local std::minstd_rand generator{ static_cast<std::uint_fast32_t>(std::hash<std::thread::id>{}(std::this_thread::get_id()) ^ now_ns()) };
+			return std::uniform_real_distribution<double>(0.0, 1.0)(generator) < rate;
+		}
+
+		inline void record(event e)
+		{
+			auto& reg = registry::instance();
+			if (reg.events.fetch_add(1, std::memory_order_relaxed) >= reg.max_events.load(std::memory_order_relaxed))
+			{
+				reg.events.fetch_sub(1, std::memory_order_relaxed);
+				reg.dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			if (!t_buffer)
+			{
+				t_buffer = reg.create_buffer(t_thread_name);
+			}
+			std::lock_guard<std::mutex> lock(t_buffer->mutex);
+			t_buffer->events.emplace_back(std::move(e));
+		}
+
+		inline void append_escaped(std::string& out, std::string_view text)
+		{
+			for (const auto c : text)
+			{
+				switch (c)
+				{
+				case '"': out += "\\\""; break;
+				case '\\': out += "\\\\"; break;
+				case '\n': out += "\\n"; break;
+				case '\r': out += "\\r"; break;
+				case '\t': out += "\\t"; break;
+				default:
+					if (static_cast<unsigned char>(c) < 0x20)
+					{
+						out += std::format("\\u{:04x}", static_cast<unsigned>(c));
+					}
+					else
+					{
+						out += c;
+					}
+					break;
+				}
+			}
+		}
+	}
+
+	// 开启追踪, sample_rate为最外层span被记录的概率(0~1), max_events为内存中最多保留的事件数, 超出后丢弃新事件
+	inline void enable(const double sample_rate = 1.0, const std::size_t max_events = 1'000'000)
+	{
+		auto& reg = detail::registry::instance();
+		detail::epoch();
+		reg.sample_rate = sample_rate;
+		reg.max_events = max_events;
+		reg.enabled.store(true, std::memory_order_release);
+	}
+	// 关闭后已记录的事件仍然保留, 可以继续导出
+	inline void disable()
+	{
+		detail::registry::instance().enabled.store(false, std::memory_order_release);
+	}
+	inline bool enabled() noexcept
+	{
+		return detail::registry::instance().enabled.load(std::memory_order_relaxed);
+	}
+	inline void set_sample_rate(const double sample_rate)
+	{
+		detail::registry::instance().sample_rate = sample_rate;
+	}
+	inline void clear()
+	{
+		detail::registry::instance().clear();
+	}
+	// 因超出max_events被丢弃的事件数
+	inline std::size_t dropped() noexcept
+	{
+		return detail::registry::instance().dropped.load(std::memory_order_relaxed);
+	}
+	// 导出中显示的线程名, 需在该线程记录第一个事件前设置
+	inline void set_thread_name(std::string name)
+	{
+		detail::t_thread_name = std::move(name);
+		if (detail::t_buffer)
+		{
+			std::lock_guard<std::mutex> lock(detail::t_buffer->mutex);
+			detail::t_buffer->name = detail::t_thread_name;
+		}
+	}
+
+	// 作用域span, 析构时记录一个完整事件; name与category必须是静态字符串
+	class span
+	{
+	public:
+		span(const char* name, const char* category) noexcept
+		{
+			if (!enabled())
+			{
+				return;
+			}
+			if (detail::t_depth == 0)
+			{
+				detail::t_sampled = detail::sample();
+			}
+			detail::t_depth++;
+			m_entered = true;
+			if (detail::t_sampled)
+			{
+				m_name = name;
+				m_category = category;
+				m_start = detail::now_ns();
+			}
+		}
+		~span()
+		{
+			if (m_name != nullptr)
+			{
+				try
+				{
+					detail::record(detail::event{ m_name, m_category, 'X', m_start, detail::now_ns() - m_start, 0, std::move(m_args) });
+				}
+				catch (...) {}
+			}
+			if (m_entered)
+			{
+				detail::t_depth--;
+			}
+		}
+		span(const span&) = delete;
+		span& operator=(const span&) = delete;
+
+		// 是否正在记录, 计算代价较高的参数前先检查
+		explicit operator bool() const noexcept
+		{
+			return m_name != nullptr;
+		}
+		span& arg(std::string_view key, std::string_view value)
+		{
+			if (m_name != nullptr)
+			{
+				append_key(key);
+				m_args += '"';
+				detail::append_escaped(m_args, value);
+				m_args += '"';
+			}
+			return *this;
+		}
+		span& arg(std::string_view key, const char* value)
+		{
+			return arg(key, std::string_view(value == nullptr ? "" : value));
+		}
+		template <class T>
+			requires std::is_arithmetic_v<T>
+		span& arg(std::string_view key, const T value)
+		{
+			if (m_name != nullptr)
+			{
+				append_key(key);
+				m_args += std::format("{}", value);
+			}
+			return *this;
+		}
+	private:
+		const char* m_name = nullptr;
+		const char* m_category = nullptr;
+		std::uint64_t m_start = 0;
+		bool m_entered = false;
+		std::string m_args;
+
+		void append_key(std::string_view key)
+		{
+			if (!m_args.empty())
+			{
+				m_args += ',';
+			}
+			m_args += '"';
+			detail::append_escaped(m_args, key);
+			m_args += "\":";
+		}
+	};
+
+	// 跨线程传递的追踪上下文: 提交任务时capture, 在执行任务的线程上用adopt恢复
+	struct context
+	{
+		bool nested = false;  // 是否在某个span内提交, 否则任务自己作为最外层span采样
+		bool sampled = false;
+		std::uint64_t flow_id = 0;
+	};
+
+	// 在被采中的span内提交时记录flow的起点
+	inline context capture(const char* name = "thread_pool::enqueue") noexcept
+	{
+		if (!enabled() || detail::t_depth == 0)
+		{
+			return {};
+		}
+		if (!detail::t_sampled)
+		{
+			return { true, false, 0 };
+		}
+		context res{ true, true, detail::registry::instance().next_flow.fetch_add(1, std::memory_order_relaxed) };
+		try
+		{
+			detail::record(detail::event{ name, "flow", 's', detail::now_ns(), 0, res.flow_id, {} });
+		}
+		catch (...) {}
+		return res;
+	}
+
+	// 作用域内的span视为ctx所属请求的嵌套span, 沿用该请求的采样结果
+	class adopt
+	{
+	public:
+		explicit adopt(const context& ctx, const char* name = "thread_pool::enqueue") noexcept
+			: m_depth{ detail::t_depth }, m_sampled{ detail::t_sampled }
+		{
+			if (!ctx.nested || !enabled())
+			{
+				return;
+			}
+			detail::t_depth++;
+			detail::t_sampled = ctx.sampled;
+			if (!ctx.sampled)
+			{
+				return;
+			}
+			try
+			{
+				detail::record(detail::event{ name, "flow", 'f', detail::now_ns(), 0, ctx.flow_id, {} });
+			}
+			catch (...) {}
+		}
+		~adopt()
+		{
+			detail::t_depth = m_depth;
+			detail::t_sampled = m_sampled;
+		}
+		adopt(const adopt&) = delete;
+		adopt& operator=(const adopt&) = delete;
+	private:
+		std::size_t m_depth;
+		bool m_sampled;
+	};
+
+	// 序列化为Chrome trace-event JSON, 时间单位为微秒
+	inline std::string json()
+	{
+		std::string res = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+		bool first = true;
+		auto begin_event = [&]
+			{
+				if (!first)
+				{
+					res += ",\n";
+				}
+				first = false;
+			};
+		begin_event();
+		res += "{\"ph\":\"M\",\"pid\":1,\"tid\":0,\"name\":\"process_name\",\"args\":{\"name\":\"qbot_memory\"}}";
+		for (const auto& buffer : detail::registry::instance().buffers())
+		{
+			std::lock_guard<std::mutex> lock(buffer->mutex);
+			if (!buffer->name.empty())
+			{
+				begin_event();
+				res += std::format("{{\"ph\":\"M\",\"pid\":1,\"tid\":{},\"name\":\"thread_name\",\"args\":{{\"name\":\"", buffer->tid);
+				detail::append_escaped(res, buffer->name);
+				res += "\"}}";
+			}
+			for (const auto& e : buffer->events)
+			{
+				begin_event();
+				res += std::format("{{\"ph\":\"{}\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"name\":\"", e.phase, buffer->tid, static_cast<double>(e.start_ns) / 1e3);
+				detail::append_escaped(res, e.name);
+				res += "\",\"cat\":\"";
+				detail::append_escaped(res, e.category);
+				res += '"';
+				switch (e.phase)
+				{
+				case 'X':
+					res += std::format(",\"dur\":{:.3f}", static_cast<double>(e.duration_ns) / 1e3);
+					break;
+				case 's':
+					res += std::format(",\"id\":{}", e.flow_id);
+					break;
+				case 'f':
+					// 终点绑定到其后开始的第一个span, 即任务本身
+					res += std::format(",\"id\":{}", e.flow_id);
+					break;
+				}
+				if (!e.args.empty())
+				{
+					res += ",\"args\":{";
+					res += e.args;
+					res += '}';
+				}
+				res += '}';
+			}
+		}
+		res += std::format("\n],\"otherData\":{{\"dropped_events\":{}}}}}\n", dropped());
+		return res;
+	}
+
+	inline void write(const std::filesystem::path& path)
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file)
+		{
+			throw exception::runtime_error(std::format("无法写入追踪文件: {}", path.string()));
+		}
+		file << json();
+	}
+}
@@ -0,0 +1,99 @@
+"""本地向量接口桩服务, 用于离线测试 memory::embedding::client
+
+兼容 Ollama 的两个接口:
+    POST /api/embed       {"model": ..., "input": "文本" 或 ["文本", ...]} -> {"model": ..., "embeddings": [[...], ...]}
+    POST /api/embeddings  {"model": ..., "prompt": "文本"}                 -> {"embedding": [...]}
+
+同一文本总是得到相同的单位向量(由文本的 SHA-256 作为随机种子生成), 不同文本的向量近似正交
+
+用法:
+    python embedding_stub_server.py --port 11434 --dimension 768 --fail-rate 0.1 --delay-ms 5
+"""
+
+import argparse
+import hashlib
+import json
+import math
+import random
+import struct
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+
+def text_to_vector(text: str, dimension: int) -> list[float]:
+    seed = struct.unpack("<Q", hashlib.sha256(text.encode("utf-8")).digest()[:8])[0]
+    rng = random.Random(seed)
+    vector = [rng.gauss(0.0, 1.0) for _ in range(dimension)]
+    norm = math.sqrt(sum(x * x for x in vector)) or 1.0
+    return [x / norm for x in vector]
+
+
+class handler(BaseHTTPRequestHandler):
+    # HTTP/1.1 才能保持长连接, 每个响应都必须带 Content-Length
+    protocol_version = "HTTP/1.1"
+
+    def do_POST(self):
+        length = int(self.headers.get("Content-Length", 0))
+        try:
+            body = json.loads(self.rfile.read(length) or b"{}")
+        except json.JSONDecodeError as e:
+            self.reply(400, {"error": f"invalid json: {e}"})
+            return
+
+        options = self.server.options
+        if options.delay_ms > 0:
+            time.sleep(options.delay_ms / 1000.0)
+        # 按比例返回 503, 用于测试客户端的重试与退避
+        if options.fail_rate > 0 and random.random() < options.fail_rate:
+            self.reply(503, {"error": "injected failure"})
+            return
+
+        if self.path == "/api/embed":
+            texts = body.get("input", [])
+            if isinstance(texts, str):
+                texts = [texts]
+            self.reply(200, {
+                "model": body.get("model", ""),
+                "embeddings": [text_to_vector(t, options.dimension) for t in texts],
+            })
+        elif self.path == "/api/embeddings":
+            self.reply(200, {"embedding": text_to_vector(body.get("prompt", ""), options.dimension)})
+        else:
+            self.reply(404, {"error": f"unknown path {self.path}"})
+
+    def reply(self, status: int, payload: dict):
+        data = json.dumps(payload).encode("utf-8")
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def log_message(self, format, *args):
+        if self.server.options.verbose:
+            super().log_message(format, *args)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="本地向量接口桩服务")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=11434)
+    parser.add_argument("--dimension", type=int, default=768)
+    parser.add_argument("--fail-rate", type=float, default=0.0, help="返回 503 的概率, 0~1")
+    parser.add_argument("--delay-ms", type=float, default=0.0, help="每个请求的模拟延迟")
+    parser.add_argument("--verbose", action="store_true")
+    options = parser.parse_args()
+
+    server = ThreadingHTTPServer((options.host, options.port), handler)
+    server.options = options
+    print(f"embedding stub server listening on http://{options.host}:{options.port} (dimension={options.dimension})")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.server_close()
+
+
+if __name__ == "__main__":
+    main()